@@ -66,7 +66,7 @@ typedef struct stats {
 } st_stats ;
 
 static unsigned int hash_from_key(void* k) {
-	return joat_hash(k, sizeof(int));
+	return key_hash(k, sizeof(int));
 }
 
 typedef struct bpt_node_id {
@@ -346,5 +346,5 @@ static int key_equal(void* k1, void* k2) {
 
 
 static unsigned int hash_from_key(void* k) {
-	return joat_hash(k, sizeof(int));
+	return key_hash(k, sizeof(int));
 }
@@ -0,0 +1,187 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <memory.h>
+#include <assert.h>
+
+#include "blocked_bloom.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLOOM_AVX2 1
+#include <immintrin.h>
+#endif
+
+#define BLOCK_SIZE sizeof(blocked_bloom_block)
+#define BLOCK_BITS (BLOCK_SIZE * 8)
+
+/* Odd multipliers spreading the second hash over the 8 words of a block */
+static const uint32_t salts[8] = {
+	0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d,
+	0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31
+};
+
+static int (*contains_any)(blocked_bloom** f, int m, flat_key_hash* h, int n);
+
+static void make_mask(unsigned int h, uint64_t* mask);
+static int contains_any_scalar(blocked_bloom** f, int m,
+	flat_key_hash* h, int n);
+#ifdef BLOOM_AVX2
+static int contains_any_avx2(blocked_bloom** f, int m,
+	flat_key_hash* h, int n);
+#endif
+
+
+blocked_bloom* blocked_bloom_new(int bits) {
+	blocked_bloom* b;
+	unsigned int blocks;
+	
+	blocks = 1;
+	while (blocks * BLOCK_BITS < bits)
+		blocks *= 2;
+	
+	b = DB_MALLOC(sizeof(blocked_bloom));
+	b->block_mask = blocks - 1;
+	b->mem = DB_MALLOC(blocks * BLOCK_SIZE + BLOCK_SIZE - 1);
+	b->blocks = (blocked_bloom_block*)
+		(((uintptr_t)b->mem + BLOCK_SIZE - 1) & ~(uintptr_t)(BLOCK_SIZE - 1));
+	blocked_bloom_clear(b);
+	
+	if (contains_any == NULL)
+		blocked_bloom_use_avx2(1);
+	return b;
+}
+
+
+int blocked_bloom_use_avx2(int on) {
+	contains_any = contains_any_scalar;
+#ifdef BLOOM_AVX2
+	if (on && __builtin_cpu_supports("avx2")) {
+		contains_any = contains_any_avx2;
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+
+void blocked_bloom_destroy(blocked_bloom* b) {
+	DB_FREE(b->mem);
+	DB_FREE(b);
+}
+
+
+void blocked_bloom_add_hashes(blocked_bloom* b, unsigned int* h) {
+	int i;
+	uint64_t mask[8];
+	blocked_bloom_block* block;
+	
+	make_mask(h[1], mask);
+	block = &b->blocks[h[0] & b->block_mask];
+	for (i = 0; i < 8; i++)
+		block->words[i] |= mask[i];
+}
+
+
+int blocked_bloom_contains_hashes(blocked_bloom* b, unsigned int* h) {
+	flat_key_hash kh;
+	kh.hash[0] = h[0];
+	kh.hash[1] = h[1];
+	return contains_any(&b, 1, &kh, 1);
+}
+
+
+int blocked_bloom_contains_any(blocked_bloom** f, int m,
+	flat_key_hash* h, int n) {
+	if (m == 0 || n == 0)
+		return 0;
+	return contains_any(f, m, h, n);
+}
+
+
+void blocked_bloom_clear(blocked_bloom* b) {
+	memset(b->blocks, 0, (b->block_mask + 1) * BLOCK_SIZE);
+}
+
+
+static void make_mask(unsigned int h, uint64_t* mask) {
+	int i;
+	for (i = 0; i < 8; i++)
+		mask[i] = 1ULL << ((uint32_t)(h * salts[i]) >> 26);
+}
+
+
+/*
+	The mask of each hash is computed once, then checked against the same
+	block of every filter.
+*/
+static int contains_any_scalar(blocked_bloom** f, int m,
+	flat_key_hash* h, int n) {
+	int i, j, w;
+	unsigned int block;
+	uint64_t mask[8];
+	uint64_t* words;
+	
+	for (j = 0; j < n; j++) {
+		make_mask(h[j].hash[1], mask);
+		block = h[j].hash[0] & f[0]->block_mask;
+		for (i = 0; i < m; i++) {
+			assert(f[i]->block_mask == f[0]->block_mask);
+			words = f[i]->blocks[block].words;
+			for (w = 0; w < 8; w++)
+				if ((words[w] & mask[w]) != mask[w])
+					break;
+			if (w == 8)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+
+#ifdef BLOOM_AVX2
+__attribute__((target("avx2")))
+static int contains_any_avx2(blocked_bloom** f, int m,
+	flat_key_hash* h, int n) {
+	int i, j;
+	unsigned int block;
+	__m256i s, one, bits, lo, hi;
+	__m256i* words;
+	
+	s = _mm256_loadu_si256((__m256i*)salts);
+	one = _mm256_set1_epi64x(1);
+	for (j = 0; j < n; j++) {
+		bits = _mm256_srli_epi32(
+			_mm256_mullo_epi32(_mm256_set1_epi32(h[j].hash[1]), s), 26);
+		lo = _mm256_sllv_epi64(one,
+			_mm256_cvtepu32_epi64(_mm256_castsi256_si128(bits)));
+		hi = _mm256_sllv_epi64(one,
+			_mm256_cvtepu32_epi64(_mm256_extracti128_si256(bits, 1)));
+		block = h[j].hash[0] & f[0]->block_mask;
+		for (i = 0; i < m; i++) {
+			assert(f[i]->block_mask == f[0]->block_mask);
+			words = (__m256i*)f[i]->blocks[block].words;
+			if (_mm256_testc_si256(_mm256_load_si256(&words[0]), lo) &&
+				_mm256_testc_si256(_mm256_load_si256(&words[1]), hi))
+				return 1;
+		}
+	}
+	return 0;
+}
+#endif
@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _BLOCKED_BLOOM_H_
+#define _BLOCKED_BLOOM_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dsmDB_priv.h"
+#include <stdint.h>
+
+/*
+	Bloom filter whose bits for a key all live in one 64 byte block, so
+	that a membership test touches a single cache line. The first hash of
+	the pair selects the block, the second sets one bit in each of the 8
+	64-bit words of the block. The number of blocks is a power of two.
+	Tests use AVX2 when the CPU has it.
+*/
+typedef struct blocked_bloom_block_t {
+	uint64_t words[8];
+} blocked_bloom_block;
+
+typedef struct blocked_bloom_t {
+	unsigned int block_mask;
+	void* mem;
+	blocked_bloom_block* blocks;
+} blocked_bloom;
+
+
+/* Creates a filter of at least bits bits */
+blocked_bloom* blocked_bloom_new(int bits);
+
+void blocked_bloom_destroy(blocked_bloom* b);
+
+void blocked_bloom_add_hashes(blocked_bloom* b, unsigned int* h);
+
+int blocked_bloom_contains_hashes(blocked_bloom* b, unsigned int* h);
+
+/* Returns 1 if any of the n hashes is in any of the m filters, which
+   must all have the same size */
+int blocked_bloom_contains_any(blocked_bloom** f, int m,
+	flat_key_hash* h, int n);
+
+void blocked_bloom_clear(blocked_bloom* b);
+
+/* Selects the AVX2 tests if on and the CPU has AVX2, the scalar ones
+   otherwise. Returns 1 if AVX2 is now in use. */
+int blocked_bloom_use_avx2(int on);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _BLOCKED_BLOOM_H_ */
@@ -33,8 +33,8 @@
 #define DIV8(n) (n >> 3)
 
 
+/* The hashes are the two halves of key_hash_pair(), as sent by the nodes */
 #define HASHES_SIZE 2
-static hash_fun hashes[HASHES_SIZE] = {joat_hash, djb2_hash};
 
 static void __bloom_set_bit(bloom* b, unsigned int h);
 static void __bloom_unset_bit(bloom* b, unsigned int h);
@@ -62,7 +62,6 @@ bloom* bloom_new(int bits, int n_hash) {
     b = DB_MALLOC(sizeof(bloom) + bytes);
     b->bit_size = bits;
     b->n_hash = n_hash;
-    b->hash_funcs = hashes;
 
     memset (b->bitmap, 0, bytes);
 
@@ -91,12 +90,9 @@ int bloom_bit_is_set(bloom* b, unsigned int h) {
 
 
 void bloom_add(bloom* b, char* data, int size) {
-    int i;
-    unsigned int h;
-    for (i = 0; i < b->n_hash; i++) {
-        h = b->hash_funcs[i](data, size);
-        __bloom_set_bit(b, h);
-    }
+    unsigned int h[HASHES_SIZE];
+    key_hash_pair(data, size, h);
+    bloom_add_hashes(b, h);
 }
 
 
@@ -108,22 +104,15 @@ void bloom_add_hashes(bloom* b, unsigned int* h) {
 
 
 int bloom_contains(bloom* b, char* data, int size) {
-    int i;
-    unsigned int h;
-    for (i = 0; i < b->n_hash; i++) {
-        h = b->hash_funcs[i](data, size);
-        if (!__bloom_bit_is_set(b, h))
-            return 0;
-    }
-    return 1;
+    unsigned int h[HASHES_SIZE];
+    key_hash_pair(data, size, h);
+    return bloom_contains_hashes(b, h);
 }
 
 
 unsigned int* bloom_gen_hashes(bloom* b, char* data, int size) {
-    int i;
-    unsigned int* a = DB_MALLOC (sizeof(unsigned int) * b->n_hash);
-    for (i = 0; i < b->n_hash; i++)
-        a[i] = b->hash_funcs[i](data, size);
+    unsigned int* a = DB_MALLOC (sizeof(unsigned int) * HASHES_SIZE);
+    key_hash_pair(data, size, a);
     return a;
 }
 
@@ -147,9 +136,7 @@ void bloom_print(bloom* b) {
     int byte_size = DIV8(b->bit_size);
     printf("bits: %d bytes: %d\n", b->bit_size, byte_size);
    
-    for (i = 0; i < b->n_hash; i++) {
-        printf("h = %p\n", b->hash_funcs[i]);
-    }
+    printf("hashes: %d version: %d\n", b->n_hash, HashVersion);
 
     for (i = 0; i < byte_size; i++) {
         printf("%d \t", i);
@@ -24,7 +24,6 @@
 
 typedef struct bloom_t {
     int n_hash;
-    hash_fun* hash_funcs;
     unsigned int bit_size;
     unsigned char bitmap[0];
 } bloom;
@@ -22,6 +22,7 @@
 #include "config_reader.h"
 #include "dsmDB_priv.h"
 #include "validation.h"
+#include "group_commit.h"
 #include "queue.h"
 #include "socket_util.h"
 #include "util.h"
@@ -83,44 +84,48 @@ static void print_stats();
 #define MAX_COMMAND_SIZE 256 * 1024
 static struct event_base *base;
 static struct bufferevent *acc_bev;
-static struct event *timeout_ev;
 struct evpaxos_config *conf;
 
 static int bytes_left;
-static struct timeval timeout_tv;
 
-// Submit committed transaction to paxos
-static int submit_transaction(tr_submit_msg *t) {
-	int rv, written;
+// Submit a buffer of validated transactions to paxos (see group_commit.h)
+static void submit_buffer(struct evbuffer* payload, int count, int full) {
 	paxos_msg pm;
-	struct evbuffer* payload = evbuffer_new();
-	written = add_validation_state(payload);
-	assert(written == evbuffer_get_length(payload));
+	
 	pm.data_size = evbuffer_get_length(payload);
 	pm.type = submit;
-	LOG(VRB,("Submitting tx of size %d\n", pm.data_size));
+	LOG(VRB,("Submitting %d tx in %d bytes\n", count, pm.data_size));
 	bufferevent_write(acc_bev, &pm, sizeof(paxos_msg));
 	bufferevent_write_buffer(acc_bev, payload);
-	evbuffer_free(payload);
+	
+	submitted_bytes += pm.data_size;
+	submitted_buffers++;
+	if (full)
+		submitted_full++;
+	else
+		submitted_timeout++;
+	if (count > max_batch_size)
+		max_batch_size = count;
+	if (pm.data_size > max_buffer_size)
+		max_buffer_size = pm.data_size;
+	last_submitted = time(NULL);
+	if (submitted_buffers == 1)
+		first_submitted = last_submitted;
 }
 
-// Since we are no longer batching tx due to the use of TCP we can
-// submit right away
+
 static int validate(tr_submit_msg* t) {
 	int commit = 1;
-	int bytes_used;
 	
-	if (validate_transaction(t)) {
-	    bytes_used = sizeof(tr_id) + t->writeset_size;
+	if (TR_SUBMIT_MSG_SIZE(t) > max_tx_size)
+		max_tx_size = TR_SUBMIT_MSG_SIZE(t);
+	
+	if (group_commit_validate(t)) {
 		committed_tx++;
-
 	} else {
-	    bytes_used = sizeof(tr_id);
 	    aborted_tx++;
 		commit = 0;
 	}
-	submit_transaction(t);
-	reset_validation_buffer();
 	
 	return commit;
 }
@@ -162,7 +167,7 @@ static void add_existing_nodes(join_msg *jmsg, struct evbuffer* payload) {
 	}
 }
 
-static void handle_join_message(join_msg *jmsg) {
+static void handle_join_message(join_msg *jmsg, int hash_version) {
 	
 	int rv, written,i, id;
 	paxos_msg pm;
@@ -171,6 +176,13 @@ static void handle_join_message(join_msg *jmsg) {
 	node_info n;
 	struct peer *p;
 	
+	// A node hashing keys differently would miss conflicts, refuse it
+	if (hash_version != HashVersion) {
+		fprintf(stderr, "cm: refusing join from %s:%d, hash version %d (ours %d)\n",
+			jmsg->address, jmsg->port, hash_version, HashVersion);
+		return;
+	}
+	
 	// Do we have a pending valid join? If so, ignore
 	tm = time(NULL);
 	if (node_pending && (tm - node_join_attempted) < 0) return;
@@ -245,6 +257,12 @@ struct request {
 	char data[0];
 };
 
+// A node connection. Until its join, a node is assumed to be an older
+// one, which only hashes with HASH_JOAT_DJB2.
+struct connection {
+	int hash_version;
+};
+
 static void signal_int(int sig) {
 	print_stats();
 	exit(0);
@@ -273,6 +291,7 @@ on_read(struct bufferevent* bev, void* arg)
 	short type;
 	join_msg jmsg;
 	tr_submit_msg tmsg;
+	struct connection* c = arg;
 	len =0;
 	memset(&tmsg, 0, sizeof(tr_submit_msg));
 	
@@ -292,13 +311,21 @@ on_read(struct bufferevent* bev, void* arg)
 				if (len < dlen) return;
 				
 				evbuffer_remove(b, read_buffer, dlen);
+				((tr_submit_msg *) read_buffer)->hash_version = c->hash_version;
 				validate((tr_submit_msg *) read_buffer);
 				break;
 			case NODE_JOIN:
+			case NODE_JOIN_HASHED:
 				if(len < sizeof(join_msg)) return;
 				
+				// The reconfiguration follows the transactions before it
+				group_commit_flush(1);
 				evbuffer_remove(b, &jmsg, sizeof(join_msg));
-				handle_join_message(&jmsg);
+				if (type == NODE_JOIN_HASHED)
+					c->hash_version = jmsg.hash_version;
+				else
+					c->hash_version = HASH_JOAT_DJB2;
+				handle_join_message(&jmsg, c->hash_version);
 				break;  
 			default: 
 				printf("dropping unknown message type %d \n",type);
@@ -313,8 +340,10 @@ on_bev_error(struct bufferevent *bev, short events, void *arg)
 {
 	if (events & BEV_EVENT_ERROR)
 		perror("Error from bufferevent");
-	if (events & (BEV_EVENT_EOF|BEV_EVENT_ERROR))
+	if (events & (BEV_EVENT_EOF|BEV_EVENT_ERROR)) {
 		bufferevent_free(bev);
+		free(arg);
+	}
 }
 
 static void
@@ -324,7 +353,9 @@ on_connect(struct evconnlistener *l, evutil_socket_t fd,
 	struct event_base* b = evconnlistener_get_base(l);
 	struct bufferevent *bev = bufferevent_socket_new(b, fd, 
 		BEV_OPT_CLOSE_ON_FREE);
-	bufferevent_setcb(bev, on_read, NULL, on_bev_error, arg);
+	struct connection *c = malloc(sizeof(struct connection));
+	c->hash_version = HASH_JOAT_DJB2;
+	bufferevent_setcb(bev, on_read, NULL, on_bev_error, c);
 	bufferevent_enable(bev, EV_READ);
 	LOG(VRB, ("accepted connection from...\n"));
 }
@@ -417,6 +448,8 @@ static void init(const char* tapioca_config, const char* paxos_config) {
 	read_buffer = malloc(MAX_COMMAND_SIZE);
 	memset(read_buffer, 0, MAX_COMMAND_SIZE);
 	
+	group_commit_init(base, submit_buffer);
+	
 	// The ceritifer will now need to learn configuration change requests
 	struct evlearner *l = evlearner_init(paxos_config, on_deliver, NULL, base);
 	assert(l != NULL);
@@ -424,8 +457,6 @@ static void init(const char* tapioca_config, const char* paxos_config) {
 	/* Setup local listener */
 	struct evconnlistener *el =  bind_new_listener(base, LeaderIP, LeaderPort, 
 												   on_connect, on_listener_error);
-	gettimeofday(&timeout_tv, NULL);
-
 	event_base_dispatch(base);
 }
 
@@ -450,6 +481,7 @@ void print_stats() {
 	float percent_conflict = (float)0;
 	float abort_percent = (float)0;
     float too_old = (float)0;
+    float hash_mismatch = (float)0;
     int t = (int)last_submitted - (int)first_submitted;
     
 	submitted_tx = aborted_tx + committed_tx;
@@ -462,9 +494,14 @@ void print_stats() {
 		percent_conflict = (((float)write_conflict_counter()) / aborted_tx) * 100;
    	 	percent_prevws_conflict = (((float)write_conflict_prevws_counter()) / aborted_tx) * 100;
 		too_old = (((float) too_old_counter()) / aborted_tx) * 100;
+		hash_mismatch = (((float) hash_mismatch_counter()) / aborted_tx) * 100;
 	}
 	
     printf("CM UDP statistics:\n");
+	if (ValidationMode == VALIDATION_EXACT)
+		printf("Validation: exact\n");
+	else
+		printf("Validation: bloom\n");
 	printf("Max count %d\n", max_count);
     printf("Bytes submitted: %lld\n", submitted_bytes);
     printf("Buffers submitted: %d\n", submitted_buffers);
@@ -472,14 +509,19 @@ void print_stats() {
     printf("Submissions full: %d\n", submitted_full);
     printf("Transactions submitted: %d\n", submitted_tx);
     printf("Transactions aborted: %d (%.2f%%)\n", aborted_tx, abort_percent);
-    printf("Reason: %.2f%% ws_conflict, %.2f%% prev_ws_conflict, %.2f%% too old\n",
-        percent_conflict, percent_prevws_conflict, too_old);
+    printf("Reason: %.2f%% ws_conflict, %.2f%% prev_ws_conflict, %.2f%% too old, %.2f%% hash mismatch\n",
+        percent_conflict, percent_prevws_conflict, too_old, hash_mismatch);
     printf("Transactions reordered: %d\n", reorder_counter());
+	if (ValidationMode == VALIDATION_BLOOM && submitted_tx > 0)
+		printf("Summaries tested per transaction: %.2f\n",
+			(float)summaries_tested_counter() / submitted_tx);
     printf("Maximum transaction size: %d\n", max_tx_size);
 	printf("Maximum batch size: %d\n", max_batch_size);
     printf("Maximum buffer size: %d\n", max_buffer_size);
     printf("Maximum buffer count: %d\n", max_buffer_count);
-	if (submitted_tx > 0) {
+	if (submitted_buffers > 0)
+		printf("Transactions per buffer: %.2f\n", (float)submitted_tx / submitted_buffers);
+	if (submitted_tx > 0 && t > 0) {
     	printf("Certifications / sec: %d\n", submitted_tx / t);
 	    printf("Data out rate: %llu Mbps\n", ((submitted_bytes / (1024*1024)) / t) * 8);
 		printf("Data in rate: %llu Mbps\n", ((received_bytes / (1024*1024)) / t) * 8);
@@ -0,0 +1,91 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "group_commit.h"
+#include "validation.h"
+
+#include <paxos.h>
+#include <assert.h>
+
+
+static struct event* timeout_ev = NULL;
+static struct timeval timeout_tv;
+static struct evbuffer* payload = NULL;
+static group_commit_cb submit_cb;
+
+static void on_deliver_timeout(evutil_socket_t fd, short event, void* arg);
+
+
+void group_commit_init(struct event_base* base, group_commit_cb cb) {
+	submit_cb = cb;
+	payload = evbuffer_new();
+	assert(payload != NULL);
+	timeout_ev = evtimer_new(base, on_deliver_timeout, NULL);
+	assert(timeout_ev != NULL);
+	timeout_tv.tv_sec = ValidationDeliverInterval / 1000000;
+	timeout_tv.tv_usec = ValidationDeliverInterval % 1000000;
+}
+
+
+void group_commit_free() {
+	event_free(timeout_ev);
+	evbuffer_free(payload);
+	timeout_ev = NULL;
+	payload = NULL;
+}
+
+
+int group_commit_validate(tr_submit_msg* t) {
+	int commit;
+	
+	// The whole buffer must fit in a paxos value
+	if (validation_state_size() + sizeof(tr_id) + t->writeset_size >
+			MAX_TRANSACTION_SIZE)
+		group_commit_flush(1);
+	
+	commit = validate_transaction(t);
+	
+	if (is_validation_buf_full() || ValidationDeliverInterval <= 0)
+		group_commit_flush(1);
+	else if (validated_count() == 1)
+		evtimer_add(timeout_ev, &timeout_tv);
+	
+	return commit;
+}
+
+
+void group_commit_flush(int full) {
+	int written, count;
+	
+	count = validated_count();
+	if (count == 0)
+		return;
+	
+	written = add_validation_state(payload);
+	assert(written == evbuffer_get_length(payload));
+	submit_cb(payload, count, full);
+	evbuffer_drain(payload, evbuffer_get_length(payload));
+	reset_validation_buffer();
+	evtimer_del(timeout_ev);
+}
+
+
+static void on_deliver_timeout(evutil_socket_t fd, short event, void* arg) {
+	group_commit_flush(0);
+}
@@ -0,0 +1,60 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GROUP_COMMIT_H_
+#define _GROUP_COMMIT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dsmDB_priv.h"
+#include <event2/event.h>
+#include <event2/buffer.h>
+
+/*
+	Group commit: transactions are validated into the validation buffer,
+	which is handed to the submit callback as a single tr_deliver_msg,
+	with its own ST, once full, when the next transaction would no longer
+	fit in a paxos value, or ValidationDeliverInterval microseconds after
+	its first transaction. An interval of 0 submits every transaction on
+	its own.
+	
+	The callback gets the message, the number of transactions in it and
+	whether the buffer was full, and must consume the message.
+*/
+typedef void (*group_commit_cb)(struct evbuffer* b, int count, int full);
+
+/* Sets up the buffer timer on base; init_validation() must be called
+   first */
+void group_commit_init(struct event_base* base, group_commit_cb cb);
+
+void group_commit_free();
+
+/* Validates t into the buffer, returns 1 if t commits */
+int group_commit_validate(tr_submit_msg* t);
+
+/* Submits the buffered transactions, if any */
+void group_commit_flush(int full);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _GROUP_COMMIT_H_ */
@@ -0,0 +1,133 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <memory.h>
+#include <assert.h>
+
+#include "last_writer.h"
+#include "dsmDB_priv.h"
+
+
+#define SLOT(lw, h) ((h)[1] & ((lw)->size - 1))
+#define FULL(lw) ((lw)->count >= (lw)->size / 4 * 3)
+
+static last_writer_entry* lookup(last_writer* lw, last_writer_entry* e,
+	unsigned int* h);
+static void evict(last_writer* lw, int newest);
+
+
+last_writer* last_writer_new(int size) {
+	last_writer* lw;
+	
+	lw = DB_MALLOC(sizeof(last_writer));
+	lw->size = 16;
+	while (lw->size < size)
+		lw->size *= 2;
+	lw->count = 0;
+	lw->horizon = 0;
+	lw->entries = DB_MALLOC(sizeof(last_writer_entry) * lw->size);
+	lw->spare = DB_MALLOC(sizeof(last_writer_entry) * lw->size);
+	memset(lw->entries, 0, sizeof(last_writer_entry) * lw->size);
+	return lw;
+}
+
+
+void last_writer_free(last_writer* lw) {
+	DB_FREE(lw->entries);
+	DB_FREE(lw->spare);
+	DB_FREE(lw);
+}
+
+
+void last_writer_set(last_writer* lw, unsigned int* h, int st) {
+	last_writer_entry* e;
+	
+	assert(st > 0);
+	e = lookup(lw, lw->entries, h);
+	if (e->st == 0) {
+		if (FULL(lw)) {
+			evict(lw, st);
+			e = lookup(lw, lw->entries, h);
+		}
+		e->hash[0] = h[0];
+		e->hash[1] = h[1];
+		lw->count++;
+	}
+	e->st = st;
+}
+
+
+int last_writer_get(last_writer* lw, unsigned int* h) {
+	return lookup(lw, lw->entries, h)->st;
+}
+
+
+int last_writer_horizon(last_writer* lw) {
+	return lw->horizon;
+}
+
+
+/* Returns the slot of h in e, or the empty slot where it would go */
+static last_writer_entry* lookup(last_writer* lw, last_writer_entry* e,
+	unsigned int* h) {
+	unsigned int i;
+	
+	i = SLOT(lw, h);
+	while (e[i].st != 0) {
+		if (e[i].hash[0] == h[0] && e[i].hash[1] == h[1])
+			break;
+		i = (i + 1) & (lw->size - 1);
+	}
+	return &e[i];
+}
+
+
+/*
+	Rehashes the writes newer than the middle ST between the oldest one
+	and newest, into the spare slots. Repeats if that is not enough, which
+	only happens when most writes share an ST, until even the writes at
+	newest go: the horizon then makes every reader conflict.
+*/
+static void evict(last_writer* lw, int newest) {
+	int i, oldest, cutoff;
+	last_writer_entry* tmp;
+	
+	while (FULL(lw)) {
+		oldest = newest;
+		for (i = 0; i < lw->size; i++)
+			if (lw->entries[i].st != 0 && lw->entries[i].st < oldest)
+				oldest = lw->entries[i].st;
+		cutoff = oldest + (newest - oldest) / 2;
+		
+		memset(lw->spare, 0, sizeof(last_writer_entry) * lw->size);
+		lw->count = 0;
+		for (i = 0; i < lw->size; i++) {
+			if (lw->entries[i].st > cutoff) {
+				*lookup(lw, lw->spare, lw->entries[i].hash) = lw->entries[i];
+				lw->count++;
+			}
+		}
+		tmp = lw->entries;
+		lw->entries = lw->spare;
+		lw->spare = tmp;
+		if (cutoff > lw->horizon)
+			lw->horizon = cutoff;
+	}
+}
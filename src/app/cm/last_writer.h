@@ -0,0 +1,70 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LAST_WRITER_H_
+#define _LAST_WRITER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+	Map from the full hash pair of a key, as sent by the nodes, to the ST
+	of the last transaction that wrote it. Used by the exact validator in
+	place of the bloom filters of the previous snapshots.
+	
+	The map has a fixed number of slots. When it gets 3/4 full the writes
+	older than the middle ST of the map are evicted, and the horizon moves
+	up to that ST: a key that is not in the map was last written at the
+	horizon or before.
+*/
+typedef struct last_writer_entry_t {
+	unsigned int hash[2];
+	int st;
+} last_writer_entry;
+
+typedef struct last_writer_t {
+	int size;
+	int count;
+	int horizon;
+	last_writer_entry* entries;
+	last_writer_entry* spare;
+} last_writer;
+
+
+/* Creates a map of size slots, rounded up to a power of two */
+last_writer* last_writer_new(int size);
+
+void last_writer_free(last_writer* lw);
+
+/* Records that the key with hash pair h was written at st, st > 0 */
+void last_writer_set(last_writer* lw, unsigned int* h, int st);
+
+/* Returns the ST at which the key with hash pair h was last written, or
+   0 if it is not in the map */
+int last_writer_get(last_writer* lw, unsigned int* h);
+
+/* Returns the newest ST evicted from the map */
+int last_writer_horizon(last_writer* lw);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LAST_WRITER_H_ */
@@ -20,6 +20,10 @@
 #ifndef _VALIDATION_H_
 #define _VALIDATION_H_
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #include "dsmDB_priv.h"
 #include "msg.h"
 #include <event2/buffer.h>
@@ -46,9 +50,21 @@ int write_conflict_prevws_counter();
 
 int too_old_counter();
 
+int hash_mismatch_counter();
+
+// Writeset summaries tested by the bloom validator
+int summaries_tested_counter();
+
 int validate_phase1(tr_submit_msg* t);
 int validate_phase2(tr_submit_msg* t, int commit);
 
 int add_validation_state(struct evbuffer *b);
 
+// Returns the number of bytes add_validation_state would write
+int validation_state_size();
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* _VALIDATION_H_ */
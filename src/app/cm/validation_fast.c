@@ -17,7 +17,8 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include "bloom.h"
+#include "blocked_bloom.h"
+#include "last_writer.h"
 #include "validation.h"
 
 #include <stdlib.h>
@@ -26,6 +27,7 @@
 
 #define MAX_ABORT_COUNT 512
 #define SKIP_VALIDATION 0
+#define MAX_SUMMARY_LEVELS 16
 
 typedef struct {
 	int type;
@@ -33,8 +35,7 @@ typedef struct {
     int abort_count;
     int commit_count;
 	int update_set_count;
-    bloom* ws;
-    bloom** snapshots;
+    blocked_bloom* ws;
     tr_id* abort_tr_ids;
     tr_id* commit_tr_ids;
 } validation_state;
@@ -46,13 +47,28 @@ typedef struct {
 } buffer;
 
 
+/*
+	Summaries of the writesets of the last summary_slots STs, the one of
+	the buffer included. Level 0 has a filter per ST, and a filter of
+	level l summarizes the 2^l STs of an aligned range, with 2^l times the
+	bits so that all levels have the same load. A range of STs is checked
+	against the largest aligned summaries it covers, descending into the
+	finer ones only on a hit.
+*/
+static blocked_bloom** summaries[MAX_SUMMARY_LEVELS];
+static int summary_levels;
+static int summary_slots;
+
 static buffer* us_buffer;
 static validation_state vs;
+static last_writer* lw;
 
 
 static int too_old = 0;
 static int ws_conflict = 0;
 static int prevws_conflict = 0;
+static int hash_mismatch = 0;
+static int summaries_tested = 0;
 
 
 static void buffer_clear(buffer* b) {
@@ -66,17 +82,80 @@ static void buffer_add(buffer* b, char* data, int size) {
 }
 
 
+/*
+	Summaries are kept for more than MaxPreviousST STs, so that those a
+	transaction is checked against are not reused by the buffer yet, and
+	up to the largest level a range of MaxPreviousST STs can cover.
+*/
+static void init_summaries() {
+    int i, level;
+    
+    summary_slots = 1;
+    while (summary_slots <= MaxPreviousST)
+        summary_slots *= 2;
+    summary_levels = 1;
+    while (summary_levels < MAX_SUMMARY_LEVELS &&
+           (1 << summary_levels) <= MaxPreviousST)
+        summary_levels++;
+    
+    for (level = 0; level < summary_levels; level++) {
+        summaries[level] = DB_MALLOC(sizeof(blocked_bloom*) *
+            (summary_slots >> level));
+        for (i = 0; i < (summary_slots >> level); i++)
+            summaries[level][i] = blocked_bloom_new(BLOCKED_BLOOM << level);
+    }
+}
+
+
+static blocked_bloom* summary(int level, int st) {
+    return summaries[level][(st & (summary_slots - 1)) >> level];
+}
+
+
+/* Clears the summaries whose range of STs starts at st */
+static void start_summaries(int st) {
+    int level;
+    for (level = 0; level < summary_levels; level++)
+        if ((st & ((1 << level) - 1)) == 0)
+            blocked_bloom_clear(summary(level, st));
+}
+
+
+static void add_to_summaries(unsigned int* h, int st) {
+    int level;
+    for (level = 0; level < summary_levels; level++)
+        blocked_bloom_add_hashes(summary(level, st), h);
+}
+
+
+/* Checks the summary of level and the range starting at st, and the
+   finer ones under it on a hit */
+static int summaries_contain(flat_key_hash* h, int n, int level, int st) {
+    blocked_bloom* b;
+    
+    b = summary(level, st);
+    summaries_tested++;
+    if (!blocked_bloom_contains_any(&b, 1, h, n))
+        return 0;
+    if (level == 0)
+        return 1;
+    return summaries_contain(h, n, level - 1, st) ||
+           summaries_contain(h, n, level - 1, st + (1 << (level - 1)));
+}
+
+
 void init_validation() {
-    int i;
 	vs.type = TRANSACTION_SUBMIT;
     vs.ST = 0;
     vs.abort_count = 0;
     vs.commit_count = 0;
 	vs.update_set_count = 0;
-    vs.ws = bloom_new(BIG_BLOOM);
-    vs.snapshots = DB_MALLOC(sizeof(bloom*) * MaxPreviousST);
-    for (i = 0; i < MaxPreviousST; i++)
-        vs.snapshots[i] = bloom_new(BIG_BLOOM);
+    if (ValidationMode == VALIDATION_EXACT) {
+        lw = last_writer_new(ValidationExactSize);
+    } else {
+        init_summaries();
+        vs.ws = summary(0, vs.ST + 1);
+    }
     vs.abort_tr_ids = DB_MALLOC(sizeof(tr_id) * MAX_ABORT_COUNT);
     vs.commit_tr_ids = DB_MALLOC(sizeof(tr_id) * ValidationBufferSize);
     us_buffer = DB_MALLOC(sizeof(buffer));
@@ -111,6 +190,21 @@ int write_conflict_prevws_counter() {
 
 
 int validation_cleanup() {
+    int i, level;
+    
+    if (lw != NULL)
+        last_writer_free(lw);
+    lw = NULL;
+    for (level = 0; level < summary_levels; level++) {
+        for (i = 0; i < (summary_slots >> level); i++)
+            blocked_bloom_destroy(summaries[level][i]);
+        DB_FREE(summaries[level]);
+    }
+    summary_levels = 0;
+    DB_FREE(vs.abort_tr_ids);
+    DB_FREE(vs.commit_tr_ids);
+    DB_FREE(us_buffer->data);
+    DB_FREE(us_buffer);
     return 1;
 }
 
@@ -120,20 +214,25 @@ int too_old_counter() {
 }
 
 
+int hash_mismatch_counter() {
+    return hash_mismatch;
+}
+
+
+int summaries_tested_counter() {
+    return summaries_tested;
+}
+
+
 void reset_validation_buffer() {
-    int i;
-    bloom* tmp;
-    
     vs.abort_count = 0;
     vs.commit_count = 0;
 	vs.update_set_count = 0;
     
-    tmp = vs.ws; 
-    vs.ws = vs.snapshots[MaxPreviousST-1];
-    bloom_clear(vs.ws);
-    for (i = MaxPreviousST-1; i > 0; i--)
-        vs.snapshots[i] = vs.snapshots[i-1];
-    vs.snapshots[0] = tmp;
+    if (ValidationMode == VALIDATION_BLOOM) {
+        start_summaries(vs.ST + 1);
+        vs.ws = summary(0, vs.ST + 1);
+    }
 
 	buffer_clear(us_buffer);
 }
@@ -158,7 +257,10 @@ static void commit_transaction(tr_submit_msg* t) {
 	if (!SKIP_VALIDATION) {
     	ws_hashes = TR_SUBMIT_MSG_WS_HASH(t);
     	for (i = 0; i < t->writeset_count; i++)
-        	bloom_add_hashes(vs.ws, ws_hashes[i].hash);
+			if (ValidationMode == VALIDATION_EXACT)
+				last_writer_set(lw, ws_hashes[i].hash, vs.ST + 1);
+			else
+        		add_to_summaries(ws_hashes[i].hash, vs.ST + 1);
     }
 	
     vs.commit_tr_ids[vs.commit_count] = t->id;
@@ -171,19 +273,58 @@ static void commit_transaction(tr_submit_msg* t) {
 
 
 static int validate_snapshots(tr_submit_msg* t, flat_key_hash* rs_hashes) {
-    int i, j;
-    for (i = 0; i < (vs.ST - t->start); i++)
-        for (j = 0; j < t->readset_count; j++)
-            if (bloom_contains_hashes(vs.snapshots[i], rs_hashes[j].hash))
-                return 0;
+    int level, st;
+    
+    st = t->start + 1;
+    while (st <= vs.ST) {
+        level = 0;
+        while (level + 1 < summary_levels &&
+               (st & ((2 << level) - 1)) == 0 &&
+               st + (2 << level) - 1 <= vs.ST)
+            level++;
+        if (summaries_contain(rs_hashes, t->readset_count, level, st))
+            return 0;
+        st += 1 << level;
+    }
     return 1;
 }
 
 
+/*
+	Exact validation: the transactions in the current buffer will be
+	delivered at vs.ST + 1, so a key read by t conflicts if it was last
+	written after t->start, and up to max_st. A key evicted from the map
+	conflicts if it may have been.
+*/
+static int validate_exact(tr_submit_msg* t, int max_st) {
+	int i, st;
+	flat_key_hash* rs_hashes;
+	
+	rs_hashes = TR_SUBMIT_MSG_RS_HASH(t);
+	for (i = 0; i < t->readset_count; i++) {
+		st = last_writer_get(lw, rs_hashes[i].hash);
+		if (st > t->start && st <= max_st) {
+			if (st > vs.ST)
+				ws_conflict++;
+			else
+				prevws_conflict++;
+			return 0;
+		}
+		if (st == 0 && last_writer_horizon(lw) > t->start) {
+			too_old++;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
 static int validate(tr_submit_msg* t) {
-    int i;
     flat_key_hash* rs_hashes;
     
+    if (ValidationMode == VALIDATION_EXACT)
+        return validate_exact(t, vs.ST + 1);
+    
     rs_hashes = TR_SUBMIT_MSG_RS_HASH(t);
     
     // Check readset of t against writesets of old snapshots
@@ -195,11 +336,9 @@ static int validate(tr_submit_msg* t) {
     }
 	
     // Check readset of t against writeset of current snapshot
-    for (i = 0; i < t->readset_count; i++) {
-        if (bloom_contains_hashes(vs.ws, rs_hashes[i].hash)) {
-            ws_conflict++;
-            return 0;
-        }
+    if (blocked_bloom_contains_any(&vs.ws, 1, rs_hashes, t->readset_count)) {
+        ws_conflict++;
+        return 0;
     }
     
     return 1;
@@ -207,12 +346,24 @@ static int validate(tr_submit_msg* t) {
 
 
 int validate_transaction(tr_submit_msg* t) {
+	// hashes computed with another function can't be compared with ours
+	if (t->hash_version != HashVersion) {
+		hash_mismatch++;
+		abort_transaction(t);
+		return 0;
+	}
+	
 	if (SKIP_VALIDATION) {
 		commit_transaction(t);
 		return 1;
 	}
 	
-    if ((t->start >= (vs.ST - MaxPreviousST)) && (t->start <= vs.ST)) {
+    if (ValidationMode == VALIDATION_EXACT && t->start <= vs.ST) {
+        if (validate(t)) {
+            commit_transaction(t);
+            return 1;
+        }
+    } else if ((t->start >= (vs.ST - MaxPreviousST)) && (t->start <= vs.ST)) {
         if (validate(t)) {
             commit_transaction(t);
             return 1;
@@ -228,6 +379,14 @@ int validate_transaction(tr_submit_msg* t) {
 int validate_phase1(tr_submit_msg* t) {
 	flat_key_hash* rs_hashes;
 	
+	if (t->hash_version != HashVersion) {
+		hash_mismatch++;
+		return 0;
+	}
+	
+	if (ValidationMode == VALIDATION_EXACT)
+		return validate_exact(t, vs.ST);
+	
 	if (t->start >= (vs.ST - MaxPreviousST)) {
 		rs_hashes = TR_SUBMIT_MSG_RS_HASH(t);
 		if (validate_snapshots(t, rs_hashes) == 0) {
@@ -243,18 +402,17 @@ int validate_phase1(tr_submit_msg* t) {
 
 
 int validate_phase2(tr_submit_msg* t, int commit) {
-	int i;
 	flat_key_hash* rs_hashes;
 	
-	if (commit) {
+	if (commit && ValidationMode == VALIDATION_EXACT) {
+		commit = validate_exact(t, vs.ST + 1);
+	} else if (commit) {
 		rs_hashes = TR_SUBMIT_MSG_RS_HASH(t);
-		for (i = 0; i < t->readset_count; i++) {
-	        if (bloom_contains_hashes(vs.ws, rs_hashes[i].hash)) {
-	            ws_conflict++;
-				commit = 0;
-				break;
-	        }
-	    }
+		if (blocked_bloom_contains_any(&vs.ws, 1, rs_hashes,
+				t->readset_count)) {
+			ws_conflict++;
+			commit = 0;
+		}
 	}
 	
 	if (commit)
@@ -266,6 +424,12 @@ int validate_phase2(tr_submit_msg* t, int commit) {
 }
 
 
+int validation_state_size() {
+	return 5 * sizeof(int) +
+		(vs.abort_count + vs.commit_count) * sizeof(tr_id) + us_buffer->offset;
+}
+
+
 // Write out validation_state/tr_deliver_msg; returns the number of bytes written
 int add_validation_state(struct evbuffer *b) {
 	int size, written;
@@ -268,6 +268,21 @@ void rlog_update(rlog *r, key* k, iid_t iid) {
 
 }
 
+/*@
+ * Remove the entry of a deleted tapioca key k
+ */
+void rlog_delete(rlog *r, key* k) {
+	int rv;
+    DBT _k;
+    memset(&_k, 0, sizeof(DBT));
+
+    _k.data = k->data;
+    _k.size = k->size;
+
+	rv = r->dbp->del(r->dbp, r->txn, &_k, 0);
+	assert(rv == 0 || rv == DB_NOTFOUND);
+}
+
 // TODO Check if this count needs to be exact -- currently it will be an estim.
 int rlog_num_keys(rlog *r) {
 	DB_BTREE_STAT *sp;
@@ -40,6 +40,7 @@ typedef struct rlog_t {
 rlog * rlog_init(const char *path);
 iid_t rlog_read(rlog *r, key* k) ;
 void rlog_update(rlog *r, key* k, iid_t iid) ;
+void rlog_delete(rlog *r, key* k) ;
 void rlog_tx_begin(rlog *r);
 void rlog_tx_commit(rlog *r);
 int rlog_num_keys();
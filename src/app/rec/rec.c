@@ -162,7 +162,7 @@ static rec_key_reply * handle_rec_key(rec_key_msg *rm) {
 
 static int key_belongs_here(key* k) {
 	unsigned int h;
-	h = joat_hash(k->data, k->size);
+	h = key_hash(k->data, k->size);
 	if (aid == 2)
 		return ((h % 2) == 0);
 	else
@@ -184,7 +184,11 @@ void update_rec_index(iid_t iid, tr_deliver_msg* dmsg)
 		k.data = kv->data;
 //		if (key_belongs_here(&k)) {
 			rlog_tx_begin(rl);
-			rlog_update(rl, &k, iid);
+			// An empty value is a tombstone, the key is gone
+			if (kv->vsize == 0)
+				rlog_delete(rl, &k);
+			else
+				rlog_update(rl, &k, iid);
 			rlog_tx_commit(rl);
 //		}
 		byte += FLAT_KEY_VAL_SIZE(kv);
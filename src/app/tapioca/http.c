@@ -360,6 +360,7 @@ static void http_commit_cb(struct evhttp_request* r, void* arg) {
 	if (rv < 0) {
 		transaction_clear(c->t);
 		http_reply_commit_result(r, -1);
+		return;
 	}
 
 	evtimer_add(&c->timeout_ev, &commit_timeout);
@@ -431,5 +432,5 @@ static int key_equal(void* k1, void* k2) {
 
 
 static unsigned int hash_from_key(void* k) {
-	return joat_hash(k, sizeof(int));
+	return key_hash(k, sizeof(int));
 }
@@ -30,6 +30,7 @@
 static int recover = 0;
 static int join = 0;
 static int dump = 0;
+static int restore = 0;
 static int help = 0;
 
 static int node_id;
@@ -46,6 +47,7 @@ struct option long_options[] =
 		{"ip-address",   	required_argument, 0, 'i'},
 		{"port",	required_argument,       0, 'p'},
 		{"dump-state",  	no_argument,       0, 'd'},
+		{"restore",  	no_argument,       0, 'l'},
 		{"paxos-config",	required_argument,       0, 'c'},
 		{"storage-config",  	required_argument,       0, 's'},
 		{"recover",  	no_argument,       0, 'r'},
@@ -53,7 +55,7 @@ struct option long_options[] =
 		{0, 0, 0, 0}
 };
 
-const char *short_opts = "n:i:p:dc:s:rh";
+const char *short_opts = "n:i:p:dlc:s:rh";
 
 void print_usage()
 {
@@ -101,6 +103,9 @@ int main(int argc, char* const argv[]) {
 		case 'd':
 			dump = 1;
 			break;
+		case 'l':
+			restore = 1;
+			break;
 		case 'c':
 			paxos_config = optarg;
 			break;
@@ -119,11 +124,14 @@ int main(int argc, char* const argv[]) {
 	
 	tapioca_init(tapioca_config, paxos_config);
 	
-	if (dump) {
-		sprintf(filename, "/tmp/tapioca-store-%s-%d.bin", 
-				LocalIpAddress, LocalPort);
+	sprintf(filename, "/tmp/tapioca-store-%s-%d.bin", 
+			LocalIpAddress, LocalPort);
+	if (dump)
 		tapioca_dump_store_at_exit(filename);
-	}
+	if (restore)
+		tapioca_restore_store(filename);
+	if (StorageSnapshotPath == NULL)
+		StorageSnapshotPath = filename;
 	
 	tcp_init(LocalPort);
 	tapioca_start_and_join();
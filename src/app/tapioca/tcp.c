@@ -91,6 +91,8 @@ static void handle_commit(tcp_client* c, struct evbuffer* b);
 static void handle_rollback(tcp_client* c, struct evbuffer* b);
 static void handle_get(tcp_client* c, struct evbuffer* b);
 static void handle_put(tcp_client* c, struct evbuffer* b);
+static void handle_delete(tcp_client* c, struct evbuffer* b);
+static void handle_range(tcp_client* c, struct evbuffer* b);
 static void handle_mget(tcp_client* c, struct evbuffer* buffer);
 static void handle_mput(tcp_client* c, struct evbuffer* buffer);
 static void handle_mget_put(tcp_client* c, struct evbuffer* buffer);
@@ -169,7 +171,9 @@ static handler handle[] =
 	  handle_bptree_index_next_mget, 
 	  handle_bptree_index_first_no_key,
 	  handle_bptree_debug,
-	  handle_bptree_delete /* 26 */
+	  handle_bptree_delete, /* 26 */
+	  handle_delete,
+	  handle_range
 
 	};
 
@@ -330,6 +334,7 @@ static void handle_commit(tcp_client* c, struct evbuffer* b) {
 	if (rv < 0) {
 		transaction_clear(c->t);
 		send_result(c->buffer_ev, -1);
+		return;
 	}
 	evtimer_add(&c->timeout_ev, &commit_timeout);
 }
@@ -405,21 +410,116 @@ static void handle_put(tcp_client* c, struct evbuffer* b) {
 }
 
 
-static void send_get_result(tcp_client* c, val* v) {
+static void handle_delete(tcp_client* c, struct evbuffer* b) {
+	int ksize;
+	key k;
+	char kdata[MAX_TRANSACTION_SIZE];
+	
+	evbuffer_remove(b, &ksize, sizeof(int));
+	evbuffer_remove(b, kdata, ksize);
+	
+	k.size = ksize;
+	k.data = kdata;
+	transaction_delete(c->t, &k);
+	send_result(c->buffer_ev, 1);
+}
+
+
+struct range_result {
+	int count;
+	int max;
+	struct evbuffer* b;
+};
+
+
+static int add_range_result(key* k, val* v, void* arg) {
+	struct range_result* r = (struct range_result*)arg;
+	evbuffer_add(r->b, &k->size, sizeof(int));
+	evbuffer_add(r->b, k->data, k->size);
+	evbuffer_add(r->b, &v->size, sizeof(int));
+	evbuffer_add(r->b, v->data, v->size);
+	r->count++;
+	return (r->max > 0 && r->count >= r->max) ||
+		(evbuffer_get_length(r->b) >= MAX_TRANSACTION_SIZE);
+}
+
+
+/*
+	Replies with the count of keys found, or -1, followed by the key and
+	the value of each. An empty start or end key leaves the range open.
+	A client sending a key size out of [0, MAX_TRANSACTION_SIZE] is
+	closed, since the rest of its message cannot be parsed.
+*/
+static void handle_range(tcp_client* c, struct evbuffer* b) {
+	int rv, size, ssize, esize;
+	key start, end;
+	char sdata[MAX_TRANSACTION_SIZE];
+	char edata[MAX_TRANSACTION_SIZE];
+	struct range_result r;
+	struct evbuffer* reply;
+	
+	evbuffer_remove(b, &ssize, sizeof(int));
+	if (ssize < 0 || ssize > MAX_TRANSACTION_SIZE)
+		goto bad_size;
+	evbuffer_remove(b, sdata, ssize);
+	evbuffer_remove(b, &esize, sizeof(int));
+	if (esize < 0 || esize > MAX_TRANSACTION_SIZE)
+		goto bad_size;
+	evbuffer_remove(b, edata, esize);
+	evbuffer_remove(b, &r.max, sizeof(int));
+	
+	start.size = ssize;
+	start.data = sdata;
+	end.size = esize;
+	end.data = edata;
+	r.count = 0;
+	r.b = evbuffer_new();
+	rv = transaction_range(c->t, ssize > 0 ? &start : NULL,
+		esize > 0 ? &end : NULL, add_range_result, &r);
+	
+	size = evbuffer_get_length(r.b);
+	reply = evbuffer_new();
+	evbuffer_add(reply, &size, sizeof(int));
+	evbuffer_add(reply, &rv, sizeof(int));
+	evbuffer_add_buffer(reply, r.b);
+	bufferevent_write_buffer(c->buffer_ev, reply);
+	evbuffer_free(reply);
+	evbuffer_free(r.b);
+	return;
+
+bad_size:
+	printf("Error: closing client %d, range key size out of bounds\n", c->id);
+	tcp_client_remove(c->id);
+}
+
+
+static void release_view(const void* data, size_t size, void* arg) {
+	val_view* w = (val_view*)arg;
+	transaction_view_release(w);
+	free(w);
+}
+
+
+/*
+	The value is handed to libevent by reference: the view is released
+	once the value has been written out.
+*/
+static void send_get_result(tcp_client* c, val_view* w) {
 	int rv, size;
 	struct evbuffer* b;
-	if (v == NULL) {
-		send_result(c->buffer_ev, -1);
-		return;
-	}
 	
 	rv = 1;
-	size = v->size + sizeof(int);
+	size = w->size + sizeof(int);
 	b = evbuffer_new();
 	evbuffer_add(b, &size, sizeof(int));
 	evbuffer_add(b, &rv, sizeof(int));
-	evbuffer_add(b, &v->size, sizeof(int));
-	evbuffer_add(b, v->data, v->size);
+	evbuffer_add(b, &w->size, sizeof(int));
+	if (w->size > 0) {
+		evbuffer_add_reference(b, w->data, w->size, release_view, w);
+	} else {
+		transaction_view_release(w);
+		free(w);
+	}
 	bufferevent_write_buffer(c->buffer_ev, b);
 	evbuffer_free(b);
 }
@@ -439,6 +539,14 @@ static val* execute_get(transaction* t, void* k, int ksize) {
 }
 
 
+static int execute_get_view(transaction* t, void* k, int ksize, val_view* w) {
+	key _k;
+	_k.data = k;
+	_k.size = ksize;
+	return transaction_get_view(t, &_k, w);
+}
+
+
 static struct evbuffer* evbuffer_copy(struct evbuffer* b) {
 	size_t size;
 	unsigned char* data;
@@ -454,16 +562,17 @@ static struct evbuffer* evbuffer_copy(struct evbuffer* b) {
 static void handle_get(tcp_client* c, struct evbuffer* buffer) {
 	int ksize;
 	char k[MAX_TRANSACTION_SIZE];
-	val* v;
+	val_view* w;
 	struct evbuffer* b = evbuffer_copy(buffer);
 	evbuffer_remove(b, &ksize, sizeof(int));
 	evbuffer_remove(b, k, ksize);
 	transaction_set_get_cb(c->t, on_get, c);
-	v = execute_get(c->t, k, ksize);
-	if (v != NULL) {
+	w = malloc(sizeof(val_view));
+	if (execute_get_view(c->t, k, ksize, w)) {
 		evbuffer_drain(buffer, evbuffer_get_length(buffer));
-		send_get_result(c, v);
-		val_free(v);
+		send_get_result(c, w);
+	} else {
+		free(w);
 	}
 	evbuffer_free(b);
 }
@@ -642,12 +751,12 @@ static int key_equal(void* k1, void* k2) {
 }
 
 static unsigned int hash_from_client_bpt_key(void* k) {
-	return joat_hash(k, sizeof(int) + sizeof(uint16_t));
+	return key_hash(k, sizeof(int) + sizeof(uint16_t));
 }
 
 
 static unsigned int hash_from_key(void* k) {
-	return joat_hash(k, sizeof(int));
+	return key_hash(k, sizeof(int));
 }
 
 
@@ -0,0 +1,116 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "arena.h"
+#include <stdlib.h>
+#include <assert.h>
+
+#define ARENA_ALIGN 8
+
+typedef struct arena_chunk_t {
+	struct arena_chunk_t* next;
+	int size;
+	int used;
+	char data[0];
+} arena_chunk;
+
+struct arena_t {
+	arena_chunk* head;
+	long used;
+};
+
+static arena_chunk* chunk_new(int size, arena_chunk* next);
+
+
+arena* arena_new() {
+	arena* a;
+	a = malloc(sizeof(arena));
+	assert(a != NULL);
+	a->head = chunk_new(ARENA_CHUNK_SIZE, NULL);
+	a->used = 0;
+	return a;
+}
+
+
+void arena_free(arena* a) {
+	arena_chunk* c;
+	while ((c = a->head) != NULL) {
+		a->head = c->next;
+		free(c);
+	}
+	free(a);
+}
+
+
+void* arena_alloc(arena* a, int size) {
+	void* p;
+	arena_chunk* c = a->head;
+	
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	if (c->used + size > c->size) {
+		c = chunk_new(size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE, c);
+		a->head = c;
+	}
+	p = &c->data[c->used];
+	c->used += size;
+	a->used += size;
+	return p;
+}
+
+
+/*
+	A reset after a load that spilled over several chunks replaces them
+	with a single one.
+*/
+void arena_reset(arena* a) {
+	int size = 0;
+	arena_chunk* c;
+	
+	if (a->head->next == NULL) {
+		a->head->used = 0;
+		a->used = 0;
+		return;
+	}
+	
+	while ((c = a->head) != NULL) {
+		a->head = c->next;
+		size += c->size;
+		free(c);
+	}
+	if (size > ARENA_MAX_CHUNK_SIZE)
+		size = ARENA_MAX_CHUNK_SIZE;
+	a->head = chunk_new(size, NULL);
+	a->used = 0;
+}
+
+
+long arena_used(arena* a) {
+	return a->used;
+}
+
+
+static arena_chunk* chunk_new(int size, arena_chunk* next) {
+	arena_chunk* c;
+	c = malloc(sizeof(arena_chunk) + size);
+	assert(c != NULL);
+	c->next = next;
+	c->size = size;
+	c->used = 0;
+	return c;
+}
@@ -0,0 +1,68 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	Bump allocator for objects that are all released at once, such as
+	the read and write sets of a transaction. Blocks are carved from
+	chunks of at least ARENA_CHUNK_SIZE bytes and cannot be freed one by
+	one: arena_reset() releases them all, keeping a single chunk large
+	enough for what was allocated since the previous reset (up to
+	ARENA_MAX_CHUNK_SIZE bytes), so that the arena stops allocating once
+	it has seen its typical load.
+*/
+
+#define ARENA_CHUNK_SIZE (4*1024)
+#define ARENA_MAX_CHUNK_SIZE (1024*1024)
+
+typedef struct arena_t arena;
+
+
+arena* arena_new();
+
+void arena_free(arena* a);
+
+
+/**
+	Returns a block of size bytes, aligned to 8 bytes, valid until the
+	next arena_reset().
+*/
+void* arena_alloc(arena* a, int size);
+
+
+void arena_reset(arena* a);
+
+
+/**
+	Returns the bytes allocated since the last reset.
+*/
+long arena_used(arena* a);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
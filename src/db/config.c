@@ -19,6 +19,8 @@
 
 #include "config.h"
 
+#include <stddef.h>
+
 char* LeaderIP;
 int LeaderPort;
 long StorageMaxSize;
@@ -27,12 +29,30 @@ int StorageMaxOldVersions;
 int MaxPreviousST;
 int ValidationBufferSize;
 int ValidationDeliverInterval;
+int ValidationMode;
+int ValidationExactSize;
 int NodeID;
 int NumberOfNodes;
 int NumberOfCacheNodes;
 int NodeType;
 char LocalIpAddress[17];
 int LocalPort;
+int StorageEvictionPolicy;
+int StorageAdmissionWidth;
+int StorageVsetType;
+storage_key_class StorageKeyClasses[MAX_KEY_CLASSES];
+int StorageKeyClassCount;
+char* StorageSpillPath;
+long StorageSpillSize;
+char* StorageSnapshotPath;
+int StorageSnapshotInterval;
+unsigned char StorageOrderedPrefix[MAX_KEY_CLASS_PREFIX];
+int StorageOrderedPrefixLen;
+int StorageCompressThreshold;
+int StorageCompressMaxPercent;
+int HashVersion;
+int RecentWritesSize;
+int CproxyMaxBatchDelay;
 
 void set_default_global_variables(void) {
 	NodeID = -1;
@@ -42,8 +62,24 @@ void set_default_global_variables(void) {
 	LeaderPort = 8888;
 	StorageMaxSize = 1024*1024*1024;
 	StorageMinFreeSize = 1024*1024;
+	StorageEvictionPolicy = EVICTION_LRU;
+	StorageAdmissionWidth = 256*1024;
+	StorageVsetType = VSET_COMPACT;
+	StorageKeyClassCount = 0;
+	StorageSpillPath = NULL;
+	StorageSpillSize = 4L*1024*1024*1024;
+	StorageSnapshotPath = NULL;
+	StorageSnapshotInterval = 0;
+	StorageOrderedPrefixLen = -1;
+	StorageCompressThreshold = 0;
+	StorageCompressMaxPercent = 80;
+	HashVersion = HASH_XXH64;
+	RecentWritesSize = 64*1024;
+	CproxyMaxBatchDelay = 1000;
 	MaxPreviousST = 128;
 	NumberOfNodes = 0;
 	NumberOfCacheNodes = 0;
 	ValidationDeliverInterval = 4000;
+	ValidationMode = VALIDATION_BLOOM;
+	ValidationExactSize = 1024*1024;
 }
@@ -32,6 +32,12 @@ extern "C" {
 #define SMALL_BLOOM 1024, 2
 #define BIG_BLOOM   16384, 2
 
+/*
+    Size in bits of the blocked bloom filters the certifier keeps for
+    the buffer and the previous writesets.
+*/
+#define BLOCKED_BLOOM 16384
+
 
 /*
     Degree of replication. Number of replicas for
@@ -70,12 +76,136 @@ extern int NodeType;
 extern char LocalIpAddress[17];
 extern int LocalPort;
 
+/*
+    Policy used to evict cached keys from the storage, either
+    EVICTION_LRU (default) or EVICTION_CLOCK. CLOCK keeps a reference
+    bit per key instead of an LRU list. Config: StorageEvictionPolicy.
+*/
+#define EVICTION_LRU   0
+#define EVICTION_CLOCK 1
+extern int StorageEvictionPolicy;
+
+/*
+    Counters per row of the sketch estimating key access frequencies,
+    used to decide whether remotely fetched values get cached.
+    0 disables admission control. Config: StorageAdmissionWidth.
+*/
+extern int StorageAdmissionWidth;
+
+/*
+    Implementation of the sets of versions of each key (see vset.h).
+    Config: StorageVsetType list|array|array_sorted|array_cache|compact
+*/
+#define VSET_LIST         0
+#define VSET_ARRAY        1
+#define VSET_ARRAY_SORTED 2
+#define VSET_ARRAY_CACHE  3
+#define VSET_COMPACT      4
+extern int StorageVsetType;
+
+/*
+    Caching policy of the keys starting with a given prefix. Keys that
+    are not local are cached only if cache is set, and only up to
+    max_bytes bytes (0 for no limit). On GC, cached keys of classes with
+    lower priority are evicted first. Keys matching no class are cached,
+    with priority 0 and no limit.
+    Config: StorageKeyClass <hex prefix> <cache> <priority> <max_bytes>
+*/
+#define MAX_KEY_CLASSES 16
+#define MAX_KEY_CLASS_PREFIX 8
+
+typedef struct storage_key_class_t {
+	unsigned char prefix[MAX_KEY_CLASS_PREFIX];
+	int prefix_len;
+	int cache;
+	int priority;
+	long max_bytes;
+} storage_key_class;
+
+extern storage_key_class StorageKeyClasses[MAX_KEY_CLASSES];
+extern int StorageKeyClassCount;
+
+/*
+    File where cold local keys are spilled when the storage exceeds
+    StorageMaxSize, and its size in bytes. Spilling is disabled when no
+    path is set. Config: StorageSpillPath, StorageSpillSize
+*/
+extern char* StorageSpillPath;
+extern long StorageSpillSize;
+
+/*
+    Path of the snapshots taken in the background on SIGUSR1, and every
+    StorageSnapshotInterval seconds (0 to disable the timer).
+    Config: StorageSnapshotPath, StorageSnapshotInterval
+*/
+extern char* StorageSnapshotPath;
+extern int StorageSnapshotInterval;
+
+/*
+    Keys starting with StorageOrderedPrefix are also kept in key order,
+    for storage_range(). The prefix is given in hex, or as * to order
+    all keys; there is no ordered index when it is not set (length -1).
+    Config: StorageOrderedPrefix
+*/
+extern unsigned char StorageOrderedPrefix[MAX_KEY_CLASS_PREFIX];
+extern int StorageOrderedPrefixLen;
+
+/*
+    Values of at least StorageCompressThreshold bytes are stored
+    compressed with zlib (0 disables compression), if that takes at most
+    StorageCompressMaxPercent percent of their size.
+    Config: StorageCompressThreshold, StorageCompressMaxPercent
+*/
+extern int StorageCompressThreshold;
+extern int StorageCompressMaxPercent;
+
+/*
+    Hash function of keys, used for partitioning, the storage index and
+    the read/write set hashes checked by the certifier. All nodes and
+    the certifier must use the same one. Config: HashVersion 0|1
+*/
+#define HASH_JOAT_DJB2 0
+#define HASH_XXH64     1
+
+extern int HashVersion;
+
+/*
+    Entries of the index of the keys written by recently delivered
+    transactions, used to abort locally the transactions the certifier
+    would abort (see recent_writes.h). 0 disables the index.
+    Config: RecentWritesSize
+*/
+extern int RecentWritesSize;
+
+/*
+    Maximum time in microseconds a transaction waits in the cproxy batch
+    before being sent to the certifier. Transactions are sent at once
+    when none are in flight; otherwise they are batched up to the number
+    of submits expected in a certifier round trip. 0 disables batching.
+    Config: CproxyMaxBatchDelay
+*/
+extern int CproxyMaxBatchDelay;
+
 /*
     Maximum period of time in which the validation buffer 
-    must be delivered, even if not full yet. In microseconds.
+    must be delivered, even if not full yet. In microseconds,
+    0 delivers every transaction on its own.
 */
 extern int ValidationDeliverInterval;
 
+/*
+    Validator of the certifier. The bloom validator checks reads against
+    bloom filters of the write sets of the last MaxPreviousST snapshots;
+    the exact one against a map of the last ST at which each key was
+    written, with ValidationExactSize slots, and has no false conflicts.
+    Config: ValidationMode 0|1, ValidationExactSize
+*/
+#define VALIDATION_BLOOM 0
+#define VALIDATION_EXACT 1
+
+extern int ValidationMode;
+extern int ValidationExactSize;
+
 void set_default_global_variables(void);
 
 
@@ -23,6 +23,7 @@
 
 #include "dsmDB_priv.h"
 #include "peer.h"
+#include "vset.h"
 
 
 static node_info* node_info_table = NULL;
@@ -47,6 +48,91 @@ node_info * get_node_info(int node_id) {
 	}
 }
 
+/*
+	Parses "StorageKeyClass <hex prefix> <cache> <priority> <max_bytes>"
+*/
+static void parse_key_class(char* string) {
+	int i, len;
+	char tmp[256];
+	char hex[2*MAX_KEY_CLASS_PREFIX + 1];
+	storage_key_class* c;
+	
+	if (StorageKeyClassCount == MAX_KEY_CLASSES) {
+		printf("Config error: too many key classes\n");
+		return;
+	}
+	
+	c = &StorageKeyClasses[StorageKeyClassCount];
+	memset(c, 0, sizeof(storage_key_class));
+	if (sscanf(string, "%s %16s %d %d %ld", tmp, hex, &c->cache,
+		&c->priority, &c->max_bytes) != 5) {
+		printf("Config error: %s", string);
+		return;
+	}
+	
+	len = strlen(hex);
+	if (len == 0 || len % 2 != 0) {
+		printf("Config error: invalid key class prefix %s\n", hex);
+		return;
+	}
+	for (i = 0; i < len / 2; i++)
+		sscanf(&hex[2*i], "%2hhx", &c->prefix[i]);
+	c->prefix_len = len / 2;
+	StorageKeyClassCount++;
+	
+	printf("Setting StorageKeyClass: %s cache %d priority %d max %ld\n",
+		hex, c->cache, c->priority, c->max_bytes);
+}
+
+/*
+	Parses "StorageOrderedPrefix <hex prefix>|*"
+*/
+static void parse_ordered_prefix(char* string) {
+	int i, len;
+	char tmp[256];
+	char hex[2*MAX_KEY_CLASS_PREFIX + 1];
+	
+	if (sscanf(string, "%s %16s", tmp, hex) != 2) {
+		printf("Config error: %s", string);
+		return;
+	}
+	
+	if (strcmp(hex, "*") == 0) {
+		StorageOrderedPrefixLen = 0;
+		printf("Setting StorageOrderedPrefix: all keys\n");
+		return;
+	}
+	
+	len = strlen(hex);
+	if (len == 0 || len % 2 != 0) {
+		printf("Config error: invalid ordered prefix %s\n", hex);
+		return;
+	}
+	for (i = 0; i < len / 2; i++)
+		sscanf(&hex[2*i], "%2hhx", &StorageOrderedPrefix[i]);
+	StorageOrderedPrefixLen = len / 2;
+	printf("Setting StorageOrderedPrefix: %s\n", hex);
+}
+
+static void parse_vset_type(char* string) {
+	int i;
+	char tmp[256];
+	char type[32];
+	static const char* names[] = {
+		"list", "array", "array_sorted", "array_cache", "compact"
+	};
+	
+	sscanf(string, "%s %31s", tmp, type);
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (strcmp(type, names[i]) == 0) {
+			StorageVsetType = i;
+			printf("Setting StorageVsetType: %s\n", type);
+			return;
+		}
+	}
+	printf("Config error: unknown vset type %s\n", type);
+}
+
 //Check that all values were configured
 void check_values(int node_count) {
 
@@ -85,6 +171,13 @@ void check_values(int node_count) {
         exit(1);
     }
 
+    if(StorageVsetType == VSET_COMPACT &&
+       StorageMaxOldVersions > VSET_COMPACT_MAX_VERSIONS) {
+        printf("Warning: StorageMaxOldVersions set to %d, the most the compact vset keeps\n",
+            VSET_COMPACT_MAX_VERSIONS);
+        StorageMaxOldVersions = VSET_COMPACT_MAX_VERSIONS;
+    }
+
     if(MaxPreviousST == -1) {
         printf("Error: MaxPreviousST not initialized\n");
         exit(1);
@@ -150,6 +243,99 @@ int load_config_file(const char * path) {
             continue;
         }
 
+        if(starts_with("StorageEvictionPolicy", string) == 0) {
+            char policy[32];
+            sscanf(string, "%s %31s", tmp, policy);
+            if (strcmp(policy, "clock") == 0)
+                StorageEvictionPolicy = EVICTION_CLOCK;
+            else if (strcmp(policy, "lru") == 0)
+                StorageEvictionPolicy = EVICTION_LRU;
+            else
+                printf("Config error: unknown eviction policy %s\n", policy);
+            printf("Setting StorageEvictionPolicy: %s\n",
+                StorageEvictionPolicy == EVICTION_CLOCK ? "clock" : "lru");
+            continue;
+        }
+
+        if(starts_with("StorageAdmissionWidth", string) == 0) {
+            sscanf(string, "%s %d", tmp, &StorageAdmissionWidth);
+            printf("Setting StorageAdmissionWidth: %d\n", StorageAdmissionWidth);
+            continue;
+        }
+
+        if(starts_with("StorageVsetType", string) == 0) {
+            parse_vset_type(string);
+            continue;
+        }
+
+        if(starts_with("StorageSpillPath", string) == 0) {
+            char path[256];
+            sscanf(string, "%s %255s", tmp, path);
+            StorageSpillPath = strdup(path);
+            printf("Setting StorageSpillPath: %s\n", StorageSpillPath);
+            continue;
+        }
+
+        if(starts_with("StorageSpillSize", string) == 0) {
+            sscanf(string, "%s %ld", tmp, &StorageSpillSize);
+            printf("Setting StorageSpillSize: %ld\n", StorageSpillSize);
+            continue;
+        }
+
+        if(starts_with("StorageSnapshotPath", string) == 0) {
+            char path[256];
+            sscanf(string, "%s %255s", tmp, path);
+            StorageSnapshotPath = strdup(path);
+            printf("Setting StorageSnapshotPath: %s\n", StorageSnapshotPath);
+            continue;
+        }
+
+        if(starts_with("StorageSnapshotInterval", string) == 0) {
+            sscanf(string, "%s %d", tmp, &StorageSnapshotInterval);
+            printf("Setting StorageSnapshotInterval: %d\n", StorageSnapshotInterval);
+            continue;
+        }
+
+        if(starts_with("StorageOrderedPrefix", string) == 0) {
+            parse_ordered_prefix(string);
+            continue;
+        }
+
+        if(starts_with("StorageCompressThreshold", string) == 0) {
+            sscanf(string, "%s %d", tmp, &StorageCompressThreshold);
+            printf("Setting StorageCompressThreshold: %d\n", StorageCompressThreshold);
+            continue;
+        }
+
+        if(starts_with("StorageCompressMaxPercent", string) == 0) {
+            sscanf(string, "%s %d", tmp, &StorageCompressMaxPercent);
+            printf("Setting StorageCompressMaxPercent: %d\n", StorageCompressMaxPercent);
+            continue;
+        }
+
+        if(starts_with("HashVersion", string) == 0) {
+            sscanf(string, "%s %d", tmp, &HashVersion);
+            printf("Setting HashVersion: %d\n", HashVersion);
+            continue;
+        }
+
+        if(starts_with("RecentWritesSize", string) == 0) {
+            sscanf(string, "%s %d", tmp, &RecentWritesSize);
+            printf("Setting RecentWritesSize: %d\n", RecentWritesSize);
+            continue;
+        }
+
+        if(starts_with("CproxyMaxBatchDelay", string) == 0) {
+            sscanf(string, "%s %d", tmp, &CproxyMaxBatchDelay);
+            printf("Setting CproxyMaxBatchDelay: %d\n", CproxyMaxBatchDelay);
+            continue;
+        }
+
+        if(starts_with("StorageKeyClass", string) == 0) {
+            parse_key_class(string);
+            continue;
+        }
+
 		if(starts_with("StorageMaxOldVersions", string) == 0) {		    
             sscanf(string, "%s %d", tmp, &StorageMaxOldVersions);
             printf("Setting StorageMaxOldVersions: %d\n", StorageMaxOldVersions);
@@ -182,6 +368,18 @@ int load_config_file(const char * path) {
 			printf("Setting ValidationDeliverInterval: %d\n", ValidationDeliverInterval);
 			continue;
 		}
+
+		if (starts_with("ValidationMode", string) == 0) {
+			sscanf(string, "%s %d", tmp, &ValidationMode);
+			printf("Setting ValidationMode: %d\n", ValidationMode);
+			continue;
+		}
+
+		if (starts_with("ValidationExactSize", string) == 0) {
+			sscanf(string, "%s %d", tmp, &ValidationExactSize);
+			printf("Setting ValidationExactSize: %d\n", ValidationExactSize);
+			continue;
+		}
 /*        
         if(starts_with("node", string) == 0) {
             node_info * n;
@@ -24,12 +24,16 @@
 #include "event.h"
 #include "peer.h"
 #include "socket_util.h"
+#include "recent_writes.h"
+#include "transaction.h"
+#include "hash.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/time.h>
 
 #include <event2/event.h>
 #include <event2/buffer.h>
@@ -40,21 +44,51 @@
 
 
 #define bsize MAX_TRANSACTION_SIZE
-#define BATCHING 0
+#define MAX_BATCH_TARGET 64
+#define BATCH_HIST_BUCKETS 8
+#define SENT_RING_SIZE 64
+#define SENT_EXPIRY_RTTS 8
+#define SENT_EXPIRY_MIN_USECS 100000
 
 
+/*
+	Transactions are batched in an evbuffer, whose chains are handed
+	over to the certifier bufferevent when the batch is sent.
+*/
 typedef struct batch_t {
 	int count;
-	char buffer[bsize];
-	size_t buffer_offset;
+	struct evbuffer* buffer;
 	struct event *timeout_ev;
 } batch;
 
+/*
+	Batches sent and not delivered yet, oldest first, to estimate the
+	round trip time to the certifier when the last of their transactions
+	is delivered, and the transactions in flight. A batch still pending
+	SENT_EXPIRY_RTTS round trips after it was sent is taken as lost, so
+	that lost submissions do not keep counting as in flight.
+*/
+typedef struct sent_batch_t {
+	struct timeval sent;
+	int pending;
+} sent_batch;
+
 static batch tx_batch;
+static struct evbuffer_iovec reserved;
 static struct timeval max_batch_time = {0, 1000};
+static sent_batch sent_ring[SENT_RING_SIZE];
+static int sent_head = 0;
+static int sent_count = 0;
+static int in_flight = 0;
+static int lost_tx = 0;
+static struct timeval last_submit;
+static long rtt_usecs = 0;
+static long interarrival_usecs = 0;
+static int batch_sizes[BATCH_HIST_BUCKETS];
 static cproxy_commit_cb commit_cb;
 
 static int ST;
+static int restored_st = -1;
 static struct bufferevent *cert_bev;
 static struct event_base *base;
 static int submitted_batch = 0;
@@ -73,6 +107,15 @@ static void on_batch_timeout(int fd, short event, void* arg);
 static void init_batch(batch* b);
 static void send_batch(batch* b);
 static void add_to_batch(batch* b, char* v, size_t s);
+static void make_room(batch* b, size_t s);
+static void count_in_batch(batch* b);
+static void flush_or_wait(batch* b);
+static int batch_target();
+static void track_submit();
+static void track_sent(int count);
+static void track_delivered(int count);
+static void expire_sent();
+static long usecs_since(struct timeval* tv);
 static void print_stats();
 
 static void on_socket_event(struct bufferevent *bev, short ev, void *arg) {
@@ -110,11 +153,16 @@ static struct bufferevent* cm_connect(struct event_base* b,
 int cproxy_init(const char* paxos_config, struct event_base *b) {
 	struct evlearner *l;
 	ST = 0;
+	restored_st = -1;
 	base = b; 
+	gettimeofday(&last_submit, NULL);
+	recent_writes_init(RecentWritesSize);
 	cert_bev = cm_connect(base, LeaderIP, LeaderPort);
 	assert(cert_bev != NULL);
 	l = evlearner_init(paxos_config, on_deliver, NULL, base);
 	assert(l != NULL);
+	tx_batch.buffer = evbuffer_new();
+	assert(tx_batch.buffer != NULL);
 	init_batch(&tx_batch);
  	tx_batch.timeout_ev = evtimer_new(base, on_batch_timeout, &tx_batch);
 	assert(tx_batch.timeout_ev != NULL);
@@ -125,8 +173,26 @@ int cproxy_init(const char* paxos_config, struct event_base *b) {
 int cproxy_submit(char* value, size_t size, cproxy_commit_cb cb) {
 	commit_cb = cb;
 	add_to_batch(&tx_batch, value, size);
-	if (!BATCHING)
-		send_batch(&tx_batch);
+	flush_or_wait(&tx_batch);
+	return 1;
+}
+
+
+char* cproxy_reserve(size_t size) {
+	make_room(&tx_batch, size);
+	if (evbuffer_reserve_space(tx_batch.buffer, size, &reserved, 1) < 1)
+		return NULL;
+	return reserved.iov_base;
+}
+
+
+int cproxy_submit_reserved(size_t size, cproxy_commit_cb cb) {
+	commit_cb = cb;
+	reserved.iov_len = size;
+	if (evbuffer_commit_space(tx_batch.buffer, &reserved, 1) < 0)
+		return -1;
+	count_in_batch(&tx_batch);
+	flush_or_wait(&tx_batch);
 	return 1;
 }
 
@@ -135,7 +201,9 @@ int cproxy_submit_join(int node_type, char* address, int port) {
 	int rv;
 	join_msg j;
 	
-	j.type = NODE_JOIN;
+	memset(&j, 0, sizeof(join_msg));
+	j.type = (HashVersion == HASH_JOAT_DJB2) ? NODE_JOIN : NODE_JOIN_HASHED;
+	j.hash_version = HashVersion;
 	j.node_type = node_type;
 	j.port = port;
 	strncpy(j.address, address, 17);
@@ -150,8 +218,16 @@ int cproxy_current_st() {
 }
 
 
+void cproxy_set_st(int st) {
+	ST = st;
+	restored_st = st;
+}
+
+
 void cproxy_cleanup() {
 	bufferevent_free(cert_bev);
+	evbuffer_free(tx_batch.buffer);
+	recent_writes_free();
 	print_stats();
 }
 
@@ -164,7 +240,8 @@ static void on_init() {
 static void handle_transaction(void* value, size_t size) {
 	key k;
 	val v;
-    int i, offset;
+    int i, offset, own;
+    unsigned int h[2];
     tr_id* ids;
     flat_key_val* kv;
 	tr_deliver_msg* dmsg;
@@ -172,9 +249,14 @@ static void handle_transaction(void* value, size_t size) {
 	
 	LOG(VRB, ("handling transaction size %d\n",size));
 	dmsg = (tr_deliver_msg*)value;
+	
+	// Already in the snapshot the storage was restored from
+	if (dmsg->ST <= restored_st)
+		return;
 
 	// Report aborted / committed transactions
 	ids = (tr_id*) dmsg->data;
+	own = commit_count + abort_count;
 	for (i = 0; i < dmsg->aborted_count; i++) {
 		if (ids[i].node_id == NodeID) {	
 			if (commit_cb == NULL) {
@@ -199,6 +281,14 @@ static void handle_transaction(void* value, size_t size) {
 	
 	delivered_tx_clients += dmsg->aborted_count + dmsg->committed_count;
 
+	// Our transactions came back: send what queued up meanwhile
+	own = commit_count + abort_count - own;
+	if (own > 0) {
+		track_delivered(own);
+		if (tx_batch.count > 0)
+			send_batch(&tx_batch);
+	}
+
 	// Apply updates to storage
 	offset = (dmsg->aborted_count + dmsg->committed_count) * sizeof(tr_id);
 	for (i = 0; i < dmsg->updateset_count; i++) {
@@ -210,6 +300,8 @@ static void handle_transaction(void* value, size_t size) {
 	    v.version = ST;
 		
 		sm_put(&k, &v);
+		key_hash_pair(k.data, k.size, h);
+		recent_writes_add(h, dmsg->ST);
 		
 	    offset += FLAT_KEY_VAL_SIZE(kv);
 	}
@@ -282,17 +374,23 @@ static void on_deliver(char* value, size_t size, iid_t iid,
 
 static void init_batch(batch* b) {
 	b->count = 0;
-	b->buffer_offset = 0;
 }
 
 
 static void send_batch(batch* b) {
-	int rv;
+	int rv, bucket;
 
-	rv = bufferevent_write(cert_bev, b->buffer, b->buffer_offset);
+	if (b->count == 0)
+		return;
+	rv = bufferevent_write_buffer(cert_bev, b->buffer);
 	
 	submitted_batch++;
 	submitted_tx += b->count;
+	track_sent(b->count);
+	for (bucket = 0; bucket < BATCH_HIST_BUCKETS - 1; bucket++)
+		if (b->count < (2 << bucket))
+			break;
+	batch_sizes[bucket]++;
 
 	init_batch(b);
 	evtimer_del(b->timeout_ev);
@@ -300,26 +398,148 @@ static void send_batch(batch* b) {
 
 
 static void add_to_batch(batch* b, char* v, size_t s) {
-	char* dst;
-	int size_left;
-	
-	size_left = bsize - b->buffer_offset;
-	
-	if (size_left < s)
+	make_room(b, s);
+	evbuffer_add(b->buffer, v, s);
+	count_in_batch(b);
+}
+
+
+static void make_room(batch* b, size_t s) {
+	if (evbuffer_get_length(b->buffer) + s > bsize)
 		send_batch(b);
+}
 
-	dst = &(b->buffer[b->buffer_offset]);
-	memcpy(dst, v, s);
-	b->count++;
-	b->buffer_offset += s;
+
+static void count_in_batch(batch* b) {
+	long delay;
 	
-	if (b->count == 1) {
+	b->count++;
+	track_submit();
+	if (b->count == 1 && CproxyMaxBatchDelay > 0) {
 		assert(b->timeout_ev != NULL);
+		delay = CproxyMaxBatchDelay;
+		if (rtt_usecs > 0 && rtt_usecs < delay)
+			delay = rtt_usecs;
+		max_batch_time.tv_sec = delay / 1000000;
+		max_batch_time.tv_usec = delay % 1000000;
 		evtimer_add(b->timeout_ev, &max_batch_time);
 	}
 }
 
 
+/*
+	Like Nagle: a transaction goes out at once when none of ours are in
+	flight, otherwise it waits for the deliveries of those in flight, for
+	the batch to reach the submits expected in a round trip, or for the
+	batch timeout.
+*/
+static void flush_or_wait(batch* b) {
+	expire_sent();
+	if (CproxyMaxBatchDelay <= 0 || in_flight <= 0 ||
+		b->count >= batch_target())
+		send_batch(b);
+}
+
+
+static int batch_target() {
+	long target;
+	
+	if (rtt_usecs == 0 || interarrival_usecs == 0)
+		return 1;
+	target = rtt_usecs / interarrival_usecs;
+	if (target < 1)
+		return 1;
+	if (target > MAX_BATCH_TARGET)
+		return MAX_BATCH_TARGET;
+	return (int)target;
+}
+
+
+/* Moving averages with weight 1/8 for the new sample, as TCP's srtt */
+static void track_submit() {
+	long d;
+	struct timeval now;
+	
+	gettimeofday(&now, NULL);
+	d = (now.tv_sec - last_submit.tv_sec) * 1000000 +
+		(now.tv_usec - last_submit.tv_usec);
+	last_submit = now;
+	if (d < 1)
+		d = 1;
+	if (interarrival_usecs == 0)
+		interarrival_usecs = d;
+	else
+		interarrival_usecs += (d - interarrival_usecs) / 8;
+}
+
+
+static void track_sent(int count) {
+	sent_batch* sb;
+	
+	if (sent_count == SENT_RING_SIZE) {
+		sb = &sent_ring[(sent_head + sent_count - 1) % SENT_RING_SIZE];
+		sb->pending += count;
+		in_flight += count;
+		return;
+	}
+	sb = &sent_ring[(sent_head + sent_count) % SENT_RING_SIZE];
+	gettimeofday(&sb->sent, NULL);
+	sb->pending = count;
+	sent_count++;
+	in_flight += count;
+}
+
+
+static void track_delivered(int count) {
+	long rtt;
+	sent_batch* sb;
+	
+	while (count > 0 && sent_count > 0) {
+		sb = &sent_ring[sent_head];
+		if (sb->pending > count) {
+			sb->pending -= count;
+			in_flight -= count;
+			return;
+		}
+		count -= sb->pending;
+		in_flight -= sb->pending;
+		rtt = usecs_since(&sb->sent);
+		if (rtt_usecs == 0)
+			rtt_usecs = rtt;
+		else
+			rtt_usecs += (rtt - rtt_usecs) / 8;
+		sent_head = (sent_head + 1) % SENT_RING_SIZE;
+		sent_count--;
+	}
+}
+
+
+static void expire_sent() {
+	long expiry;
+	sent_batch* sb;
+	
+	expiry = SENT_EXPIRY_RTTS * rtt_usecs;
+	if (expiry < SENT_EXPIRY_MIN_USECS)
+		expiry = SENT_EXPIRY_MIN_USECS;
+	while (sent_count > 0) {
+		sb = &sent_ring[sent_head];
+		if (usecs_since(&sb->sent) < expiry)
+			return;
+		in_flight -= sb->pending;
+		lost_tx += sb->pending;
+		sent_head = (sent_head + 1) % SENT_RING_SIZE;
+		sent_count--;
+	}
+}
+
+
+static long usecs_since(struct timeval* tv) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - tv->tv_sec) * 1000000 + (now.tv_usec - tv->tv_usec);
+}
+
+
 static void on_batch_timeout(int fd, short event, void* arg) {
 	batch* b;
 	b = (batch*)arg;
@@ -329,19 +549,29 @@ static void on_batch_timeout(int fd, short event, void* arg) {
 
 
 static void print_stats() {
+	int i;
+	
     printf("\nCERTIFIER PROXY\n");
     printf("------------------------------\n");
-	if (BATCHING)
-		printf("Batching: enabled\n");
+	if (CproxyMaxBatchDelay > 0)
+		printf("Batching: enabled, max delay %d us\n", CproxyMaxBatchDelay);
 	else
 		printf("Batching: disabled\n");
 	printf("Submitted batch: %d\n", submitted_batch);
 	printf("Batches on timeout: %d\n", batch_timeout);
+	printf("Batch sizes:");
+	for (i = 0; i < BATCH_HIST_BUCKETS - 1; i++)
+		printf(" %d-%d: %d", 1 << i, (2 << i) - 1, batch_sizes[i]);
+	printf(" %d+: %d\n", 1 << i, batch_sizes[i]);
+	printf("Certifier RTT: %ld us\n", rtt_usecs);
+	printf("Submit interarrival: %ld us\n", interarrival_usecs);
     printf("Submitted tx: %d\n", submitted_tx);
 	printf("Delivered tx: %d\n", delivered_tx);
 	printf("Delivered tx to clients: %d\n", delivered_tx_clients);
 	printf("Commit count: %d\n", commit_count);
 	printf("Abort count: %d\n", abort_count);
+	printf("Taken as lost: %d\n", lost_tx);
+	printf("Aborted locally: %ld\n", transaction_local_abort_count());
 	printf("Final ST: %d\n", ST);
 	printf("------------------------------\n");
 //	learner_print_eventcounters();
@@ -27,8 +27,15 @@ typedef void(*cproxy_commit_cb)(tr_id*, int);
 
 int cproxy_init(const char* paxos_config, struct event_base *base);
 int cproxy_submit(char* value, size_t size, cproxy_commit_cb cb);
+// Returns size contiguous bytes at the end of the current batch, where
+// a transaction is written in place and then submitted with
+// cproxy_submit_reserved (size may then be smaller)
+char* cproxy_reserve(size_t size);
+int cproxy_submit_reserved(size_t size, cproxy_commit_cb cb);
 int cproxy_submit_join(int node_type, char* address, int port);
 int cproxy_current_st();
+// Starts from a storage restored at st, deliveries up to st are skipped
+void cproxy_set_st(int st);
 void cproxy_cleanup();
 
 #endif /* _CPROXY_H_ */
@@ -0,0 +1,114 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "crc32c.h"
+
+#include <string.h>
+#include <pthread.h>
+
+
+#define CRC32C_POLY 0x82f63b78
+
+
+static pthread_once_t initialized = PTHREAD_ONCE_INIT;
+static int use_sse42 = 0;
+static uint32_t table[8][256];
+
+static void init_tables();
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char* p, size_t size);
+#if defined(__x86_64__) && defined(__GNUC__)
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char* p, size_t size);
+#endif
+
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t size) {
+	pthread_once(&initialized, init_tables);
+#if defined(__x86_64__) && defined(__GNUC__)
+	if (use_sse42)
+		return crc32c_hw(crc, data, size);
+#endif
+	return crc32c_sw(crc, data, size);
+}
+
+
+static void init_tables() {
+	int i, j;
+	uint32_t c;
+	
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+		table[0][i] = c;
+	}
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < 8; j++)
+			table[j][i] = (table[j-1][i] >> 8) ^ table[0][table[j-1][i] & 0xff];
+	
+#if defined(__x86_64__) && defined(__GNUC__)
+	use_sse42 = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+
+/*
+	Slicing-by-8: eight bytes per step, one table per byte position.
+*/
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char* p, size_t size) {
+	uint64_t w;
+	
+	crc = ~crc;
+	while (size >= 8) {
+		memcpy(&w, p, 8);
+		w ^= crc;
+		crc = table[7][w & 0xff] ^
+			table[6][(w >> 8) & 0xff] ^
+			table[5][(w >> 16) & 0xff] ^
+			table[4][(w >> 24) & 0xff] ^
+			table[3][(w >> 32) & 0xff] ^
+			table[2][(w >> 40) & 0xff] ^
+			table[1][(w >> 48) & 0xff] ^
+			table[0][w >> 56];
+		p += 8;
+		size -= 8;
+	}
+	while (size-- > 0)
+		crc = (crc >> 8) ^ table[0][(crc ^ *p++) & 0xff];
+	return ~crc;
+}
+
+
+#if defined(__x86_64__) && defined(__GNUC__)
+__attribute__ ((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char* p, size_t size) {
+	uint64_t w, c;
+	
+	c = ~crc;
+	while (size >= 8) {
+		memcpy(&w, p, 8);
+		c = __builtin_ia32_crc32di(c, w);
+		p += 8;
+		size -= 8;
+	}
+	crc = c;
+	while (size-- > 0)
+		crc = __builtin_ia32_crc32qi(crc, *p++);
+	return ~crc;
+}
+#endif
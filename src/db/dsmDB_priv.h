@@ -81,6 +81,23 @@ typedef struct db_val_t {
     void* data;
 } val;
 
+/*
+	A borrowed view of a value: data either points into the storage, to
+	the view's own bytes or to a decompressed copy. It stays valid until the view is released,
+	so a view must not be copied around by value.
+*/
+#define VAL_VIEW_INLINE 16
+
+typedef struct db_val_view_t {
+    int   size;
+    int   version;
+    char* data;
+    char  bytes[VAL_VIEW_INLINE];
+    val*  copy;
+    void* epoch;
+    void* hot;
+} val_view;
+
 key* key_new (void* data, int size);
 void key_free (key* k);
 
@@ -143,6 +160,7 @@ typedef struct flat_key_val_t {
 #define TRANSACTION_SUBMIT 1 	// tr_submit_msg
 #define NODE_JOIN 2				// join_msg
 #define RECONFIG 3				// reconf_msg
+#define NODE_JOIN_HASHED 4		// join_msg with hash_version set
 
 /*
     data contains:
@@ -152,6 +170,7 @@ typedef struct flat_key_val_t {
 */
 typedef struct tr_submit_msg_t {
 	short type;
+	short hash_version;	// set by the certifier from the sender's join
     tr_id id;
     int   start;
     short readset_count;
@@ -168,8 +187,14 @@ typedef struct tr_submit_msg_t {
 //#define TR_MAX_MSG_SIZE 8192
 //#define TR_MAX_DATA_SIZE (TR_MAX_MSG_SIZE - sizeof(tr_submit_msg))
 
+/*
+    Nodes hashing with HASH_JOAT_DJB2 send a NODE_JOIN, whose hash_version
+    is padding older nodes leave uninitialized, the others a
+    NODE_JOIN_HASHED.
+*/
 typedef struct join_msg_t {
 	short type;
+	short hash_version;
 	int node_type;
 	int port;
 	int ST;
@@ -0,0 +1,126 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "freq_sketch.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+
+
+struct freq_sketch_t {
+	unsigned int mask;
+	long additions;
+	long sample_size;
+	long resets;
+	uint8_t* rows[FREQ_SKETCH_ROWS];
+};
+
+
+static const unsigned int seeds[FREQ_SKETCH_ROWS] = {
+	0x97cb3127, 0xb4b82e39, 0x5bd1e995, 0xcc9e2d51
+};
+
+
+/*
+	Index of the counter of hash h in row i. Each row remixes h with its
+	own seed (murmur3 finalizer), so that keys colliding in one row are
+	unlikely to collide in the others.
+*/
+static unsigned int row_index(freq_sketch* s, int i, unsigned int h) {
+	h ^= seeds[i];
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h & s->mask;
+}
+
+
+static void halve(freq_sketch* s) {
+	int i;
+	unsigned int j;
+	for (i = 0; i < FREQ_SKETCH_ROWS; i++)
+		for (j = 0; j <= s->mask; j++)
+			s->rows[i][j] >>= 1;
+	s->additions /= 2;
+	s->resets++;
+}
+
+
+freq_sketch* freq_sketch_new(int width) {
+	int i;
+	unsigned int size = 16;
+	freq_sketch* s;
+	
+	while (size < (unsigned int)width)
+		size *= 2;
+	
+	s = malloc(sizeof(freq_sketch));
+	assert(s != NULL);
+	s->mask = size - 1;
+	s->additions = 0;
+	s->sample_size = (long)FREQ_SKETCH_SAMPLE * size;
+	s->resets = 0;
+	for (i = 0; i < FREQ_SKETCH_ROWS; i++) {
+		s->rows[i] = calloc(size, sizeof(uint8_t));
+		assert(s->rows[i] != NULL);
+	}
+	return s;
+}
+
+
+void freq_sketch_free(freq_sketch* s) {
+	int i;
+	for (i = 0; i < FREQ_SKETCH_ROWS; i++)
+		free(s->rows[i]);
+	free(s);
+}
+
+
+void freq_sketch_add(freq_sketch* s, unsigned int h) {
+	int i;
+	uint8_t* c;
+	
+	for (i = 0; i < FREQ_SKETCH_ROWS; i++) {
+		c = &s->rows[i][row_index(s, i, h)];
+		if (*c < UINT8_MAX)
+			(*c)++;
+	}
+	if (++s->additions >= s->sample_size)
+		halve(s);
+}
+
+
+int freq_sketch_estimate(freq_sketch* s, unsigned int h) {
+	int i, c, min = UINT8_MAX;
+	
+	for (i = 0; i < FREQ_SKETCH_ROWS; i++) {
+		c = s->rows[i][row_index(s, i, h)];
+		if (c < min)
+			min = c;
+	}
+	return min;
+}
+
+
+long freq_sketch_resets(freq_sketch* s) {
+	return s->resets;
+}
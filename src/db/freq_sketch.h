@@ -0,0 +1,74 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FREQ_SKETCH_H_
+#define _FREQ_SKETCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	Count-min sketch estimating how often keys were accessed, used by
+	the storage to decide whether a remotely fetched value is worth
+	caching (TinyLFU admission).
+
+	Keys are identified by their hash. Counters saturate at 255 and are
+	all halved every FREQ_SKETCH_SAMPLE * width additions, so that the
+	estimates follow changes in the workload.
+*/
+
+#define FREQ_SKETCH_ROWS 4
+#define FREQ_SKETCH_SAMPLE 10
+
+typedef struct freq_sketch_t freq_sketch;
+
+
+/**
+	Creates a sketch with width counters per row, rounded up to a power
+	of two.
+*/
+freq_sketch* freq_sketch_new(int width);
+
+
+void freq_sketch_free(freq_sketch* s);
+
+
+/**
+	Records one access to the key with hash h.
+*/
+void freq_sketch_add(freq_sketch* s, unsigned int h);
+
+
+/**
+	Returns the estimated number of accesses to the key with hash h.
+*/
+int freq_sketch_estimate(freq_sketch* s, unsigned int h);
+
+
+/**
+	Returns the number of times counters were halved.
+*/
+long freq_sketch_resets(freq_sketch* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FREQ_SKETCH_H_ */
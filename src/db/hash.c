@@ -18,6 +18,22 @@
 */
 
 #include "hash.h"
+#include "config.h"
+
+#include <string.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static unsigned long long read64(const unsigned char* p);
+static unsigned int read32(const unsigned char* p);
+static unsigned long long xxh64_round(unsigned long long acc, unsigned long long in);
+static unsigned long long xxh64_merge(unsigned long long acc, unsigned long long v);
 
 /*
     Jenkins' one at a time hash
@@ -48,3 +64,110 @@ unsigned int djb2_hash(char *str, int size) {
     return hash;
 }
 
+
+
+unsigned long long xxh64(const void* data, int size, unsigned long long seed) {
+    const unsigned char* p = data;
+    const unsigned char* end = p + size;
+    unsigned long long h, v1, v2, v3, v4;
+
+    if (size >= 32) {
+        v1 = seed + PRIME64_1 + PRIME64_2;
+        v2 = seed + PRIME64_2;
+        v3 = seed;
+        v4 = seed - PRIME64_1;
+        do {
+            v1 = xxh64_round(v1, read64(p));
+            v2 = xxh64_round(v2, read64(p + 8));
+            v3 = xxh64_round(v3, read64(p + 16));
+            v4 = xxh64_round(v4, read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+        h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+    h += (unsigned long long)size;
+
+    while (p + 8 <= end) {
+        h ^= xxh64_round(0, read64(p));
+        h = ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (unsigned long long)read32(p) * PRIME64_1;
+        h = ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * PRIME64_5;
+        h = ROTL64(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+
+unsigned int key_hash(char* k, int size) {
+    if (HashVersion == HASH_JOAT_DJB2)
+        return joat_hash(k, size);
+    return (unsigned int)xxh64(k, size, 0);
+}
+
+
+void key_hash_pair(char* k, int size, unsigned int h[2]) {
+    unsigned long long x;
+    
+    /* As sent by the baseline nodes: the read/write set hashtable hash,
+       the raw key for int keys, and djb2 */
+    if (HashVersion == HASH_JOAT_DJB2) {
+        if (size == sizeof(unsigned int))
+            memcpy(&h[0], k, sizeof(unsigned int));
+        else
+            h[0] = joat_hash(k, size);
+        h[1] = djb2_hash(k, size);
+        return;
+    }
+    x = xxh64(k, size, 0);
+    h[0] = (unsigned int)x;
+    h[1] = (unsigned int)(x >> 32);
+}
+
+
+/* Keys are hashed in host order, the certifier and the nodes are
+   expected to share the same endianness. */
+static unsigned long long read64(const unsigned char* p) {
+    unsigned long long v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+static unsigned int read32(const unsigned char* p) {
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+
+static unsigned long long xxh64_round(unsigned long long acc, unsigned long long in) {
+    acc += in * PRIME64_2;
+    acc = ROTL64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+
+static unsigned long long xxh64_merge(unsigned long long acc, unsigned long long v) {
+    acc ^= xxh64_round(0, v);
+    return acc * PRIME64_1 + PRIME64_4;
+}
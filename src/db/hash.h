@@ -20,11 +20,38 @@
 #ifndef _HASH_H_
 #define _HASH_H_
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef unsigned int (*hash_fun)(char*, int);
 
 unsigned int joat_hash (char* k, int size);
 
 unsigned int djb2_hash (char *str, int size);
 
+/*
+    XXH64 of size bytes at data, reads 8 bytes at a time.
+*/
+unsigned long long xxh64(const void* data, int size, unsigned long long seed);
+
+/*
+    Hash of a key with the function selected by HashVersion: joat_hash
+    for HASH_JOAT_DJB2, the low half of xxh64 for HASH_XXH64.
+*/
+unsigned int key_hash(char* k, int size);
+
+/*
+    The two hashes of a key sent to the certifier. With HASH_XXH64 both
+    come from a single xxh64 pass and h[0] is key_hash(). With
+    HASH_JOAT_DJB2 h[0] is the key itself for 4 byte keys, as it was
+    before HashVersion, and key_hash() otherwise.
+*/
+void key_hash_pair(char* k, int size, unsigned int h[2]);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* _HASH_H_ */
 
@@ -0,0 +1,101 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "recent_writes.h"
+#include <stdlib.h>
+#include <assert.h>
+
+typedef struct recent_write_t {
+	unsigned int hash[2];
+	int st;
+} recent_write;
+
+static recent_write* table = NULL;
+static unsigned int mask = 0;
+
+static recent_write* bucket(unsigned int h[2]);
+
+
+void recent_writes_init(int size) {
+	unsigned int buckets = 1;
+	
+	recent_writes_free();
+	if (size < RECENT_WRITES_WAYS)
+		return;
+	while (buckets * 2 * RECENT_WRITES_WAYS <= (unsigned int)size)
+		buckets *= 2;
+	table = calloc(buckets * RECENT_WRITES_WAYS, sizeof(recent_write));
+	assert(table != NULL);
+	mask = buckets - 1;
+}
+
+
+void recent_writes_free() {
+	free(table);
+	table = NULL;
+	mask = 0;
+}
+
+
+void recent_writes_add(unsigned int h[2], int st) {
+	int i;
+	recent_write* b;
+	recent_write* victim;
+	
+	if (table == NULL)
+		return;
+	
+	b = victim = bucket(h);
+	for (i = 0; i < RECENT_WRITES_WAYS; i++) {
+		if (b[i].hash[0] == h[0] && b[i].hash[1] == h[1]) {
+			if (st > b[i].st)
+				b[i].st = st;
+			return;
+		}
+		if (b[i].st < victim->st)
+			victim = &b[i];
+	}
+	victim->hash[0] = h[0];
+	victim->hash[1] = h[1];
+	victim->st = st;
+}
+
+
+int recent_writes_after(unsigned int h[2], int st) {
+	int i;
+	recent_write* b;
+	
+	if (table == NULL)
+		return 0;
+	
+	b = bucket(h);
+	for (i = 0; i < RECENT_WRITES_WAYS; i++)
+		if (b[i].hash[0] == h[0] && b[i].hash[1] == h[1])
+			return b[i].st > st;
+	return 0;
+}
+
+
+/*
+	The high half of the hash picks the bucket: the low half already
+	picks the partition and the storage slot of the key.
+*/
+static recent_write* bucket(unsigned int h[2]) {
+	return &table[(h[1] & mask) * RECENT_WRITES_WAYS];
+}
@@ -0,0 +1,69 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RECENT_WRITES_H_
+#define _RECENT_WRITES_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dsmDB_priv.h"
+
+/**
+	Index of the keys written by the transactions delivered to this
+	node: the hash pair of each key, as sent to the certifier, maps to
+	the last ST at which it was written. The index has a fixed number of
+	entries in buckets of RECENT_WRITES_WAYS; a full bucket forgets its
+	oldest write. A forgotten write only means that a conflict is left
+	to the certifier, so any conflict found here is one the certifier
+	finds too.
+*/
+
+#define RECENT_WRITES_WAYS 4
+
+
+/**
+	Creates an index of size entries, rounded down to a power of two.
+	With size 0 the index is disabled: it keeps nothing and finds no
+	conflict.
+*/
+void recent_writes_init(int size);
+
+void recent_writes_free();
+
+
+/**
+	Records that the key with hash pair h was written at st.
+*/
+void recent_writes_add(unsigned int h[2], int st);
+
+
+/**
+	Returns 1 if the key with hash pair h is known to have been written
+	after st, 0 otherwise.
+*/
+int recent_writes_after(unsigned int h[2], int st);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -33,6 +33,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <event2/event.h>
 #include <event2/buffer.h>
 #include <event2/bufferevent.h>
@@ -48,6 +50,7 @@ typedef struct get_request_t {
 	int version;
 	sm_get_cb cb;
 	int timeout_count;
+	int cache;
 	struct event timeout_ev;
 } get_request;
 
@@ -206,8 +209,9 @@ void remote_get(key* k, int ver, sm_get_cb cb, void* arg) {
 	req->cb = cb;
 	req->arg = arg;
 	req->timeout_count = 0;
+	storage_snapshot_acquire(ver);
 	
-	node_id = peer_id_for_hash(joat_hash(k->data, k->size));
+	node_id = peer_id_for_hash(key_hash(k->data, k->size));
 	
 	if (node_id == NodeID) {
 		local = 1;
@@ -218,12 +222,18 @@ void remote_get(key* k, int ver, sm_get_cb cb, void* arg) {
 		send_remote_get(req, node_id);
 	}
 	
-	// added this
-	val* v = val_new(NULL, 0);
-	storage_put(k, v, local, 1);
-	val_free(v);
+	// Values of keys not admitted in the cache are only handed to cb
+	req->cache = local || storage_admit(k);
+	if (req->cache) {
+		// added this
+		val* v = val_new(NULL, 0);
+		storage_put(k, v, local, 1);
+		val_free(v);
+		// The placeholder must survive GC until the reply, deliveries
+		// in between are dropped otherwise
+		storage_pin(k, req->id);
+	}
 	
-	storage_gc_stop();
 	get_request_add(req);
 }
 
@@ -351,6 +361,8 @@ static void reply_remote_get(remote_get_message* m, key* k, val* v, int cache) {
 	remote_message* rm;
 	remote_put_message* msg;
 	struct sockaddr_in addr;
+	struct iovec iov[2];
+	struct msghdr hdr;
 	
 	rm = (remote_message*)&send_buffer;
 	msg = (remote_put_message*)rm->data;
@@ -365,18 +377,23 @@ static void reply_remote_get(remote_get_message* m, key* k, val* v, int cache) {
 	msg->cache = cache;
 	
     memcpy(msg->data, k->data, k->size);
-    memcpy(&msg->data[k->size], v->data, v->size);
 
+	// The value is sent from where it is, right after the key
 	size = REMOTE_PUT_MSG_SIZE(msg) + sizeof(remote_message);
+	iov[0].iov_base = send_buffer;
+	iov[0].iov_len = size - v->size;
+	iov[1].iov_base = v->data;
+	iov[1].iov_len = v->size;
+	
 	p = peer_get(m->sender_node);
 	socket_set_address(&addr, peer_address(p), peer_port(p));
-
-	rv = sendto(send_sock,
-		   		send_buffer,
-	   	   		size,
-		   		0,
-	   	   		(struct sockaddr*)&addr,
-	   	   		sizeof(addr));
+	
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.msg_name = &addr;
+	hdr.msg_namelen = sizeof(addr);
+	hdr.msg_iov = iov;
+	hdr.msg_iovlen = 2;
+	rv = sendmsg(send_sock, &hdr, 0);
 	
 	if (rv == -1)
 		perror("sendto");
@@ -393,7 +410,8 @@ static void handle_deferred_remote_get(key* k, val* v, void* arg) {
 
 static void handle_remote_get(remote_message* rm) {
 	key k;
-	val* v;
+	val v;
+	val_view w, newest;
 	int cache = 0;
 	remote_get_message* msg;
 	msg = (remote_get_message*)rm->data;
@@ -410,8 +428,7 @@ static void handle_remote_get(remote_message* rm) {
 	}
 	
 	// Reply
-	v = storage_get(&k, msg->version);
-	if (v == NULL) {
+	if (!storage_get_view(&k, msg->version, &w)) {
 		request_drop_count++;
 		remote_get_message* m = malloc(REMOTE_GET_MSG_SIZE(msg));
 		memcpy(m, msg, REMOTE_GET_MSG_SIZE(msg));
@@ -423,14 +440,18 @@ static void handle_remote_get(remote_message* rm) {
 	// at the receiver.
 	if (cproxy_current_st() >= msg->st) {
 		// check thet v is the newest item in storage
-		val* newest = storage_get(&k, cproxy_current_st());
-		if (newest->version == v->version)
-			cache = 1;
-		val_free(newest);
+		if (storage_get_view(&k, cproxy_current_st(), &newest)) {
+			if (newest.version == w.version)
+				cache = 1;
+			storage_view_release(&newest);
+		}
 	}
 	
-	reply_remote_get(msg, &k, v, cache);
-	val_free(v);
+	v.size = w.size;
+	v.version = w.version;
+	v.data = w.data;
+	reply_remote_get(msg, &k, &v, cache);
+	storage_view_release(&w);
 }
 
 
@@ -457,9 +478,10 @@ static void handle_remote_put(remote_message* rm) {
 	if (msg->cache) {
 	    if (v.size > 0) {
 			int local = 0;
-			if (peer_id_for_hash(joat_hash(k.data, k.size)) == NodeID)
+			if (peer_id_for_hash(key_hash(k.data, k.size)) == NodeID)
 			local = 1;
-			storage_put(&k, &v, local, 1);
+			if (r->cache)
+				storage_put(&k, &v, local, 1);
 		} else {
 			v.data = NULL;
 			request_completed_null++;
@@ -472,12 +494,12 @@ static void handle_remote_put(remote_message* rm) {
 	}
 	
 	evtimer_del(&r->timeout_ev);
+	storage_snapshot_release(r->version);
+	if (r->cache)
+		storage_unpin(r->k, r->id);
 	key_free(r->k);
 	free(r);
 	
-	if (hashtable_count(requests) == 0)
-		storage_gc_start();
-	
 	request_completed_count++;
 }
 
@@ -495,9 +517,10 @@ static void handle_rec_key_reply(remote_message* msg) {
 	
 	if (rep->size > 0) {	
 		value = versioned_val_new(rep->data, rep->size, rep->version);
-		if (peer_id_for_hash(joat_hash(r->k->data, r->k->size)) == NodeID)
+		if (peer_id_for_hash(key_hash(r->k->data, r->k->size)) == NodeID)
 			local = 1;
-		storage_put(r->k, value, local, 1);
+		if (r->cache)
+			storage_put(r->k, value, local, 1);
 	} else {
 		request_completed_null++;
 		value = val_new(NULL, 0);
@@ -510,6 +533,9 @@ static void handle_rec_key_reply(remote_message* msg) {
 	val_free(value);
 	
 	evtimer_del(&r->timeout_ev);
+	storage_snapshot_release(r->version);
+	if (r->cache)
+		storage_unpin(r->k, r->id);
 	key_free(r->k);
 	free(r);
 	
@@ -525,7 +551,7 @@ static void on_request_timeout(int fd, short ev, void* arg) {
 	r->timeout_count++;
 	
 	// resend the request
-	id = peer_id_for_hash(joat_hash(r->k->data, r->k->size));
+	id = peer_id_for_hash(key_hash(r->k->data, r->k->size));
 	if (id == NodeID) {
 		send_rec_key(r);
 	} else {
@@ -562,7 +588,7 @@ static int key_equal(void* k1, void* k2) {
 
 
 static unsigned int hash_from_key(void* k) {
-	return joat_hash(k, sizeof(int));
+	return key_hash(k, sizeof(int));
 }
 
 
@@ -0,0 +1,192 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "skiplist.h"
+#include "slab.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+	A node of level l has l forward pointers. The head is a node of
+	level SKIPLIST_MAX_LEVEL with no item.
+*/
+struct skiplist_node_t {
+	void* item;
+	int level;
+	skiplist_node* next[0];
+};
+
+#define NODE_SIZE(l) (sizeof(skiplist_node) + (l) * sizeof(skiplist_node*))
+
+
+struct skiplist_t {
+	skiplist_cmp cmp;
+	int level;
+	long count;
+	unsigned int seed;
+	skiplist_node* head;
+};
+
+
+static skiplist_node* node_new(void* item, int level);
+static int random_level(skiplist* s);
+static skiplist_node* find(skiplist* s, const char* k, int size,
+	skiplist_node** update);
+
+
+skiplist* skiplist_new(skiplist_cmp cmp) {
+	skiplist* s;
+	
+	s = malloc(sizeof(skiplist));
+	if (s == NULL)
+		return NULL;
+	s->cmp = cmp;
+	s->level = 1;
+	s->count = 0;
+	s->seed = 2463534242U;
+	s->head = node_new(NULL, SKIPLIST_MAX_LEVEL);
+	return s;
+}
+
+
+void skiplist_free(skiplist* s) {
+	skiplist_node* n;
+	skiplist_node* next;
+	
+	for (n = s->head; n != NULL; n = next) {
+		next = n->next[0];
+		slab_free(n, NODE_SIZE(n->level));
+	}
+	free(s);
+}
+
+
+int skiplist_insert(skiplist* s, void* item, const char* k, int size) {
+	int i, level;
+	skiplist_node* n;
+	skiplist_node* update[SKIPLIST_MAX_LEVEL];
+	
+	n = find(s, k, size, update);
+	if (n != NULL && s->cmp(n->item, k, size) == 0)
+		return -1;
+	
+	level = random_level(s);
+	if (level > s->level) {
+		for (i = s->level; i < level; i++)
+			update[i] = s->head;
+		s->level = level;
+	}
+	
+	n = node_new(item, level);
+	for (i = 0; i < level; i++) {
+		n->next[i] = update[i]->next[i];
+		update[i]->next[i] = n;
+	}
+	s->count++;
+	return 0;
+}
+
+
+int skiplist_remove(skiplist* s, const char* k, int size) {
+	int i;
+	skiplist_node* n;
+	skiplist_node* update[SKIPLIST_MAX_LEVEL];
+	
+	n = find(s, k, size, update);
+	if (n == NULL || s->cmp(n->item, k, size) != 0)
+		return -1;
+	
+	for (i = 0; i < n->level; i++)
+		update[i]->next[i] = n->next[i];
+	while (s->level > 1 && s->head->next[s->level - 1] == NULL)
+		s->level--;
+	slab_free(n, NODE_SIZE(n->level));
+	s->count--;
+	return 0;
+}
+
+
+skiplist_node* skiplist_seek(skiplist* s, const char* k, int size) {
+	if (k == NULL)
+		return s->head->next[0];
+	return find(s, k, size, NULL);
+}
+
+
+skiplist_node* skiplist_next(skiplist_node* n) {
+	return n->next[0];
+}
+
+
+void* skiplist_item(skiplist_node* n) {
+	return n->item;
+}
+
+
+long skiplist_count(skiplist* s) {
+	return s->count;
+}
+
+
+static skiplist_node* node_new(void* item, int level) {
+	skiplist_node* n;
+	
+	n = slab_alloc(NODE_SIZE(level));
+	memset(n, 0, NODE_SIZE(level));
+	n->item = item;
+	n->level = level;
+	return n;
+}
+
+
+/*
+	Each level holds a quarter of the nodes of the one below, enough
+	for 4^SKIPLIST_MAX_LEVEL items. The generator is a xorshift.
+*/
+static int random_level(skiplist* s) {
+	int level = 1;
+	
+	s->seed ^= s->seed << 13;
+	s->seed ^= s->seed >> 17;
+	s->seed ^= s->seed << 5;
+	while (level < SKIPLIST_MAX_LEVEL && ((s->seed >> (2 * level)) & 3) == 0)
+		level++;
+	return level;
+}
+
+
+/*
+	Returns the first node with a key greater or equal to k. If update
+	is not NULL, it is filled with the last node before it at each level.
+*/
+static skiplist_node* find(skiplist* s, const char* k, int size,
+	skiplist_node** update) {
+	int i;
+	skiplist_node* n = s->head;
+	
+	for (i = s->level - 1; i >= 0; i--) {
+		while (n->next[i] != NULL && s->cmp(n->next[i]->item, k, size) < 0)
+			n = n->next[i];
+		if (update != NULL)
+			update[i] = n;
+	}
+	return n->next[0];
+}
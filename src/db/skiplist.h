@@ -0,0 +1,79 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SKIPLIST_H_
+#define _SKIPLIST_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	Skiplist of items ordered by their key bytes, compared with memcmp()
+	and then by size, so that a key sorts right after its prefixes. The
+	skiplist does not copy the keys: cmp compares the key of an item with
+	a given key, and returns <0, 0 or >0 as the item is smaller, equal or
+	greater. Nodes are allocated with slab_alloc().
+*/
+
+#define SKIPLIST_MAX_LEVEL 16
+
+typedef struct skiplist_t skiplist;
+
+typedef struct skiplist_node_t skiplist_node;
+
+typedef int (*skiplist_cmp)(void* item, const char* k, int size);
+
+
+skiplist* skiplist_new(skiplist_cmp cmp);
+
+void skiplist_free(skiplist* s);
+
+
+/**
+	Inserts item, whose key is k. Returns 0, or -1 if the key is already
+	in the skiplist.
+*/
+int skiplist_insert(skiplist* s, void* item, const char* k, int size);
+
+
+/**
+	Removes the item with key k. Returns 0, or -1 if there is none.
+*/
+int skiplist_remove(skiplist* s, const char* k, int size);
+
+
+/**
+	Returns the node of the first item with a key greater or equal to k,
+	the first node if k is NULL, NULL if there is no such item.
+*/
+skiplist_node* skiplist_seek(skiplist* s, const char* k, int size);
+
+skiplist_node* skiplist_next(skiplist_node* n);
+
+void* skiplist_item(skiplist_node* n);
+
+
+long skiplist_count(skiplist* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SKIPLIST_H_ */
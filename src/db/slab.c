@@ -0,0 +1,349 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "slab.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/queue.h>
+
+
+#define SLAB_ALIGN 16
+#define SLAB_MAX_CLASSES 64
+#define ROUND_UP(n) (((n) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+
+LIST_HEAD(slab_head, slab_t);
+
+
+/*
+	Header placed at the beginning of every slab. Objects are carved
+	lazily from the slab (carved counts them), freed objects are pushed
+	on the slab's free list.
+*/
+typedef struct slab_t {
+	LIST_ENTRY(slab_t) partial;
+	int cls;
+	int used;
+	int carved;
+	void* free_list;
+} slab;
+
+#define SLAB_HEADER_SIZE ROUND_UP(sizeof(slab))
+#define SLAB_OF(p) ((slab*)((uintptr_t)(p) & ~((uintptr_t)SLAB_SIZE - 1)))
+#define SLAB_DATA(s) ((char*)(s) + SLAB_HEADER_SIZE)
+
+
+/*
+	Slabs with at least one free object are kept in the partial list
+	of their class, full slabs are not linked anywhere.
+*/
+typedef struct slab_class_t {
+	int size;
+	int per_slab;
+	int slabs;
+	struct slab_head partial;
+} slab_class;
+
+
+/*
+	Deferred frees are queued on the epoch that was current when they
+	were released. Epochs are kept from the oldest to the current one,
+	and a new epoch is opened only when a reader enters after some
+	blocks were released in the current one.
+*/
+typedef struct deferred_t {
+	void* p;
+	int size;
+	struct deferred_t* next;
+} deferred;
+
+typedef struct epoch_t {
+	long readers;
+	deferred* frees;
+	struct epoch_t* next;
+} epoch;
+
+
+static int class_count = 0;
+static slab_class classes[SLAB_MAX_CLASSES];
+static unsigned char class_of[(SLAB_MAX_OBJECT / SLAB_ALIGN) + 1];
+static long used_bytes = 0;
+static long large_bytes = 0;
+static int mapped_slabs = 0;
+static epoch* oldest_epoch = NULL;
+static epoch* current_epoch = NULL;
+static long epoch_readers = 0;
+static long deferred_bytes = 0;
+
+static void init_classes();
+static slab* slab_new(slab_class* c);
+static void slab_unmap(slab_class* c, slab* s);
+
+
+void* slab_alloc(int size) {
+	void* p;
+	slab* s;
+	slab_class* c;
+	
+	if (size <= 0)
+		return NULL;
+	
+	if (size > SLAB_MAX_OBJECT) {
+		p = malloc(size);
+		if (p == NULL) {
+			printf("Malloc failed, out of memory!!!\n");
+			exit(1);
+		}
+		large_bytes += size;
+		used_bytes += size;
+		return p;
+	}
+	
+	if (class_count == 0)
+		init_classes();
+	
+	c = &classes[class_of[(size + SLAB_ALIGN - 1) / SLAB_ALIGN]];
+	if ((s = LIST_FIRST(&c->partial)) == NULL)
+		s = slab_new(c);
+	
+	if (s->free_list != NULL) {
+		p = s->free_list;
+		s->free_list = *(void**)p;
+	} else {
+		p = SLAB_DATA(s) + (s->carved * c->size);
+		s->carved++;
+	}
+	
+	s->used++;
+	if (s->used == c->per_slab)
+		LIST_REMOVE(s, partial);
+	used_bytes += c->size;
+	return p;
+}
+
+
+void slab_free(void* p, int size) {
+	slab* s;
+	slab_class* c;
+	
+	if (p == NULL)
+		return;
+	
+	if (size > SLAB_MAX_OBJECT) {
+		free(p);
+		large_bytes -= size;
+		used_bytes -= size;
+		return;
+	}
+	
+	s = SLAB_OF(p);
+	c = &classes[s->cls];
+	if (s->used == c->per_slab)
+		LIST_INSERT_HEAD(&c->partial, s, partial);
+	
+	*(void**)p = s->free_list;
+	s->free_list = p;
+	s->used--;
+	used_bytes -= c->size;
+}
+
+
+void* slab_epoch_enter() {
+	epoch* e;
+	
+	if (current_epoch == NULL || current_epoch->frees != NULL) {
+		e = calloc(1, sizeof(epoch));
+		if (e == NULL) {
+			printf("Malloc failed, out of memory!!!\n");
+			exit(1);
+		}
+		if (current_epoch == NULL)
+			oldest_epoch = e;
+		else
+			current_epoch->next = e;
+		current_epoch = e;
+	}
+	current_epoch->readers++;
+	epoch_readers++;
+	return current_epoch;
+}
+
+
+void slab_epoch_exit(void* p) {
+	epoch* e = (epoch*)p;
+	deferred* d;
+	
+	e->readers--;
+	epoch_readers--;
+	
+	while (oldest_epoch != NULL && oldest_epoch->readers == 0) {
+		e = oldest_epoch;
+		while ((d = e->frees) != NULL) {
+			e->frees = d->next;
+			slab_free(d->p, d->size);
+			deferred_bytes -= d->size;
+			free(d);
+		}
+		oldest_epoch = e->next;
+		if (e == current_epoch)
+			current_epoch = NULL;
+		free(e);
+	}
+}
+
+
+void slab_free_deferred(void* p, int size) {
+	deferred* d;
+	
+	if (epoch_readers == 0) {
+		slab_free(p, size);
+		return;
+	}
+	
+	d = malloc(sizeof(deferred));
+	if (d == NULL) {
+		printf("Malloc failed, out of memory!!!\n");
+		exit(1);
+	}
+	d->p = p;
+	d->size = size;
+	d->next = current_epoch->frees;
+	current_epoch->frees = d;
+	deferred_bytes += size;
+}
+
+
+long slab_deferred_bytes() {
+	return deferred_bytes;
+}
+
+
+long slab_reclaim(int keep) {
+	int i, kept;
+	long bytes = 0;
+	slab *s, *next;
+	
+	for (i = 0; i < class_count; i++) {
+		kept = 0;
+		s = LIST_FIRST(&classes[i].partial);
+		while (s != NULL) {
+			next = LIST_NEXT(s, partial);
+			if (s->used == 0) {
+				if (kept < keep) {
+					kept++;
+				} else {
+					slab_unmap(&classes[i], s);
+					bytes += SLAB_SIZE;
+				}
+			}
+			s = next;
+		}
+	}
+	return bytes;
+}
+
+
+long slab_used_bytes() {
+	return used_bytes;
+}
+
+
+long slab_mapped_bytes() {
+	return ((long)mapped_slabs * SLAB_SIZE) + large_bytes;
+}
+
+
+int slab_count() {
+	return mapped_slabs;
+}
+
+
+/*
+	Classes are spaced by SLAB_ALIGN bytes up to 128 bytes, and grow by
+	25% from there on, so that at most ~20% of an object is wasted.
+*/
+static void init_classes() {
+	int i, c, size = SLAB_ALIGN;
+	
+	while (size < SLAB_MAX_OBJECT) {
+		classes[class_count++].size = size;
+		if (size < 128)
+			size += SLAB_ALIGN;
+		else
+			size = ROUND_UP(size + (size / 4));
+	}
+	classes[class_count++].size = SLAB_MAX_OBJECT;
+	
+	for (i = 0; i < class_count; i++) {
+		classes[i].per_slab = (SLAB_SIZE - SLAB_HEADER_SIZE) / classes[i].size;
+		classes[i].slabs = 0;
+		LIST_INIT(&classes[i].partial);
+	}
+	
+	c = 0;
+	for (i = 0; i <= (SLAB_MAX_OBJECT / SLAB_ALIGN); i++) {
+		while (classes[c].size < (i * SLAB_ALIGN))
+			c++;
+		class_of[i] = c;
+	}
+}
+
+
+/*
+	Maps 2*SLAB_SIZE bytes and trims them to a SLAB_SIZE aligned slab,
+	so that the slab of an object can be found by masking its address.
+*/
+static slab* slab_new(slab_class* c) {
+	char* p;
+	size_t head;
+	slab* s;
+	
+	p = mmap(NULL, 2 * SLAB_SIZE, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (p == MAP_FAILED) {
+		printf("Slab mmap failed, out of memory!!!\n");
+		exit(1);
+	}
+	
+	head = (SLAB_SIZE - ((uintptr_t)p & (SLAB_SIZE - 1))) & (SLAB_SIZE - 1);
+	if (head > 0)
+		munmap(p, head);
+	munmap(p + head + SLAB_SIZE, SLAB_SIZE - head);
+	
+	s = (slab*)(p + head);
+	s->cls = c - classes;
+	s->used = 0;
+	s->carved = 0;
+	s->free_list = NULL;
+	LIST_INSERT_HEAD(&c->partial, s, partial);
+	c->slabs++;
+	mapped_slabs++;
+	return s;
+}
+
+
+static void slab_unmap(slab_class* c, slab* s) {
+	LIST_REMOVE(s, partial);
+	munmap(s, SLAB_SIZE);
+	c->slabs--;
+	mapped_slabs--;
+}
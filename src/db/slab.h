@@ -0,0 +1,106 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SLAB_H_
+#define _SLAB_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	Size-class slab allocator used by the storage for key entries,
+	vsets and values.
+
+	Objects up to SLAB_MAX_OBJECT bytes are carved from SLAB_SIZE bytes
+	slabs, each slab serving a single size class and keeping its own
+	free list. Slabs that become empty can be given back to the OS with
+	slab_reclaim(). Larger objects fall back to malloc().
+
+	The caller must pass to slab_free() the same size it passed to
+	slab_alloc().
+*/
+
+#define SLAB_SIZE (64*1024)
+#define SLAB_MAX_OBJECT 8192
+
+
+/**
+	Returns a block of at least size bytes, NULL if size is 0.
+*/
+void* slab_alloc(int size);
+
+
+/**
+	Releases a block previously obtained with slab_alloc(size).
+*/
+void slab_free(void* p, int size);
+
+
+/**
+	Borrowed references. A reader that keeps a pointer to a block across
+	event loop turns enters an epoch with slab_epoch_enter(), and leaves
+	it with slab_epoch_exit() once done with the pointer. Blocks released
+	with slab_free_deferred() while readers are around are actually freed
+	only after every reader that entered before the release has left.
+*/
+void* slab_epoch_enter();
+
+void slab_epoch_exit(void* epoch);
+
+void slab_free_deferred(void* p, int size);
+
+
+/**
+	Returns the bytes released with slab_free_deferred() not yet freed.
+*/
+long slab_deferred_bytes();
+
+
+/**
+	Unmaps empty slabs, keeping at most keep empty slabs per size class.
+	Returns the number of bytes given back to the OS.
+*/
+long slab_reclaim(int keep);
+
+
+/**
+	Returns the bytes currently handed out, rounded up to the size class
+	of each object.
+*/
+long slab_used_bytes();
+
+
+/**
+	Returns the bytes currently obtained from the OS.
+*/
+long slab_mapped_bytes();
+
+
+/**
+	Returns the number of slabs currently mapped.
+*/
+int slab_count();
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SLAB_H_ */
@@ -22,20 +22,75 @@
 #include "storage.h"
 #include "remote.h"
 #include "peer.h"
+#include "slab.h"
+#include "vset.h"
+#include "cproxy.h"
+#include "snapshot.h"
 
 #include <event.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
 
 
 static int recovering = 0;
-static int32_t cksum = 0;
 static struct event gc_timer;
 static struct timeval gc_timeval = {0, 100000};
+static struct timeval gc_busy_timeval = {0, 1000};
+
+
+/*
+	Budget of each GC tick. While the storage is still above its limit
+	after a tick, the next one is scheduled after gc_busy_timeval.
+*/
+#define GC_TICK_USECS 2000
+#define GC_TICK_BYTES (32*1024*1024)
+
+static long gc_ticks;
+static long gc_pause_total;
+static long gc_pause_max;
+static long gc_bytes_total;
+static long gc_bytes_max;
+static long gc_overshoot_max;
+static struct event prune_timer;
+static struct timeval prune_timeval = {0, 10000};
+
+
+/*
+	Number of storage entries whose old versions are pruned at each
+	tick of the prune timer.
+*/
+#define PRUNE_SLOTS_PER_TICK 16384
+
+
+/*
+	Bytes of spilled records moved at each tick of the prune timer to
+	compact the spill file.
+*/
+#define SPILL_COMPACT_BYTES_PER_TICK (1024*1024)
+
+
+static struct event snapshot_timer;
+static struct timeval snapshot_timeval;
+static struct event snapshot_signal;
+static struct event child_signal;
+static pid_t snapshot_pid = 0;
+static int snapshot_st;
+static struct timeval snapshot_start;
+static long snapshot_count;
+static long snapshot_failures;
+static long snapshot_fork_max;
 
 
 static void print_stats();
 static void gc(int fd, short event, void* arg);
+static void prune(int fd, short event, void* arg);
+static void on_snapshot_timer(int fd, short event, void* arg);
+static void on_snapshot_signal(int sig, short event, void* arg);
+static void on_child(int sig, short event, void* arg);
 
 
 int sm_init(struct evpaxos_config *lp_config, struct event_base *base) {
@@ -49,6 +104,19 @@ int sm_init(struct evpaxos_config *lp_config, struct event_base *base) {
     
 	evtimer_set(&gc_timer, gc, NULL);
 	event_add(&gc_timer, &gc_timeval);
+	evtimer_set(&prune_timer, prune, NULL);
+	event_add(&prune_timer, &prune_timeval);
+	
+	evsignal_set(&snapshot_signal, SIGUSR1, on_snapshot_signal, NULL);
+	event_add(&snapshot_signal, NULL);
+	evsignal_set(&child_signal, SIGCHLD, on_child, NULL);
+	event_add(&child_signal, NULL);
+	if (StorageSnapshotInterval > 0) {
+		snapshot_timeval.tv_sec = StorageSnapshotInterval;
+		snapshot_timeval.tv_usec = 0;
+		evtimer_set(&snapshot_timer, on_snapshot_timer, NULL);
+		event_add(&snapshot_timer, &snapshot_timeval);
+	}
     return 1;
 }
 
@@ -92,9 +160,14 @@ val* sm_get(key* k, int version) {
 }
 
 
+int sm_get_view(key* k, int version, val_view* w) {
+	return storage_get_view(k, version, w);
+}
+
+
 int sm_put(key* k, val* v) {
 	int local = 0;
-	if (peer_id_for_hash(joat_hash(k->data, k->size)) == NodeID)
+	if (peer_id_for_hash(key_hash(k->data, k->size)) == NodeID)
 		local = 1;
     return storage_put(k, v, local, 0);
 }
@@ -106,54 +179,186 @@ void sm_recovery() {
 }
 
 
-static void iter(key* k, val* v, void* arg) {
-	size_t rv;
-	FILE* fp = (FILE*)arg;
-	// Put will consist of keylen, k data, value len, value data
-	if(fwrite(&k->size, sizeof(int), 1,fp) != 1) goto exception;
-	if(fwrite(k->data, k->size, 1,fp) != 1) goto exception;
-	if(fwrite(&v->size, sizeof(int), 1,fp) != 1) goto exception;
-	if(fwrite(v->data, v->size, 1,fp) != 1) goto exception;
-	return;
-exception:
-	printf("Failed on fwrite!\n");
-	exit(-1);
+void sm_dump_storage(char* path, int version) {
+	long n;
+	if ((n = snapshot_write(path, version)) < 0)
+		return;
+	printf("Dumped %ld keys at ST %d to %s\n", n, version, path);
 }
 
 
-void sm_dump_storage(char* path, int version) {
-	FILE *fp = fopen(path, "w");
-	// Preserve 4 bytes for checksum -- implement if we're sure file is
-	// being written correctly
-	//	fwrite(&cksum, sizeof(int32_t), 1, fp);
-	storage_iterate(version, iter, fp);
-	if(fclose(fp) != 0)
-	{
-		printf("Error closing file!\n");
-		exit(-1);
+/*
+	The snapshot is written by a child process, which sees the storage as
+	it was at the fork thanks to copy-on-write: the event loop only pays
+	for the fork. The spill file is shared with the child, so its space
+	is not reused until the child is done.
+*/
+int sm_snapshot(char* path) {
+	pid_t pid;
+	long pause;
+	struct timeval end;
+	
+	if (path == NULL || snapshot_pid > 0)
+		return -1;
+	
+	snapshot_st = cproxy_current_st();
+	storage_spill_freeze(1);
+	gettimeofday(&snapshot_start, NULL);
+	if ((pid = fork()) == 0)
+		_exit(snapshot_write(path, snapshot_st) < 0 ? 1 : 0);
+	
+	if (pid < 0) {
+		perror("fork");
+		storage_spill_freeze(0);
+		snapshot_failures++;
+		return -1;
 	}
+	
+	gettimeofday(&end, NULL);
+	pause = (end.tv_sec - snapshot_start.tv_sec) * 1000000 +
+		(end.tv_usec - snapshot_start.tv_usec);
+	if (pause > snapshot_fork_max)
+		snapshot_fork_max = pause;
+	snapshot_pid = pid;
+	return 0;
+}
+
+
+int sm_restore_storage(char* path) {
+	return snapshot_load(path, 0);
 }
 
 
 /*
-    Checks that at least bytes_to_free bytes are available in the storage.
+    Checks that at least bytes_to_free bytes are available in the storage,
+    freeing at most max_bytes bytes in at most usecs microseconds (0 for
+    no limit). Returns the bytes that are still to be freed.
 */
-static void collect_garbage(long bytes_to_free) {
+static long collect_garbage(long bytes_to_free, long max_bytes, long usecs) {
     long curr_size = storage_get_current_size(); 
     long free_space = StorageMaxSize - curr_size;
+    long needed, freed, pause;
+    struct timeval start, end;
+    
     //Free < 0: return under the limit+min_free_space
-    if (free_space <= 0) {
-        storage_gc_at_least(-(free_space) + bytes_to_free) ;
-    } else if (free_space < bytes_to_free) {
-        //Almost full cache
-        storage_gc_at_least(bytes_to_free - free_space);
-    }
+    needed = bytes_to_free - free_space;
+    if (needed <= 0)
+        return 0;
+    
+    gettimeofday(&start, NULL);
+    freed = storage_gc_budget((max_bytes > 0 && needed > max_bytes) ?
+        max_bytes : needed, usecs);
+    gettimeofday(&end, NULL);
+    
+    pause = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+    gc_ticks++;
+    gc_pause_total += pause;
+    if (pause > gc_pause_max)
+        gc_pause_max = pause;
+    gc_bytes_total += freed;
+    if (freed > gc_bytes_max)
+        gc_bytes_max = freed;
+    
+    return needed - freed;
 }
 
 
 static void gc(int fd, short event, void* arg) {
-	collect_garbage(StorageMinFreeSize);
-	event_add(&gc_timer, &gc_timeval);
+	long left, overshoot;
+	
+	overshoot = storage_get_current_size() - StorageMaxSize;
+	if (overshoot > gc_overshoot_max)
+		gc_overshoot_max = overshoot;
+	
+	left = collect_garbage(StorageMinFreeSize, GC_TICK_BYTES, GC_TICK_USECS);
+	event_add(&gc_timer, (left > 0) ? &gc_busy_timeval : &gc_timeval);
+}
+
+
+/*
+	Versions older than the watermark can go, once a newer version also
+	older than the watermark exists. The watermark is the oldest snapshot
+	read locally, bounded by ST - MaxPreviousST: remote readers with an
+	older snapshot would be aborted by the certifier anyway.
+	The spill file is compacted at the same pace.
+*/
+static void prune(int fd, short event, void* arg) {
+	int watermark, oldest;
+	
+	watermark = cproxy_current_st() - MaxPreviousST;
+	oldest = storage_oldest_snapshot();
+	if (oldest != -1 && oldest < watermark)
+		watermark = oldest;
+	if (watermark > 0)
+		storage_prune(watermark, PRUNE_SLOTS_PER_TICK);
+	storage_spill_compact(SPILL_COMPACT_BYTES_PER_TICK);
+	event_add(&prune_timer, &prune_timeval);
+}
+
+
+static void on_snapshot_timer(int fd, short event, void* arg) {
+	sm_snapshot(StorageSnapshotPath);
+	event_add(&snapshot_timer, &snapshot_timeval);
+}
+
+
+static void on_snapshot_signal(int sig, short event, void* arg) {
+	sm_snapshot(StorageSnapshotPath);
+}
+
+
+static void on_child(int sig, short event, void* arg) {
+	int status;
+	long msecs;
+	struct timeval end;
+	
+	if (snapshot_pid <= 0 || waitpid(snapshot_pid, &status, WNOHANG) != snapshot_pid)
+		return;
+	
+	snapshot_pid = 0;
+	storage_spill_freeze(0);
+	gettimeofday(&end, NULL);
+	msecs = (end.tv_sec - snapshot_start.tv_sec) * 1000 +
+		(end.tv_usec - snapshot_start.tv_usec) / 1000;
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+		snapshot_count++;
+		printf("Snapshot at ST %d written to %s in %ld ms\n",
+			snapshot_st, StorageSnapshotPath, msecs);
+	} else {
+		snapshot_failures++;
+		printf("Snapshot at ST %d failed\n", snapshot_st);
+	}
+}
+
+
+static void print_gc_stats() {
+	printf("GC ticks: %ld\n", gc_ticks);
+	if (gc_ticks > 0) {
+		printf("GC pause: %ld us avg, %ld us max\n",
+			gc_pause_total / gc_ticks, gc_pause_max);
+		printf("GC reclaimed: %ld KB avg, %ld KB max per tick\n",
+			(gc_bytes_total / gc_ticks) / 1024, gc_bytes_max / 1024);
+	}
+	printf("GC max overshoot: %ld KB\n", gc_overshoot_max / 1024);
+}
+
+
+static void print_cache_stats() {
+	int i;
+	long hits, misses;
+	
+	hits = storage_cache_hit_count();
+	misses = storage_cache_miss_count();
+	printf("Eviction policy: %s\n", storage_eviction_policy_name());
+	printf("Cache hits: %ld\n", hits);
+	printf("Cache misses: %ld\n", misses);
+	printf("Cache hit ratio: %.2f%%\n",
+		(hits + misses) > 0 ? (100.0 * hits) / (hits + misses) : 0.0);
+	printf("Evictions: %ld\n", storage_eviction_count());
+	printf("Admission rejects: %ld\n", storage_admission_reject_count());
+	for (i = 1; i < storage_key_class_count(); i++)
+		printf("Key class %d: %ld KB cached\n", i,
+			storage_key_class_cached_bytes(i) / 1024);
 }
 
 
@@ -166,7 +371,8 @@ static void print_stats() {
     key_count = storage_key_count();
     val_count = storage_val_count();
     
-    collect_garbage(StorageMaxSize);
+    print_gc_stats();
+    collect_garbage(StorageMaxSize, 0, 0);
     
     cache_size = total_size - ((storage_get_current_size() / 1024) / 1024);
     cached_key_count = key_count - storage_key_count();
@@ -181,6 +387,27 @@ static void print_stats() {
     printf("Total vals: %ld\n", val_count);
     printf("Cached vals: %ld\n", cached_val_count);
 	printf("GC calls: %ld\n", storage_gc_count());
+	printf("Pruned versions: %ld\n", storage_pruned_count());
+	printf("Deleted keys reclaimed: %ld\n", storage_reclaimed_count());
+	printf("Ordered keys: %ld\n", storage_ordered_count());
+	if (StorageCompressThreshold > 0) {
+		printf("Compressed vals: %ld\n", vset_compressed_count());
+		printf("Compression ratio: %.2f\n", vset_compress_bytes_out() > 0 ?
+			(double)vset_compress_bytes_in() / vset_compress_bytes_out() : 1.0);
+		printf("Compression time: %ld ms, decompression time: %ld ms\n",
+			vset_compress_usecs() / 1000, vset_decompress_usecs() / 1000);
+		printf("Decompression hot hits: %ld\n", vset_hot_hit_count());
+	}
+	printf("Spilled keys: %ld\n", storage_spilled_count());
+	printf("Spill faults: %ld\n", storage_spill_fault_count());
+	printf("Spill file: %ld MB\n", (storage_spill_file_bytes() / 1024) / 1024);
+	printf("Snapshots: %ld (%ld failed), max fork pause %ld us\n",
+		snapshot_count, snapshot_failures, snapshot_fork_max);
+	print_cache_stats();
+	printf("Vset type: %s\n", vset_name());
+	printf("Slab memory: %ld MB (%d slabs)\n",
+		(slab_mapped_bytes() / 1024) / 1024, slab_count());
+	printf("Deferred frees: %ld KB\n", slab_deferred_bytes() / 1024);
 	remote_print_stats();
     printf("------------------------------\n");
 }
@@ -33,10 +33,21 @@ int sm_cleanup();
 // otherwise returns a valid val*
 val* sm_get(key* k, int version);
 
+// Like sm_get, but fills w with a borrowed view of the value,
+// returns 0 if the value is not local
+int sm_get_view(key* k, int version, val_view* w);
+
 int sm_put(key* k, val* v);
 
 void sm_recovery();
 
 void sm_dump_storage(char* path, int version);
 
+// Writes a snapshot to path in the background, returns -1 if one is
+// already being written
+int sm_snapshot(char* path);
+
+// Loads a snapshot written by sm_dump_storage, returns its ST or -1
+int sm_restore_storage(char* path);
+
 #endif /* _SM_H_ */
@@ -0,0 +1,370 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "snapshot.h"
+#include "storage.h"
+#include "crc32c.h"
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+#define MAX_LOAD_THREADS 16
+
+
+typedef struct snapshot_header_t {
+	uint32_t magic;
+	uint32_t format;
+	int32_t st;
+	uint32_t crc;
+} snapshot_header;
+
+
+typedef struct snapshot_block_t {
+	uint32_t records;
+	uint32_t bytes;
+	uint32_t crc;
+	uint32_t unused;
+	char data[0];
+} snapshot_block;
+
+
+typedef struct snapshot_record_t {
+	uint32_t ksize;
+	uint32_t vsize;
+	int32_t version;
+	char data[0];
+} __attribute__ ((packed)) snapshot_record;
+
+
+/*
+	Records are accumulated in block, which is written out as soon as
+	the next record does not fit.
+*/
+typedef struct writer_t {
+	FILE* fp;
+	snapshot_block* block;
+	uint32_t size;
+	long records;
+	int error;
+} writer;
+
+
+typedef struct loader_t {
+	char* base;
+	snapshot_block** blocks;
+	int block_count;
+	int threads;
+	int corrupted;
+} loader;
+
+
+typedef struct load_thread_t {
+	loader* l;
+	int id;
+	int corrupted;
+} load_thread;
+
+
+static void write_record(key* k, val* v, void* arg);
+static void write_block(writer* w);
+static void* check_blocks(void* arg);
+static int find_blocks(loader* l, long size, long* records);
+static int load_block(snapshot_block* b, int check);
+static uint32_t block_crc(snapshot_block* b);
+
+
+long snapshot_write(const char* path, int st) {
+	writer w;
+	char tmp[1024];
+	snapshot_header h;
+	int64_t total;
+	
+	snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+	if ((w.fp = fopen(tmp, "w")) == NULL) {
+		perror("fopen");
+		return -1;
+	}
+	w.size = SNAPSHOT_BLOCK_SIZE;
+	w.block = malloc(sizeof(snapshot_block) + w.size);
+	w.block->records = 0;
+	w.block->bytes = 0;
+	w.records = 0;
+	w.error = 0;
+	
+	h.magic = SNAPSHOT_MAGIC;
+	h.format = SNAPSHOT_FORMAT;
+	h.st = st;
+	h.crc = crc32c(0, &h, offsetof(snapshot_header, crc));
+	if (fwrite(&h, sizeof(h), 1, w.fp) != 1)
+		w.error = 1;
+	
+	storage_iterate(st, write_record, &w);
+	write_block(&w);
+	
+	// The trailer, a block with no records
+	total = w.records;
+	memcpy(w.block->data, &total, sizeof(total));
+	w.block->bytes = sizeof(total);
+	write_block(&w);
+	
+	free(w.block);
+	if (fflush(w.fp) != 0 || fsync(fileno(w.fp)) != 0)
+		w.error = 1;
+	if (fclose(w.fp) != 0)
+		w.error = 1;
+	if (w.error || rename(tmp, path) != 0) {
+		printf("Failed to write snapshot %s\n", path);
+		unlink(tmp);
+		return -1;
+	}
+	return w.records;
+}
+
+
+int snapshot_load(const char* path, int threads) {
+	int i, fd, st = -1;
+	long records;
+	struct stat sb;
+	loader l;
+	snapshot_header* h;
+	pthread_t tids[MAX_LOAD_THREADS];
+	load_thread args[MAX_LOAD_THREADS];
+	
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		perror("open");
+		return -1;
+	}
+	if (fstat(fd, &sb) == -1 || sb.st_size < sizeof(snapshot_header)) {
+		close(fd);
+		return -1;
+	}
+	l.base = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (l.base == MAP_FAILED) {
+		perror("mmap");
+		return -1;
+	}
+	madvise(l.base, sb.st_size, MADV_WILLNEED);
+	l.blocks = NULL;
+	
+	h = (snapshot_header*)l.base;
+	if (h->magic != SNAPSHOT_MAGIC || h->format != SNAPSHOT_FORMAT ||
+		h->crc != crc32c(0, h, offsetof(snapshot_header, crc))) {
+		printf("Snapshot %s: bad header\n", path);
+		goto out;
+	}
+	if (find_blocks(&l, sb.st_size, &records) < 0) {
+		printf("Snapshot %s: truncated or inconsistent\n", path);
+		goto out;
+	}
+	
+	if (threads <= 0)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads > MAX_LOAD_THREADS)
+		threads = MAX_LOAD_THREADS;
+	if (threads < 1)
+		threads = 1;
+	l.threads = threads;
+	l.corrupted = 0;
+	for (i = 0; i < threads; i++) {
+		args[i].l = &l;
+		args[i].id = i;
+		pthread_create(&tids[i], NULL, check_blocks, &args[i]);
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_join(tids[i], NULL);
+		l.corrupted += args[i].corrupted;
+	}
+	if (l.corrupted > 0) {
+		printf("Snapshot %s: %d corrupted blocks\n", path, l.corrupted);
+		goto out;
+	}
+	
+	storage_reserve(storage_key_count() + records);
+	for (i = 0; i < l.block_count; i++)
+		load_block(l.blocks[i], 0);
+	st = h->st;
+	printf("Loaded snapshot %s: %ld keys at ST %d\n", path, records, st);
+
+out:
+	free(l.blocks);
+	munmap(l.base, sb.st_size);
+	return st;
+}
+
+
+static void write_record(key* k, val* v, void* arg) {
+	writer* w = (writer*)arg;
+	snapshot_record r;
+	uint32_t size;
+	
+	if (v == NULL)
+		return;
+	
+	size = sizeof(r) + k->size + v->size;
+	if (w->block->bytes + size > w->size) {
+		write_block(w);
+		if (size > w->size) {
+			w->size = size;
+			w->block = realloc(w->block, sizeof(snapshot_block) + w->size);
+		}
+	}
+	
+	r.ksize = k->size;
+	r.vsize = v->size;
+	r.version = v->version;
+	memcpy(&w->block->data[w->block->bytes], &r, sizeof(r));
+	memcpy(&w->block->data[w->block->bytes + sizeof(r)], k->data, k->size);
+	memcpy(&w->block->data[w->block->bytes + sizeof(r) + k->size],
+		v->data, v->size);
+	w->block->bytes += size;
+	w->block->records++;
+	w->records++;
+}
+
+
+static void write_block(writer* w) {
+	snapshot_block* b = w->block;
+	
+	if (b->bytes == 0)
+		return;
+	b->unused = 0;
+	b->crc = block_crc(b);
+	if (fwrite(b, sizeof(snapshot_block) + b->bytes, 1, w->fp) != 1)
+		w->error = 1;
+	b->records = 0;
+	b->bytes = 0;
+}
+
+
+/*
+	The CRC of a block covers its header, but the CRC itself, and its data.
+*/
+static uint32_t block_crc(snapshot_block* b) {
+	uint32_t crc;
+	crc = crc32c(0, b, offsetof(snapshot_block, crc));
+	return crc32c(crc, b->data, b->bytes);
+}
+
+
+/*
+	Walks the block headers up to the trailer. Returns -1 if the file
+	ends before the trailer, or if the trailer does not count the records
+	of the blocks.
+*/
+static int find_blocks(loader* l, long size, long* records) {
+	int n = 0;
+	long offset, sum = 0;
+	int64_t total;
+	snapshot_block* b;
+	snapshot_block** blocks;
+	
+	l->block_count = 0;
+	offset = sizeof(snapshot_header);
+	while (offset + (long)sizeof(snapshot_block) <= size) {
+		b = (snapshot_block*)(l->base + offset);
+		if (offset + (long)sizeof(snapshot_block) + b->bytes > size)
+			return -1;
+		
+		if (b->records == 0) {
+			if (b->bytes != sizeof(total) || b->crc != block_crc(b))
+				return -1;
+			memcpy(&total, b->data, sizeof(total));
+			if (total != sum)
+				return -1;
+			*records = total;
+			return 0;
+		}
+		
+		if (l->block_count == n) {
+			n = (n == 0) ? 64 : 2 * n;
+			blocks = realloc(l->blocks, n * sizeof(snapshot_block*));
+			if (blocks == NULL)
+				return -1;
+			l->blocks = blocks;
+		}
+		l->blocks[l->block_count++] = b;
+		sum += b->records;
+		offset += sizeof(snapshot_block) + b->bytes;
+	}
+	return -1;
+}
+
+
+/*
+	Each thread checks every threads-th block. Besides the checksums,
+	this brings the file in memory in parallel.
+*/
+static void* check_blocks(void* arg) {
+	int i;
+	load_thread* t = (load_thread*)arg;
+	loader* l = t->l;
+	snapshot_block* b;
+	
+	t->corrupted = 0;
+	for (i = t->id; i < l->block_count; i += l->threads) {
+		b = l->blocks[i];
+		if (b->crc != block_crc(b) || load_block(b, 1) < 0)
+			t->corrupted++;
+	}
+	return NULL;
+}
+
+
+/*
+	Loads the records of block b, or with check only walks them. Returns
+	-1 if a record runs past the block, or if the records do not end
+	exactly with it. Snapshots only hold local keys.
+*/
+static int load_block(snapshot_block* b, int check) {
+	uint32_t i;
+	uint64_t offset, size;
+	snapshot_record r;
+	key k;
+	val v;
+	
+	offset = 0;
+	for (i = 0; i < b->records; i++) {
+		if (offset + sizeof(r) > b->bytes)
+			return -1;
+		memcpy(&r, b->data + offset, sizeof(r));
+		size = (uint64_t)sizeof(r) + r.ksize + r.vsize;
+		if (offset + size > b->bytes)
+			return -1;
+		if (!check) {
+			k.size = r.ksize;
+			k.data = b->data + offset + sizeof(r);
+			v.size = r.vsize;
+			v.version = r.version;
+			v.data = b->data + offset + sizeof(r) + r.ksize;
+			storage_put(&k, &v, 1, 0);
+		}
+		offset += size;
+	}
+	return (offset == b->bytes) ? 0 : -1;
+}
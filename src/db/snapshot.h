@@ -0,0 +1,67 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	Binary snapshots of the local keys of the storage.
+
+	A snapshot starts with a header stamped with the ST it was taken at,
+	followed by blocks of about SNAPSHOT_BLOCK_SIZE bytes of records,
+	each block with its own CRC32C of its header and records. A block
+	with no records, holding the total number of records, ends the
+	snapshot, so that a truncated file is detected.
+
+	Records are (key size, value size, version, key, value), with all
+	integers in host byte order: snapshots are meant to be loaded on
+	the same kind of machine that wrote them.
+*/
+
+#define SNAPSHOT_MAGIC 0x70616e73
+#define SNAPSHOT_FORMAT 2
+#define SNAPSHOT_BLOCK_SIZE (1024*1024)
+
+
+/**
+	Writes the values visible at st of the local keys to path. The file
+	is written next to path, under a name unique to the process, and
+	renamed once complete. Returns the
+	number of records written, -1 on error.
+*/
+long snapshot_write(const char* path, int st);
+
+
+/**
+	Loads the snapshot at path in the storage. Blocks are checked by
+	threads threads (0 for one per CPU) before being loaded; nothing is
+	loaded if any of them is corrupted. Returns the ST of the snapshot,
+	-1 on error.
+*/
+int snapshot_load(const char* path, int threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SNAPSHOT_H_ */
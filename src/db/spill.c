@@ -0,0 +1,278 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "spill.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+
+#define SPILL_ALIGN 8
+#define RECORD_SIZE(n) \
+	((sizeof(spill_record) + (n) + SPILL_ALIGN - 1) & ~((long)SPILL_ALIGN - 1))
+
+
+typedef struct spill_record_t {
+	int size;
+	int live;
+	void* owner;
+	char data[0];
+} spill_record;
+
+
+/*
+	Records are appended at head. A segment with no live records left is
+	reset, and its pages dropped from memory.
+*/
+typedef struct spill_segment_t {
+	long head;
+	long live;
+	long dead;
+} spill_segment;
+
+
+struct spill_t {
+	int fd;
+	char* base;
+	long segment_size;
+	int active;
+	int compacting;
+	long compact_pos;
+	int frozen;
+	long live_bytes;
+	long dead_bytes;
+	spill_segment segments[SPILL_SEGMENTS];
+};
+
+
+static spill_record* record_at(spill* s, long offset);
+static int empty_segment(spill* s);
+static void reset_segment(spill* s, int i);
+static int compaction_segment(spill* s);
+
+
+spill* spill_new(const char* path, long size) {
+	spill* s;
+	
+	s = calloc(1, sizeof(spill));
+	if (s == NULL)
+		return NULL;
+	
+	s->segment_size = (size / SPILL_SEGMENTS) & ~((long)getpagesize() - 1);
+	s->compacting = -1;
+	if (s->segment_size == 0)
+		goto error;
+	
+	s->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (s->fd == -1) {
+		perror("open");
+		goto error;
+	}
+	unlink(path);
+	if (ftruncate(s->fd, s->segment_size * SPILL_SEGMENTS) == -1) {
+		perror("ftruncate");
+		close(s->fd);
+		goto error;
+	}
+	
+	s->base = mmap(NULL, s->segment_size * SPILL_SEGMENTS,
+		PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+	if (s->base == MAP_FAILED) {
+		perror("mmap");
+		close(s->fd);
+		goto error;
+	}
+	return s;
+
+error:
+	free(s);
+	return NULL;
+}
+
+
+void spill_free(spill* s) {
+	munmap(s->base, s->segment_size * SPILL_SEGMENTS);
+	close(s->fd);
+	free(s);
+}
+
+
+long spill_append(spill* s, void* owner, const void* data, int size) {
+	int i;
+	long offset, rsize;
+	spill_record* r;
+	spill_segment* seg;
+	
+	rsize = RECORD_SIZE(size);
+	if (rsize > s->segment_size)
+		return -1;
+	
+	seg = &s->segments[s->active];
+	if (seg->head + rsize > s->segment_size) {
+		if ((i = empty_segment(s)) < 0)
+			return -1;
+		s->active = i;
+		seg = &s->segments[i];
+	}
+	
+	offset = (s->active * s->segment_size) + seg->head;
+	r = record_at(s, offset);
+	r->size = size;
+	r->live = 1;
+	r->owner = owner;
+	memcpy(r->data, data, size);
+	
+	seg->head += rsize;
+	seg->live += rsize;
+	s->live_bytes += rsize;
+	return offset;
+}
+
+
+void* spill_data(spill* s, long offset, int* size) {
+	spill_record* r = record_at(s, offset);
+	*size = r->size;
+	return r->data;
+}
+
+
+void spill_release(spill* s, long offset) {
+	int i;
+	long rsize;
+	spill_record* r;
+	spill_segment* seg;
+	
+	r = record_at(s, offset);
+	if (!r->live)
+		return;
+	
+	r->live = 0;
+	rsize = RECORD_SIZE(r->size);
+	i = offset / s->segment_size;
+	seg = &s->segments[i];
+	seg->live -= rsize;
+	seg->dead += rsize;
+	s->live_bytes -= rsize;
+	s->dead_bytes += rsize;
+	if (seg->live == 0 && !s->frozen)
+		reset_segment(s, i);
+}
+
+
+long spill_compact(spill* s, long bytes, spill_move_cb cb) {
+	long offset, moved = 0, rsize, start;
+	spill_record* r;
+	
+	if (s->frozen)
+		return 0;
+	if (s->compacting < 0) {
+		if ((s->compacting = compaction_segment(s)) < 0)
+			return 0;
+		s->compact_pos = 0;
+	}
+	
+	start = s->compacting * s->segment_size;
+	while (moved < bytes && s->compacting >= 0 &&
+		s->compact_pos < s->segments[s->compacting].head) {
+		r = record_at(s, start + s->compact_pos);
+		rsize = RECORD_SIZE(r->size);
+		if (r->live) {
+			offset = spill_append(s, r->owner, r->data, r->size);
+			if (offset < 0)
+				break;
+			cb(r->owner, offset);
+			moved += rsize;
+			// Releasing the last live record resets the segment
+			s->compact_pos += rsize;
+			spill_release(s, start + s->compact_pos - rsize);
+		} else {
+			s->compact_pos += rsize;
+		}
+	}
+	return moved;
+}
+
+
+void spill_freeze(spill* s, int frozen) {
+	int i;
+	
+	s->frozen = frozen;
+	if (frozen)
+		return;
+	for (i = 0; i < SPILL_SEGMENTS; i++)
+		if (s->segments[i].head > 0 && s->segments[i].live == 0)
+			reset_segment(s, i);
+}
+
+
+long spill_live_bytes(spill* s) {
+	return s->live_bytes;
+}
+
+
+long spill_dead_bytes(spill* s) {
+	return s->dead_bytes;
+}
+
+
+static spill_record* record_at(spill* s, long offset) {
+	return (spill_record*)(s->base + offset);
+}
+
+
+static int empty_segment(spill* s) {
+	int i;
+	for (i = 0; i < SPILL_SEGMENTS; i++)
+		if (s->segments[i].head == 0 && i != s->active)
+			return i;
+	return -1;
+}
+
+
+static void reset_segment(spill* s, int i) {
+	spill_segment* seg = &s->segments[i];
+	s->dead_bytes -= seg->dead;
+	seg->head = 0;
+	seg->dead = 0;
+	madvise(s->base + (i * s->segment_size), s->segment_size, MADV_DONTNEED);
+	if (i == s->compacting)
+		s->compacting = -1;
+}
+
+
+/*
+	Compacts the segment with the most dead bytes, if at least half of
+	it is dead.
+*/
+static int compaction_segment(spill* s) {
+	int i, best = -1;
+	for (i = 0; i < SPILL_SEGMENTS; i++) {
+		if (i == s->active || s->segments[i].dead < s->segments[i].live)
+			continue;
+		if (s->segments[i].dead == 0)
+			continue;
+		if (best < 0 || s->segments[i].dead > s->segments[best].dead)
+			best = i;
+	}
+	return best;
+}
@@ -0,0 +1,103 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SPILL_H_
+#define _SPILL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	Append-only file of records, mapped in memory, where the storage
+	spills the versions of cold local keys when it runs out of memory.
+
+	The file is split in SPILL_SEGMENTS segments, and records are appended
+	to the active segment. Released records are only marked as dead:
+	spill_compact() moves the live records out of the segment with the
+	most dead bytes, so that the segment can be reused. The owner of each
+	record is told its new offset through a callback.
+
+	The file is unlinked as soon as it is mapped, as its contents are
+	meaningful only to the process that wrote them.
+*/
+
+#define SPILL_SEGMENTS 16
+
+typedef struct spill_t spill;
+
+typedef void (*spill_move_cb)(void* owner, long offset);
+
+
+/**
+	Creates a spill file of size bytes at path. Returns NULL on error.
+*/
+spill* spill_new(const char* path, long size);
+
+
+void spill_free(spill* s);
+
+
+/**
+	Appends a record of size bytes owned by owner. Returns its offset,
+	or -1 if there is no room left in the file.
+*/
+long spill_append(spill* s, void* owner, const void* data, int size);
+
+
+/**
+	Returns the data of the record at offset, and its size in size.
+*/
+void* spill_data(spill* s, long offset, int* size);
+
+
+/**
+	Marks the record at offset as dead.
+*/
+void spill_release(spill* s, long offset);
+
+
+/**
+	Moves at most bytes live bytes out of the segment being compacted,
+	picking a new one if needed, and calls cb for each record moved.
+	Returns the bytes moved.
+*/
+long spill_compact(spill* s, long bytes, spill_move_cb cb);
+
+
+/**
+	While frozen, no record is overwritten: segments with no live records
+	left are not reused, and compaction does nothing. Used while another
+	process (e.g. a forked snapshot writer) reads the file.
+*/
+void spill_freeze(spill* s, int frozen);
+
+
+/**
+	Returns the bytes of live and dead records in the file.
+*/
+long spill_live_bytes(spill* s);
+
+long spill_dead_bytes(spill* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SPILL_H_ */
@@ -21,64 +21,278 @@
 #include "vset.h"
 #include "hash.h"
 #include "peer.h"
+#include "slab.h"
+#include "freq_sketch.h"
+#include "spill.h"
+#include "skiplist.h"
+#include "config.h"
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <limits.h>
 #include <memory.h>
 #include <assert.h>
 #include <sys/queue.h>
+#include <sys/time.h>
 
 
-#define STORAGE_TABLE_SIZE 12582917
-
-
-TAILQ_HEAD(lru_head, key_entry_t);
-LIST_HEAD(key_entry_head, key_entry_t);
+/*
+	Initial number of slots of the key index. The index is an open
+	addressing table (Robin Hood hashing with backward shift deletion)
+	that doubles its size whenever it becomes more than 7/8 full.
+*/
+#define INDEX_INIT_SIZE 4096
+#define INDEX_MAX_LOAD(s) ((s) - ((s) >> 3))
 
 
-#define ENTRY_IN_LRU(e)  (!(e.tqe_next == NULL && e.tqe_prev == NULL))
+/*
+	Flags of a key entry. Cached entries are those of keys not local to
+	this node, and are the only ones that can be evicted. The referenced
+	bit is the second chance of the CLOCK eviction policy.
+	Entries with pins (e.g. those waiting for a remote get) are never
+	evicted. Spilled entries are local entries whose versions were moved
+	to the spill file: in place of their vset they hold the offset of
+	their record, and the referenced bit is their second chance.
+	Ordered entries are also linked in the ordered index.
+*/
+#define KENTRY_CACHED     0x01
+#define KENTRY_REFERENCED 0x02
+#define KENTRY_SPILLED    0x04
+#define KENTRY_ORDERED    0x08
 
 
+/*
+	The vset of a key is embedded in its entry, at vset_offset, and is
+	followed by the key itself, at key_offset. Both depend on the vset
+	implementation in use.
+*/
 typedef struct __attribute__ ((packed)) key_entry_t {
     uint16_t size;
-	vset values;
-    LIST_ENTRY(key_entry_t) collisions;
-    TAILQ_ENTRY(key_entry_t) lru;
-    char key[0];
+	uint8_t flags;
+	uint8_t cls;
+	uint16_t pins;
+    char data[0];
 } key_entry;
 
+#define KENTRY_VSET(e) ((vset)((char*)(e) + vset_offset))
+#define KENTRY_KEY(e)  ((char*)(e) + key_offset)
+
+
+/*
+	Offset of the record of a spilled entry, possibly unaligned.
+*/
+typedef struct __attribute__ ((packed)) spill_ref_t {
+	long offset;
+} spill_ref;
+
+#define KENTRY_SPILL_OFFSET(e) (((spill_ref*)KENTRY_VSET(e))->offset)
+
+
+/*
+	With the LRU policy, the list links are allocated right before the
+	key entry, so that entries pay for them only when LRU is in use.
+*/
+typedef struct lru_link_t {
+	TAILQ_ENTRY(lru_link_t) lru;
+} lru_link;
+
+
+TAILQ_HEAD(lru_head, lru_link_t);
+
+
+#define LRU_LINK(e)   (((lru_link*)(e)) - 1)
+#define LRU_ENTRY(l)  ((key_entry*)((l) + 1))
+
+
+/*
+	Keys are grouped in classes by prefix, as configured with
+	StorageKeyClass. Class 0 holds the keys matching no prefix. Each
+	class accounts the bytes of its cached entries, and with LRU keeps
+	its own list.
+*/
+typedef struct key_class_t {
+	storage_key_class conf;
+	long cached_bytes;
+	long cached_entries;
+	long pinned;
+	struct lru_head lru;
+} key_class;
+
 
-static struct lru_head lru_list;
+/*
+	A pin of an entry by its owner, e.g. a remote get request. Pins are
+	kept in buckets by owner, so that an owner can only release its own.
+*/
+typedef struct pin_t {
+	int owner;
+	key_entry* entry;
+	struct pin_t* next;
+} pin;
+
+#define PIN_BUCKETS 256
+
+
+/*
+	Snapshots (STs) in use by local readers, i.e. open transactions and
+	pending remote gets, sorted by ST, with the number of readers of each.
+*/
+typedef struct snapshot_ref_t {
+	int st;
+	int count;
+} snapshot_ref;
+
+
+/*
+	Number of index slots after the clock hand, or of entries from the
+	LRU tail, looked at when peeking the next victim for admission.
+*/
+#define PEEK_WINDOW 64
+
+
+/*
+	A slot is empty iff its hash is 0. The full hash of each key is kept
+	next to the entry pointer, so that probing stays within the slots
+	array and an entry is dereferenced only when the hashes match.
+*/
+typedef struct index_slot_t {
+	unsigned int hash;
+	key_entry* entry;
+} index_slot;
+
+
+typedef struct key_index_t {
+	unsigned int size;
+	unsigned int count;
+	index_slot* slots;
+} key_index;
+
+
+static key_class classes[MAX_KEY_CLASSES + 1];
+static int class_count;
 static long storage_key_entries;
 static long storage_val_entries;
-static long storage_current_size;
 static long storage_gc_calls;
-static struct key_entry_head storage_table[STORAGE_TABLE_SIZE];
+static key_index storage_index;
 static int gc_enabled = 1;
 
+static int eviction_policy;
+static int kentry_prefix;
+static int vset_offset;
+static int key_offset;
+static unsigned int clock_hand;
+static pin* pins[PIN_BUCKETS];
+static long storage_cached_entries;
+static long storage_cache_hits;
+static long storage_cache_misses;
+static long storage_evictions;
+static long storage_admission_rejects;
+static freq_sketch* admission_sketch;
+static snapshot_ref* snapshots;
+static int snapshot_count;
+static int snapshot_size;
+static unsigned int prune_cursor;
+static long storage_pruned_versions;
+static long storage_reclaimed_entries;
+static spill* spill_file;
+static unsigned int spill_hand;
+static long storage_spilled_entries;
+static long storage_spill_faults;
+static skiplist* ordered_keys;
+
 static consistent_hash node_id_for_hash;
 
-static key_entry* key_entry_new(key* k);
+static key_entry* key_entry_new(key* k, int cls);
+static int key_entry_bytes(key_entry* kentry);
 static int key_entry_free(key_entry* kentry);
 static int key_entry_local(key_entry* kentry);
-static key_entry* find_key_entry(key* k);
+static int key_entry_deleted(key_entry* kentry, int version);
+static key_entry* find_key_entry(key* k, unsigned int h);
+static key_entry* lookup_for_get(key* k);
+static void count_get(key_entry* kentry, int found);
 static int key_cmp(key* k, key_entry* ke);
 static unsigned int hash(char* k, int size);
+static void index_init(key_index* idx, unsigned int size);
+static void index_free(key_index* idx);
+static void index_grow(key_index* idx);
+static void index_insert(key_index* idx, unsigned int h, key_entry* kentry);
+static void index_remove(key_index* idx, key_entry* kentry);
+static void cache_insert(key_entry* kentry);
+static void cache_remove(key_entry* kentry);
+static void cache_touch(key_entry* kentry);
+static key_entry* cache_victim();
+static key_entry* class_victim(key_class* c, int same_class);
+static void trim_class(key_class* c, key_entry* keep);
+static key_entry* cache_peek_victim();
+static int key_class_of(key* k);
+static int key_class_admits(int cls, int bytes);
+static key_class* victim_class();
+static int snapshot_find(int st);
+static key_entry* spill_victim();
+static int spill_out(key_entry* kentry);
+static void spill_in(key_entry* kentry);
+static int spilled_count(key_entry* kentry);
+static val* spilled_get(key_entry* kentry, int version);
+static void spill_moved(void* owner, long offset);
+static int ordered_cmp(void* item, const char* k, int size);
+static void free_pins();
 
 
 int storage_init() {
-    int i;
+	int i;
 	
     storage_key_entries = 0;
 	storage_val_entries = 0;
-    storage_current_size = 0;
 	storage_gc_calls = 0;
+	storage_cached_entries = 0;
+	storage_cache_hits = 0;
+	storage_cache_misses = 0;
+	storage_evictions = 0;
+	storage_admission_rejects = 0;
+	storage_pruned_versions = 0;
+	storage_reclaimed_entries = 0;
+	storage_spilled_entries = 0;
+	storage_spill_faults = 0;
+	
+	prune_cursor = 0;
+	spill_hand = 0;
+	
+	spill_file = NULL;
+	if (StorageSpillPath != NULL) {
+		spill_file = spill_new(StorageSpillPath, StorageSpillSize);
+		if (spill_file == NULL)
+			printf("Failed to create spill file %s\n", StorageSpillPath);
+	}
+	
+	ordered_keys = NULL;
+	if (StorageOrderedPrefixLen >= 0)
+		ordered_keys = skiplist_new(ordered_cmp);
+	
+	admission_sketch = NULL;
+	if (StorageAdmissionWidth > 0)
+		admission_sketch = freq_sketch_new(StorageAdmissionWidth);
 	
 	node_id_for_hash = peer_get_default_hash();
 	
-    TAILQ_INIT(&lru_list);
-    for (i = 0; i < STORAGE_TABLE_SIZE; i++)
-        LIST_INIT(&storage_table[i]);
+	eviction_policy = StorageEvictionPolicy;
+	kentry_prefix = (eviction_policy == EVICTION_LRU) ? sizeof(lru_link) : 0;
+	vset_offset = sizeof(key_entry);
+	if (vset_offset % vset_alignof() != 0)
+		vset_offset += vset_alignof() - (vset_offset % vset_alignof());
+	// Spilled entries keep the offset of their record in the vset
+	key_offset = vset_offset + vset_sizeof();
+	if (vset_sizeof() < sizeof(spill_ref))
+		key_offset = vset_offset + sizeof(spill_ref);
+	clock_hand = 0;
+	
+	memset(classes, 0, sizeof(classes));
+	classes[0].conf.cache = 1;
+	class_count = StorageKeyClassCount + 1;
+	for (i = 0; i < class_count; i++) {
+		if (i > 0)
+			classes[i].conf = StorageKeyClasses[i - 1];
+		TAILQ_INIT(&classes[i].lru);
+	}
+	index_init(&storage_index, INDEX_INIT_SIZE);
 
     return 1;
 }
@@ -92,52 +306,83 @@ int storage_init2(consistent_hash chash) {
 
 
 void storage_free() {
-    int i;
-    key_entry* k;
+    unsigned int i;
     
-    for (i = 0; i < STORAGE_TABLE_SIZE; i++) {
-        while ((k = LIST_FIRST(&storage_table[i])) != NULL) {
-            LIST_REMOVE(k, collisions);
-            key_entry_free(k);
-        }
+	if (ordered_keys != NULL) {
+		skiplist_free(ordered_keys);
+		ordered_keys = NULL;
+	}
+    for (i = 0; i < storage_index.size; i++) {
+        if (storage_index.slots[i].hash != 0)
+            key_entry_free(storage_index.slots[i].entry);
     }
+	index_free(&storage_index);
+	slab_reclaim(0);
+	if (admission_sketch != NULL) {
+		freq_sketch_free(admission_sketch);
+		admission_sketch = NULL;
+	}
+	free(snapshots);
+	snapshots = NULL;
+	snapshot_count = snapshot_size = 0;
+	if (spill_file != NULL) {
+		spill_free(spill_file);
+		spill_file = NULL;
+	}
+	free_pins();
+}
+
+
+void storage_reserve(long keys) {
+	while (INDEX_MAX_LOAD(storage_index.size) < keys)
+		index_grow(&storage_index);
 }
 
 
 val* storage_get(key* k, int max_ver) {
 	val* v;
 	key_entry* kentry;
-    if ((kentry = find_key_entry(k)) == NULL) {
-		// printf("get %d %d %d %d\n", *(int*)k->data, -1, -1, max_ver);
-        return NULL;
-	}
-	if ((v = vset_get(kentry->values, max_ver)) == NULL) {
-		// printf("get %d %d %d %d\n", *(int*)k->data, -1, -1, max_ver);
-		return NULL;	
-	}
-	// Move to lru head
-	if (ENTRY_IN_LRU(kentry->lru)) {
-		TAILQ_REMOVE(&lru_list, kentry, lru);
-		TAILQ_INSERT_HEAD(&lru_list, kentry, lru);
-	}
+	
+	if ((kentry = lookup_for_get(k)) == NULL)
+		return NULL;
+	v = vset_get(KENTRY_VSET(kentry), max_ver);
+	count_get(kentry, v != NULL);
+	if (v == NULL)
+		return NULL;
+	
 	// added this
 	if (v->size == 0) {
 		val_free(v);
 		v = NULL;
 	}
-	
-	// if (v != NULL)
-		// printf("get %d %d %d %d\n", *(int*)k->data, *(int*)v->data, v->version, max_ver);
-	// else
-		// printf("get %d %d %d %d\n", *(int*)k->data, -1, -1, max_ver);
-	
 	return v;
 }
 
 
+int storage_get_view(key* k, int max_ver, val_view* w) {
+	int found;
+	key_entry* kentry;
+	
+	if ((kentry = lookup_for_get(k)) == NULL)
+		return 0;
+	found = vset_view(KENTRY_VSET(kentry), max_ver, w);
+	count_get(kentry, found);
+	if (found && w->size == 0) {
+		vset_view_release(w);
+		found = 0;
+	}
+	return found;
+}
+
+
+void storage_view_release(val_view* w) {
+	vset_view_release(w);
+}
+
+
 int storage_put(key* k, val* v, int local, int force_cache) {
 	unsigned int h;
-    unsigned int i = -1;
+	int cls, cached;
     int kentry_is_new = 0;
     key_entry* kentry = NULL;
 
@@ -149,7 +394,11 @@ int storage_put(key* k, val* v, int local, int force_cache) {
 	// }
 
     //Find the Key entry, if not present create a new one
-    if ((kentry = find_key_entry(k)) == NULL) {
+	h = hash((char*)k->data, k->size);
+    if ((kentry = find_key_entry(k, h)) != NULL) {
+		if (kentry->flags & KENTRY_SPILLED)
+			spill_in(kentry);
+	} else {
 		// If not local, drop it.
 		if (!force_cache) {
 			if (!local) {
@@ -157,42 +406,139 @@ int storage_put(key* k, val* v, int local, int force_cache) {
 			}
 		}
 		
-        kentry = key_entry_new(k);
-		h = hash((char*)k->data, k->size);
-        i = h % STORAGE_TABLE_SIZE;
-        LIST_INSERT_HEAD(&storage_table[i], kentry, collisions);
+		cls = key_class_of(k);
+		if (!local && !key_class_admits(cls,
+				kentry_prefix + vset_offset + k->size + v->size))
+			return 1;
+		
+        kentry = key_entry_new(k, cls);
+		index_insert(&storage_index, h, kentry);
         kentry_is_new = 1;
     }
     
 
-    // If key became local
-    if (local && ENTRY_IN_LRU(kentry->lru)) {
-        // kentry was already there, remove it from LRU
-        // if (!kentry_is_new) {
-			TAILQ_REMOVE(&lru_list, kentry, lru);
-			memset(&kentry->lru, 0, sizeof(kentry->lru));
-			assert(!ENTRY_IN_LRU(kentry->lru));
-        // }
-    }
+    // If key became local, it can no longer be evicted
+    if (local && (kentry->flags & KENTRY_CACHED))
+		cache_remove(kentry);
 
-	storage_val_entries -= vset_count(kentry->values);
-	storage_current_size -= vset_allocated_bytes(kentry->values);
+	cached = kentry->flags & KENTRY_CACHED;
+	if (cached)
+		classes[kentry->cls].cached_bytes -= key_entry_bytes(kentry);
+	storage_val_entries -= vset_count(KENTRY_VSET(kentry));
 	// Add to the set of values
-	vset_add(kentry->values, v);
-	storage_val_entries += vset_count(kentry->values);
-	storage_current_size += vset_allocated_bytes(kentry->values);
+	vset_add(KENTRY_VSET(kentry), v);
+	storage_val_entries += vset_count(KENTRY_VSET(kentry));
+	if (cached)
+		classes[kentry->cls].cached_bytes += key_entry_bytes(kentry);
 	
-	// Insert in LRU if item is cached and if it is not already there
-	if (!local && !ENTRY_IN_LRU(kentry->lru)) {
-        TAILQ_INSERT_HEAD(&lru_list, kentry, lru);
-	}
+	// Make the entry evictable if it is cached and not already so
+	if (!local && !(kentry->flags & KENTRY_CACHED))
+		cache_insert(kentry);
+	
+	// The new entry or version may take its class over budget
+	if (kentry->flags & KENTRY_CACHED)
+		trim_class(&classes[kentry->cls], kentry);
 	
     return 1;
 }
 
 
+/*
+	TinyLFU admission: a key not in storage is admitted if its class can
+	be cached, and if there is still room for it, or if it was accessed
+	more often than the entry it would displace. Keys of a class with
+	higher priority than the victim's are always admitted.
+*/
+int storage_admit(key* k) {
+	int cls;
+	unsigned int h;
+	key_entry* victim;
+	
+	h = hash((char*)k->data, k->size);
+	if (find_key_entry(k, h) != NULL)
+		return 1;
+	cls = key_class_of(k);
+	if (!key_class_admits(cls, kentry_prefix + vset_offset + k->size)) {
+		storage_admission_rejects++;
+		return 0;
+	}
+	
+	if (admission_sketch == NULL)
+		return 1;
+	if (storage_get_current_size() + StorageMinFreeSize < StorageMaxSize)
+		return 1;
+	if ((victim = cache_peek_victim()) == NULL)
+		return 1;
+	if (classes[cls].conf.priority > classes[victim->cls].conf.priority)
+		return 1;
+	
+	if (freq_sketch_estimate(admission_sketch, h) >
+		freq_sketch_estimate(admission_sketch, hash(KENTRY_KEY(victim), victim->size)))
+		return 1;
+	
+	storage_admission_rejects++;
+	return 0;
+}
+
+
+int storage_pin(key* k, int owner) {
+	pin* p;
+	key_entry* kentry;
+	
+	if ((kentry = find_key_entry(k, hash((char*)k->data, k->size))) == NULL)
+		return 0;
+	assert(kentry->pins < UINT16_MAX);
+	p = malloc(sizeof(pin));
+	p->owner = owner;
+	p->entry = kentry;
+	p->next = pins[owner & (PIN_BUCKETS - 1)];
+	pins[owner & (PIN_BUCKETS - 1)] = p;
+	if (kentry->pins++ == 0 && (kentry->flags & KENTRY_CACHED))
+		classes[kentry->cls].pinned++;
+	return 1;
+}
+
+
+void storage_unpin(key* k, int owner) {
+	pin** p;
+	pin* found;
+	key_entry* kentry;
+	
+	if ((kentry = find_key_entry(k, hash((char*)k->data, k->size))) == NULL)
+		return;
+	for (p = &pins[owner & (PIN_BUCKETS - 1)]; *p != NULL; p = &(*p)->next)
+		if ((*p)->owner == owner && (*p)->entry == kentry)
+			break;
+	// Not pinned by owner, e.g. a duplicate release
+	if (*p == NULL)
+		return;
+	found = *p;
+	*p = found->next;
+	free(found);
+	if (--kentry->pins == 0 && (kentry->flags & KENTRY_CACHED))
+		classes[kentry->cls].pinned--;
+}
+
+
+static void free_pins() {
+	int i;
+	pin* p;
+	
+	for (i = 0; i < PIN_BUCKETS; i++) {
+		while ((p = pins[i]) != NULL) {
+			pins[i] = p->next;
+			free(p);
+		}
+	}
+}
+
+
+/*
+	The storage size is the memory handed out by the slab allocator to
+	key entries, vsets and values, including size class rounding.
+*/
 long storage_get_current_size() {
-    return storage_current_size;
+    return slab_used_bytes();
 }
 
 
@@ -211,46 +557,291 @@ long storage_gc_count() {
 }
 
 
+long storage_cache_hit_count() {
+	return storage_cache_hits;
+}
+
+
+long storage_cache_miss_count() {
+	return storage_cache_misses;
+}
+
+
+long storage_eviction_count() {
+	return storage_evictions;
+}
+
+
+long storage_admission_reject_count() {
+	return storage_admission_rejects;
+}
+
+
+int storage_key_class_count() {
+	return class_count;
+}
+
+
+long storage_key_class_cached_bytes(int cls) {
+	if (cls < 0 || cls >= class_count)
+		return 0;
+	return classes[cls].cached_bytes;
+}
+
+
+const char* storage_eviction_policy_name() {
+	return (eviction_policy == EVICTION_CLOCK) ? "clock" : "lru";
+}
+
+
 void storage_gc_at_least(int bytes) {
+	storage_gc_budget(bytes, 0);
+}
+
+
+/*
+	The clock is checked every GC_CLOCK_CHECK evictions only.
+*/
+#define GC_CLOCK_CHECK 64
+
+
+long storage_gc_budget(long bytes, long usecs) {
+	int n = 0, n_freed;
+	long freed = 0;
 	key_entry* kentry;
+	struct timeval start, now;
     
 	if (!gc_enabled)
-		return;
+		return 0;
 	
 	storage_gc_calls++;
+	gettimeofday(&start, NULL);
 	// printf("garbage\n");
-	while ((bytes > 0)) {
-		kentry = TAILQ_LAST(&lru_list, lru_head);
-		if (kentry == NULL)
-			return;
+	while (freed < bytes) {
+		kentry = cache_victim();
+		if (kentry != NULL) {
+			cache_remove(kentry);
+			if (!key_entry_local(kentry)) {
+				index_remove(&storage_index, kentry);
+				freed += key_entry_free(kentry);
+				storage_evictions++;
+			}
+		} else {
+			// Out of cached entries, spill cold local ones
+			if (spill_file == NULL || (kentry = spill_victim()) == NULL)
+				break;
+			if ((n_freed = spill_out(kentry)) < 0)
+				break;
+			freed += n_freed;
+		}
+		
+		if (usecs > 0 && (++n % GC_CLOCK_CHECK) == 0) {
+			gettimeofday(&now, NULL);
+			if ((now.tv_sec - start.tv_sec) * 1000000 +
+				(now.tv_usec - start.tv_usec) >= usecs)
+				break;
+		}
+	}
+	slab_reclaim(1);
+	return freed;
+}
 
-		TAILQ_REMOVE(&lru_list, kentry, lru);
-		memset(&kentry->lru, 0, sizeof(kentry->lru));
-		if (!key_entry_local(kentry)) {
-			LIST_REMOVE(kentry, collisions);
-			bytes -= key_entry_free(kentry);
+
+void storage_snapshot_acquire(int st) {
+	int i;
+	
+	i = snapshot_find(st);
+	if (i < snapshot_count && snapshots[i].st == st) {
+		snapshots[i].count++;
+		return;
+	}
+	
+	if (snapshot_count == snapshot_size) {
+		snapshot_size = (snapshot_size == 0) ? 16 : 2 * snapshot_size;
+		snapshots = realloc(snapshots, snapshot_size * sizeof(snapshot_ref));
+		assert(snapshots != NULL);
+	}
+	memmove(&snapshots[i+1], &snapshots[i],
+		(snapshot_count - i) * sizeof(snapshot_ref));
+	snapshots[i].st = st;
+	snapshots[i].count = 1;
+	snapshot_count++;
+}
+
+
+void storage_snapshot_release(int st) {
+	int i;
+	
+	i = snapshot_find(st);
+	if (i == snapshot_count || snapshots[i].st != st)
+		return;
+	if (--snapshots[i].count > 0)
+		return;
+	
+	memmove(&snapshots[i], &snapshots[i+1],
+		(snapshot_count - i - 1) * sizeof(snapshot_ref));
+	snapshot_count--;
+}
+
+
+int storage_oldest_snapshot() {
+	return (snapshot_count > 0) ? snapshots[0].st : -1;
+}
+
+
+/*
+	Prunes the vsets of the entries in the next slots of the index,
+	resuming where the previous call stopped, so that a full pass over
+	the storage is spread over many calls.
+*/
+long storage_prune(int version, int slots) {
+	unsigned int n = 0;
+	int pruned = 0, cached;
+	index_slot* slot;
+	key_entry* kentry;
+	
+	while (n < (unsigned int)slots && n < storage_index.size) {
+		if (prune_cursor >= storage_index.size)
+			prune_cursor = 0;
+		slot = &storage_index.slots[prune_cursor];
+		kentry = slot->entry;
+		if (slot->hash == 0 || (kentry->flags & KENTRY_SPILLED)) {
+			prune_cursor++;
+			n++;
+			continue;
+		}
+		
+		if (vset_count(KENTRY_VSET(kentry)) > 1) {
+			cached = kentry->flags & KENTRY_CACHED;
+			if (cached)
+				classes[kentry->cls].cached_bytes -= key_entry_bytes(kentry);
+			pruned += vset_prune(KENTRY_VSET(kentry), version);
+			if (cached)
+				classes[kentry->cls].cached_bytes += key_entry_bytes(kentry);
 		}
+		
+		if (key_entry_deleted(kentry, version)) {
+			if (kentry->flags & KENTRY_CACHED)
+				cache_remove(kentry);
+			index_remove(&storage_index, kentry);
+			key_entry_free(kentry);
+			storage_reclaimed_entries++;
+			// The next entry may have been shifted into this slot
+			continue;
+		}
+		prune_cursor++;
+		n++;
 	}
+	
+	storage_val_entries -= pruned;
+	storage_pruned_versions += pruned;
+	return pruned;
+}
+
+
+long storage_pruned_count() {
+	return storage_pruned_versions;
+}
+
+
+long storage_reclaimed_count() {
+	return storage_reclaimed_entries;
+}
+
+
+long storage_spill_compact(long bytes) {
+	if (spill_file == NULL)
+		return 0;
+	return spill_compact(spill_file, bytes, spill_moved);
+}
+
+
+void storage_spill_freeze(int frozen) {
+	if (spill_file != NULL)
+		spill_freeze(spill_file, frozen);
+}
+
+
+long storage_spilled_count() {
+	return storage_spilled_entries;
+}
+
+
+long storage_spill_fault_count() {
+	return storage_spill_faults;
+}
+
+
+long storage_spill_file_bytes() {
+	if (spill_file == NULL)
+		return 0;
+	return spill_live_bytes(spill_file);
+}
+
+
+int storage_range(key* start, key* end, int version, storage_range_cb cb, void* arg) {
+	int count = 0, stop = 0;
+	skiplist_node* n;
+	key_entry* kentry;
+	key k;
+	val* v;
+	
+	if (ordered_keys == NULL)
+		return -1;
+	
+	n = skiplist_seek(ordered_keys, start ? start->data : NULL, start ? start->size : 0);
+	for (; n != NULL && !stop; n = skiplist_next(n)) {
+		kentry = skiplist_item(n);
+		if (end != NULL && ordered_cmp(kentry, end->data, end->size) >= 0)
+			break;
+		if (kentry->flags & KENTRY_CACHED)
+			continue;
+		if (kentry->flags & KENTRY_SPILLED)
+			v = spilled_get(kentry, version);
+		else
+			v = vset_get(KENTRY_VSET(kentry), version);
+		if (v == NULL)
+			continue;
+		if (v->size > 0) {
+			k.size = kentry->size;
+			k.data = KENTRY_KEY(kentry);
+			stop = cb(&k, v, arg);
+			count++;
+		}
+		val_free(v);
+	}
+	return count;
+}
+
+
+long storage_ordered_count() {
+	if (ordered_keys == NULL)
+		return 0;
+	return skiplist_count(ordered_keys);
 }
 
 
 int storage_iterate(int version, void (iter)(key*, val*, void*), void* arg) {
-	int i;
+	unsigned int i;
 	key_entry* kentry;
 	key k;
 	val* v;
 	int count = 0;
 	
-	for (i = 0; i < STORAGE_TABLE_SIZE; i++) {
-	    LIST_FOREACH(kentry, &storage_table[i], collisions) {
-			if (key_entry_local(kentry)) {
-				k.size = kentry->size;
-				k.data = kentry->key;
-				v = vset_get(kentry->values, version);
-				iter(&k, v, arg);
-				val_free(v);
-				count++;
-			}
+	for (i = 0; i < storage_index.size; i++) {
+		if (storage_index.slots[i].hash == 0)
+			continue;
+		kentry = storage_index.slots[i].entry;
+		if (key_entry_local(kentry)) {
+			k.size = kentry->size;
+			k.data = KENTRY_KEY(kentry);
+			if (kentry->flags & KENTRY_SPILLED)
+				v = spilled_get(kentry, version);
+			else
+				v = vset_get(KENTRY_VSET(kentry), version);
+			iter(&k, v, arg);
+			val_free(v);
+			count++;
 		}
 	}
 	return count;
@@ -269,58 +860,113 @@ void storage_gc_stop() {
 }
 
 
-static key_entry* key_entry_new(key* k) {
+static key_entry* key_entry_new(key* k, int cls) {
 	int size;
     key_entry* kentry;
+    char* p;
     
-	size = sizeof(key_entry) + k->size;
-    kentry = DB_MALLOC(size);
-	memset(kentry, 0, size);
+	size = kentry_prefix + key_offset + k->size;
+    p = slab_alloc(size);
+	memset(p, 0, size);
+	kentry = (key_entry*)(p + kentry_prefix);
+	kentry->cls = cls;
     kentry->size = k->size;
-    memcpy(kentry->key, k->data, k->size);
-	kentry->values = vset_new();
+    memcpy(KENTRY_KEY(kentry), k->data, k->size);
+	vset_init(KENTRY_VSET(kentry));
     storage_key_entries++;
-    storage_current_size += (size + vset_allocated_bytes(kentry->values));
+	
+	if (ordered_keys != NULL && k->size >= StorageOrderedPrefixLen &&
+		memcmp(k->data, StorageOrderedPrefix, StorageOrderedPrefixLen) == 0) {
+		skiplist_insert(ordered_keys, kentry, k->data, k->size);
+		kentry->flags |= KENTRY_ORDERED;
+	}
     
     return kentry;
 }
 
 
+/*
+	Returns the number of bytes given back to the slab allocator.
+*/
 static int key_entry_free(key_entry* kentry) {
-    int bytes;
-    
-    bytes = sizeof(key_entry) + kentry->size + vset_allocated_bytes(kentry->values);
+    long bytes;
     
+    bytes = slab_used_bytes();
     storage_key_entries--;
-	storage_val_entries -= vset_count(kentry->values);
-    storage_current_size -= bytes;
-
-	vset_free(kentry->values);
-    DB_FREE(kentry);
+	if ((kentry->flags & KENTRY_ORDERED) && ordered_keys != NULL)
+		skiplist_remove(ordered_keys, KENTRY_KEY(kentry), kentry->size);
+	if (kentry->flags & KENTRY_SPILLED) {
+		storage_val_entries -= spilled_count(kentry);
+		storage_spilled_entries--;
+		spill_release(spill_file, KENTRY_SPILL_OFFSET(kentry));
+	} else {
+		storage_val_entries -= vset_count(KENTRY_VSET(kentry));
+		vset_destroy(KENTRY_VSET(kentry));
+	}
+    slab_free((char*)kentry - kentry_prefix,
+		kentry_prefix + key_offset + kentry->size);
     
-    return bytes;
+    return bytes - slab_used_bytes();
+}
+
+
+/*
+	Approximate memory footprint of an entry, used for the per class
+	accounting of cached bytes.
+*/
+static int key_entry_bytes(key_entry* kentry) {
+	return kentry_prefix + vset_offset + kentry->size +
+		vset_allocated_bytes(KENTRY_VSET(kentry));
 }
 
 
 static int key_entry_local(key_entry* kentry) {
 	unsigned int h;
-	h = joat_hash(kentry->key, kentry->size);
+	h = key_hash(KENTRY_KEY(kentry), kentry->size);
 	return node_id_for_hash(h) == NodeID;
 }
 
 
-static key_entry* find_key_entry(key* k) {
-    unsigned int h, i;
-    key_entry* kentry;
-    
-    h = hash((char*) k->data, k->size);
-    i = h % STORAGE_TABLE_SIZE;
+/*
+	An entry is deleted when its only version is a tombstone (an empty
+	value) that every reader at version or later sees: no one can get
+	anything else from it. Pinned entries wait for their remote get.
+*/
+static int key_entry_deleted(key_entry* kentry, int version) {
+	int deleted;
+	val_view w;
+	
+	if (kentry->pins > 0 || vset_count(KENTRY_VSET(kentry)) != 1)
+		return 0;
+	if (!vset_view(KENTRY_VSET(kentry), version, &w))
+		return 0;
+	deleted = (w.size == 0);
+	vset_view_release(&w);
+	return deleted;
+}
+
+
+/*
+	Distance of slot i from the home slot of hash h.
+*/
+#define PROBE_DISTANCE(idx, h, i) (((i) - (h)) & ((idx)->size - 1))
+
+
+static key_entry* find_key_entry(key* k, unsigned int h) {
+    unsigned int i, d, mask;
+	index_slot* slot;
+	key_index* idx = &storage_index;
     
-    LIST_FOREACH(kentry, &storage_table[i], collisions) {
-        if (key_cmp(k, kentry)) {
-            return kentry;
-        }
-    }
+	mask = idx->size - 1;
+	i = h & mask;
+	for (d = 0; (slot = &idx->slots[i])->hash != 0; d++) {
+		// Robin Hood invariant: k would have displaced this entry
+		if (PROBE_DISTANCE(idx, slot->hash, i) < d)
+			return NULL;
+		if (slot->hash == h && key_cmp(k, slot->entry))
+			return slot->entry;
+		i = (i + 1) & mask;
+	}
     return NULL;
 }
 
@@ -329,18 +975,554 @@ static int key_cmp(key* k, key_entry* ke) {
     if (k->size != ke->size)
         return 0;
     
-    if (memcmp(k->data, ke->key, k->size) == 0)
+    if (memcmp(k->data, KENTRY_KEY(ke), k->size) == 0)
         return 1;
     else
         return 0;
 }
 
 
+/*
+	Integer keys are mixed with the murmur3 finalizer, as the index
+	takes the low bits of the hash as home slot. 0 marks empty slots.
+*/
 static unsigned int hash(char* k, int size) {
+	unsigned int h;
 	if (size == sizeof(int)) {
-		unsigned int* h;
-		h = (unsigned int*)k;
-		return *h;
+		h = *(unsigned int*)k;
+		h ^= h >> 16;
+		h *= 0x85ebca6b;
+		h ^= h >> 13;
+		h *= 0xc2b2ae35;
+		h ^= h >> 16;
+	} else {
+		h = key_hash(k, size);
+	}
+	return (h == 0) ? 1 : h;
+}
+
+
+static void index_init(key_index* idx, unsigned int size) {
+	idx->size = size;
+	idx->count = 0;
+	idx->slots = calloc(size, sizeof(index_slot));
+	assert(idx->slots != NULL);
+}
+
+
+static void index_free(key_index* idx) {
+	free(idx->slots);
+	idx->slots = NULL;
+	idx->size = idx->count = 0;
+}
+
+
+static void index_place(key_index* idx, unsigned int h, key_entry* kentry) {
+	unsigned int i, d, mask;
+	index_slot tmp, cur;
+	
+	cur.hash = h;
+	cur.entry = kentry;
+	mask = idx->size - 1;
+	i = h & mask;
+	for (d = 0; idx->slots[i].hash != 0; d++) {
+		// Steal the slot from entries closer to their home slot
+		if (PROBE_DISTANCE(idx, idx->slots[i].hash, i) < d) {
+			tmp = idx->slots[i];
+			idx->slots[i] = cur;
+			cur = tmp;
+			d = PROBE_DISTANCE(idx, cur.hash, i);
+		}
+		i = (i + 1) & mask;
+	}
+	idx->slots[i] = cur;
+	idx->count++;
+}
+
+
+static void index_grow(key_index* idx) {
+	unsigned int i;
+	key_index old = *idx;
+	
+	index_init(idx, old.size * 2);
+	for (i = 0; i < old.size; i++)
+		if (old.slots[i].hash != 0)
+			index_place(idx, old.slots[i].hash, old.slots[i].entry);
+	index_free(&old);
+}
+
+
+static void index_insert(key_index* idx, unsigned int h, key_entry* kentry) {
+	if (idx->count + 1 > INDEX_MAX_LOAD(idx->size))
+		index_grow(idx);
+	index_place(idx, h, kentry);
+}
+
+
+static void index_remove(key_index* idx, key_entry* kentry) {
+	unsigned int i, next, mask;
+	
+	mask = idx->size - 1;
+	i = hash(KENTRY_KEY(kentry), kentry->size) & mask;
+	while (idx->slots[i].entry != kentry)
+		i = (i + 1) & mask;
+	
+	// Shift back the following entries until an empty slot, or an
+	// entry already in its home slot
+	next = (i + 1) & mask;
+	while (idx->slots[next].hash != 0 &&
+		   PROBE_DISTANCE(idx, idx->slots[next].hash, next) > 0) {
+		idx->slots[i] = idx->slots[next];
+		i = next;
+		next = (next + 1) & mask;
+	}
+	idx->slots[i].hash = 0;
+	idx->slots[i].entry = NULL;
+	idx->count--;
+}
+
+
+static void cache_insert(key_entry* kentry) {
+	key_class* c = &classes[kentry->cls];
+	kentry->flags |= KENTRY_CACHED;
+	kentry->flags &= ~KENTRY_REFERENCED;
+	storage_cached_entries++;
+	c->cached_entries++;
+	if (kentry->pins > 0)
+		c->pinned++;
+	c->cached_bytes += key_entry_bytes(kentry);
+	if (eviction_policy == EVICTION_LRU)
+		TAILQ_INSERT_HEAD(&c->lru, LRU_LINK(kentry), lru);
+}
+
+
+static void cache_remove(key_entry* kentry) {
+	key_class* c = &classes[kentry->cls];
+	kentry->flags &= ~(KENTRY_CACHED | KENTRY_REFERENCED);
+	storage_cached_entries--;
+	c->cached_entries--;
+	if (kentry->pins > 0)
+		c->pinned--;
+	c->cached_bytes -= key_entry_bytes(kentry);
+	if (eviction_policy == EVICTION_LRU)
+		TAILQ_REMOVE(&c->lru, LRU_LINK(kentry), lru);
+}
+
+
+/*
+	A hit on a cached entry moves it to the LRU head, or just sets its
+	reference bit with CLOCK, which leaves the entry cache line as the
+	only one written.
+*/
+static void cache_touch(key_entry* kentry) {
+	lru_link* l;
+	struct lru_head* head;
+	if (eviction_policy == EVICTION_CLOCK) {
+		kentry->flags |= KENTRY_REFERENCED;
+		return;
+	}
+	l = LRU_LINK(kentry);
+	head = &classes[kentry->cls].lru;
+	if (TAILQ_FIRST(head) != l) {
+		TAILQ_REMOVE(head, l, lru);
+		TAILQ_INSERT_HEAD(head, l, lru);
+	}
+}
+
+
+/*
+	Victims are taken from the class with the lowest priority that has
+	unpinned cached entries: with LRU, the tail of its list, pinned
+	entries found there being moved to the head. With CLOCK, the hand
+	sweeps the slots of the key index, clearing the reference bits of
+	cached entries with that priority until it finds one without.
+	The hand is not advanced past the victim: once the victim is
+	removed, backward shifting moves the next entry into its slot.
+	Gives up after two full rotations, which can only happen if the
+	index changed under the hand.
+*/
+static key_entry* cache_victim() {
+	key_class* c;
+	
+	if ((c = victim_class()) == NULL)
+		return NULL;
+	return class_victim(c, 0);
+}
+
+
+/*
+	Returns the victim with the priority of class c, or of class c only
+	if same_class is set.
+*/
+static key_entry* class_victim(key_class* c, int same_class) {
+	unsigned int n;
+	int priority;
+	index_slot* slot;
+	key_entry* e;
+	lru_link* l;
+	
+	if (eviction_policy == EVICTION_LRU) {
+		for (n = 0; n < c->cached_entries; n++) {
+			l = TAILQ_LAST(&c->lru, lru_head);
+			if (LRU_ENTRY(l)->pins == 0)
+				return LRU_ENTRY(l);
+			TAILQ_REMOVE(&c->lru, l, lru);
+			TAILQ_INSERT_HEAD(&c->lru, l, lru);
+		}
+		return NULL;
 	}
-	return joat_hash(k, size);
+	
+	priority = c->conf.priority;
+	for (n = 0; n < 2 * storage_index.size; n++) {
+		if (clock_hand >= storage_index.size)
+			clock_hand = 0;
+		slot = &storage_index.slots[clock_hand];
+		e = slot->entry;
+		if (slot->hash != 0 && (e->flags & KENTRY_CACHED) && e->pins == 0 &&
+			classes[e->cls].conf.priority == priority &&
+			(!same_class || &classes[e->cls] == c)) {
+			if (!(e->flags & KENTRY_REFERENCED))
+				return e;
+			e->flags &= ~KENTRY_REFERENCED;
+		}
+		clock_hand++;
+	}
+	return NULL;
+}
+
+
+/*
+	Returns the entry the next GC would evict, without moving the clock
+	hand, clearing reference bits or reordering the LRU lists. With LRU,
+	this is the unpinned entry closest to the tail of the victim class.
+	With CLOCK, it is the first unreferenced cached entry close to the
+	hand, or the first cached one if all of them are referenced.
+*/
+static key_entry* cache_peek_victim() {
+	unsigned int n, i;
+	int priority;
+	index_slot* slot;
+	key_entry* e;
+	key_entry* first = NULL;
+	key_class* c;
+	lru_link* l;
+	
+	if ((c = victim_class()) == NULL)
+		return NULL;
+	
+	if (eviction_policy == EVICTION_LRU) {
+		l = TAILQ_LAST(&c->lru, lru_head);
+		for (n = 0; l != NULL && n < PEEK_WINDOW; n++) {
+			if (LRU_ENTRY(l)->pins == 0)
+				return LRU_ENTRY(l);
+			l = TAILQ_PREV(l, lru_head, lru);
+		}
+		return NULL;
+	}
+	
+	priority = c->conf.priority;
+	for (n = 0; n < PEEK_WINDOW && n < storage_index.size; n++) {
+		i = (clock_hand + n) & (storage_index.size - 1);
+		slot = &storage_index.slots[i];
+		e = slot->entry;
+		if (slot->hash == 0 || !(e->flags & KENTRY_CACHED) || e->pins > 0 ||
+			classes[e->cls].conf.priority != priority)
+			continue;
+		if (!(e->flags & KENTRY_REFERENCED))
+			return e;
+		if (first == NULL)
+			first = e;
+	}
+	return first;
+}
+
+
+/*
+	Returns the first class whose prefix matches k, 0 if none does.
+*/
+static int key_class_of(key* k) {
+	int i;
+	storage_key_class* c;
+	
+	for (i = 1; i < class_count; i++) {
+		c = &classes[i].conf;
+		if (k->size >= c->prefix_len &&
+			memcmp(k->data, c->prefix, c->prefix_len) == 0)
+			return i;
+	}
+	return 0;
+}
+
+
+/*
+	A class admits a new entry of the given bytes if it can be cached and
+	the entry fits in its max_bytes.
+*/
+static int key_class_admits(int cls, int bytes) {
+	key_class* c = &classes[cls];
+	if (!c->conf.cache)
+		return 0;
+	return c->conf.max_bytes == 0 ||
+		c->cached_bytes + bytes <= c->conf.max_bytes;
+}
+
+
+static int key_class_over_budget(key_class* c) {
+	return c->conf.max_bytes > 0 && c->cached_bytes > c->conf.max_bytes;
+}
+
+
+/*
+	Evicts entries of class c, other than keep, until it is back within
+	its max_bytes. keep is pinned meanwhile: it may be a placeholder the
+	caller has yet to pin.
+*/
+static void trim_class(key_class* c, key_entry* keep) {
+	key_entry* kentry;
+	
+	if (!key_class_over_budget(c))
+		return;
+	if (keep->pins++ == 0)
+		c->pinned++;
+	while (key_class_over_budget(c) && c->cached_entries > c->pinned) {
+		if ((kentry = class_victim(c, 1)) == NULL)
+			break;
+		cache_remove(kentry);
+		if (!key_entry_local(kentry)) {
+			index_remove(&storage_index, kentry);
+			key_entry_free(kentry);
+			storage_evictions++;
+		}
+	}
+	if (--keep->pins == 0)
+		c->pinned--;
+}
+
+
+/*
+	Classes over their max_bytes go first, then the one with the lowest
+	priority.
+*/
+static key_class* victim_class() {
+	int i, over;
+	key_class* victim = NULL;
+	
+	if (storage_cached_entries == 0)
+		return NULL;
+	over = 0;
+	for (i = 0; i < class_count; i++) {
+		if (classes[i].cached_entries == classes[i].pinned)
+			continue;
+		if (key_class_over_budget(&classes[i]) && !over) {
+			victim = &classes[i];
+			over = 1;
+			continue;
+		}
+		if (over && !key_class_over_budget(&classes[i]))
+			continue;
+		if (victim == NULL || classes[i].conf.priority < victim->conf.priority)
+			victim = &classes[i];
+	}
+	return victim;
+}
+
+
+/*
+	Returns the index of st in snapshots, or where it should be inserted.
+*/
+static int snapshot_find(int st) {
+	int lo = 0, hi = snapshot_count, mid;
+	
+	// Most lookups are for the newest snapshot
+	if (snapshot_count > 0 && snapshots[snapshot_count - 1].st < st)
+		return snapshot_count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (snapshots[mid].st < st)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+/*
+	Finds the entry of k for a get, counting misses of remote keys.
+*/
+static key_entry* lookup_for_get(key* k) {
+	unsigned int h;
+	key_entry* kentry;
+	
+	h = hash((char*)k->data, k->size);
+	if (admission_sketch != NULL)
+		freq_sketch_add(admission_sketch, h);
+	if ((kentry = find_key_entry(k, h)) == NULL) {
+		if (node_id_for_hash(key_hash((char*)k->data, k->size)) != NodeID)
+			storage_cache_misses++;
+		return NULL;
+	}
+	if (kentry->flags & KENTRY_SPILLED)
+		spill_in(kentry);
+	return kentry;
+}
+
+
+static void count_get(key_entry* kentry, int found) {
+	if (!(kentry->flags & KENTRY_CACHED)) {
+		kentry->flags |= KENTRY_REFERENCED;
+		return;
+	}
+	if (found) {
+		storage_cache_hits++;
+		cache_touch(kentry);
+	} else {
+		storage_cache_misses++;
+	}
+}
+
+
+/*
+	CLOCK sweep over the local entries for one to spill: entries read
+	since the hand last passed are skipped, and lose their reference bit.
+*/
+static key_entry* spill_victim() {
+	unsigned int n;
+	index_slot* slot;
+	key_entry* kentry;
+	
+	for (n = 0; n < 2 * storage_index.size; n++) {
+		if (spill_hand >= storage_index.size)
+			spill_hand = 0;
+		slot = &storage_index.slots[spill_hand++];
+		if (slot->hash == 0)
+			continue;
+		kentry = slot->entry;
+		if ((kentry->flags & (KENTRY_CACHED | KENTRY_SPILLED)) ||
+			kentry->pins > 0)
+			continue;
+		// Nothing to gain from entries whose values are all inline
+		if (vset_allocated_bytes(KENTRY_VSET(kentry)) <= vset_sizeof())
+			continue;
+		if (kentry->flags & KENTRY_REFERENCED) {
+			kentry->flags &= ~KENTRY_REFERENCED;
+			continue;
+		}
+		return kentry;
+	}
+	return NULL;
+}
+
+
+/*
+	A spill record holds the number of versions, followed by each version
+	(version, size and data), newest first. Returns the number of bytes
+	given back to the slab allocator, -1 if the spill file is full.
+*/
+static int spill_out(key_entry* kentry) {
+	int n = 0, size, version = INT_MAX;
+	long offset, bytes;
+	val* v;
+	static char* buffer = NULL;
+	static int buffer_size = 0;
+	
+	size = sizeof(int);
+	while ((v = vset_get(KENTRY_VSET(kentry), version)) != NULL) {
+		if (size + 2 * sizeof(int) + v->size > buffer_size) {
+			buffer_size = 2 * (size + 2 * sizeof(int) + v->size);
+			buffer = realloc(buffer, buffer_size);
+			assert(buffer != NULL);
+		}
+		memcpy(&buffer[size], &v->version, sizeof(int));
+		memcpy(&buffer[size + sizeof(int)], &v->size, sizeof(int));
+		memcpy(&buffer[size + 2 * sizeof(int)], v->data, v->size);
+		size += 2 * sizeof(int) + v->size;
+		version = v->version - 1;
+		n++;
+		val_free(v);
+	}
+	memcpy(buffer, &n, sizeof(int));
+	
+	if ((offset = spill_append(spill_file, kentry, buffer, size)) < 0)
+		return -1;
+	
+	bytes = slab_used_bytes();
+	vset_destroy(KENTRY_VSET(kentry));
+	KENTRY_SPILL_OFFSET(kentry) = offset;
+	kentry->flags |= KENTRY_SPILLED;
+	storage_spilled_entries++;
+	return bytes - slab_used_bytes();
+}
+
+
+static void spill_in(key_entry* kentry) {
+	int i, n, size;
+	long offset;
+	char* p;
+	val v;
+	
+	offset = KENTRY_SPILL_OFFSET(kentry);
+	p = spill_data(spill_file, offset, &size);
+	memcpy(&n, p, sizeof(int));
+	p += sizeof(int);
+	
+	vset_init(KENTRY_VSET(kentry));
+	for (i = 0; i < n; i++) {
+		memcpy(&v.version, p, sizeof(int));
+		memcpy(&v.size, p + sizeof(int), sizeof(int));
+		v.data = p + 2 * sizeof(int);
+		vset_add(KENTRY_VSET(kentry), &v);
+		p += 2 * sizeof(int) + v.size;
+	}
+	
+	spill_release(spill_file, offset);
+	kentry->flags &= ~KENTRY_SPILLED;
+	kentry->flags |= KENTRY_REFERENCED;
+	storage_spilled_entries--;
+	storage_spill_faults++;
+}
+
+
+static int spilled_count(key_entry* kentry) {
+	int n, size;
+	memcpy(&n, spill_data(spill_file, KENTRY_SPILL_OFFSET(kentry), &size),
+		sizeof(int));
+	return n;
+}
+
+
+/*
+	Reads a version of a spilled entry without bringing it back.
+*/
+static val* spilled_get(key_entry* kentry, int version) {
+	int i, n, size, vversion, vsize;
+	char* p;
+	
+	p = spill_data(spill_file, KENTRY_SPILL_OFFSET(kentry), &size);
+	memcpy(&n, p, sizeof(int));
+	p += sizeof(int);
+	for (i = 0; i < n; i++) {
+		memcpy(&vversion, p, sizeof(int));
+		memcpy(&vsize, p + sizeof(int), sizeof(int));
+		if (vversion <= version)
+			return versioned_val_new(p + 2 * sizeof(int), vsize, vversion);
+		p += 2 * sizeof(int) + vsize;
+	}
+	return NULL;
+}
+
+
+static void spill_moved(void* owner, long offset) {
+	KENTRY_SPILL_OFFSET((key_entry*)owner) = offset;
+}
+
+
+static int ordered_cmp(void* item, const char* k, int size) {
+	int rv;
+	key_entry* kentry = (key_entry*)item;
+	
+	rv = memcmp(KENTRY_KEY(kentry), k, kentry->size < size ? kentry->size : size);
+	if (rv != 0)
+		return rv;
+	return kentry->size - size;
 }
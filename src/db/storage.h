@@ -33,10 +33,30 @@ int storage_init2(consistent_hash chash);
 
 void storage_free();
 
+/*
+	Makes room in the index for keys keys, e.g. before a bulk load.
+*/
+void storage_reserve(long keys);
+
 val* storage_get(key* k, int max_ver);
 
+/*
+	Like storage_get(), but borrows the value instead of copying it.
+	Returns 1 and fills w if the value exists. The data of w stays valid,
+	even across event loop turns, until storage_view_release(w).
+*/
+int storage_get_view(key* k, int max_ver, val_view* w);
+
+void storage_view_release(val_view* w);
+
 int storage_put(key* k, val* v, int local, int force_cache);
 
+/*
+	Tells whether a value fetched for a key that is not local should be
+	cached, based on how often the key is accessed.
+*/
+int storage_admit(key* k);
+
 long storage_get_current_size();
 
 long storage_key_count();
@@ -45,10 +65,97 @@ long storage_val_count();
 
 long storage_gc_count();
 
+long storage_cache_hit_count();
+
+long storage_cache_miss_count();
+
+long storage_eviction_count();
+
+long storage_admission_reject_count();
+
+int storage_key_class_count();
+
+long storage_key_class_cached_bytes(int cls);
+
+const char* storage_eviction_policy_name();
+
 void storage_gc_at_least(int bytes);
 
+/*
+	Evicts cached entries until bytes bytes are freed, or usecs
+	microseconds have elapsed (0 for no limit). Once no cached entry is
+	left, spills cold local entries if a spill file is configured.
+	Returns the bytes freed.
+*/
+long storage_gc_budget(long bytes, long usecs);
+
+/*
+	Prevents the entry of k from being evicted until unpinned by the same
+	owner, e.g. while the remote get with that id is in flight. An owner
+	releases only the pins it holds. Returns 0 if k is not in storage.
+*/
+int storage_pin(key* k, int owner);
+
+void storage_unpin(key* k, int owner);
+
+/*
+	Registers a reader of snapshot st, which needs the versions of the
+	keys visible at st to remain available.
+*/
+void storage_snapshot_acquire(int st);
+
+void storage_snapshot_release(int st);
+
+/*
+	Returns the oldest snapshot with readers, -1 if there is none.
+*/
+int storage_oldest_snapshot();
+
+/*
+	Drops the versions that no reader at version or later can get, in
+	the next slots entries of the storage. Entries left with only a
+	tombstone are freed. Returns the versions dropped.
+*/
+long storage_prune(int version, int slots);
+
+long storage_pruned_count();
+
+long storage_reclaimed_count();
+
+/*
+	Moves at most bytes bytes of records in the spill file, to reclaim
+	the space of records that were brought back or deleted.
+*/
+long storage_spill_compact(long bytes);
+
+/*
+	Stops (frozen = 1) or resumes reusing the space of the spill file,
+	see spill_freeze().
+*/
+void storage_spill_freeze(int frozen);
+
+long storage_spilled_count();
+
+long storage_spill_fault_count();
+
+long storage_spill_file_bytes();
+
 int storage_iterate(int version, void (iter)(key*, val*, void*), void* arg);
 
+/*
+	Calls cb, in key order, with the values at version of the local keys
+	in [start, end) that are kept ordered (see StorageOrderedPrefix). A
+	NULL start or end leaves the range open on that side. Deleted keys
+	are skipped, and the scan stops when cb returns non zero. cb must not
+	modify the storage. Returns the number of keys passed to cb, or -1
+	if there is no ordered index.
+*/
+typedef int (*storage_range_cb)(key* k, val* v, void* arg);
+
+int storage_range(key* start, key* end, int version, storage_range_cb cb, void* arg);
+
+long storage_ordered_count();
+
 void storage_gc_start();
 
 void storage_gc_stop();
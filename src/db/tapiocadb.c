@@ -39,6 +39,7 @@ static const char* tapioca_config;
 static const char* paxos_config;
 static int dump_at_exit = 0;
 static char* dump_path;
+static char* restore_path = NULL;
 static struct evpaxos_config* lp_config;
 
 static void sigint(int sig) {
@@ -127,24 +128,32 @@ void tapioca_add_node(int node_id, char* address, int port) {
 }
 
 
-void tapioca_start_and_join(void) {
-	int rv;
-	struct peer* p;
+/*
+	The storage is restored before the proxy starts learning, which then
+	skips the transactions already in the snapshot.
+*/
+static void init_storage(void) {
+	int rv, st = -1;
 	rv = sm_init(lp_config, base);
 	assert(rv >= 0);
+	if (restore_path != NULL)
+		st = sm_restore_storage(restore_path);
 	rv = cproxy_init(paxos_config, base);
 	assert(rv >= 0);
+	if (st > 0)
+		cproxy_set_st(st);
+}
+
+
+void tapioca_start_and_join(void) {
+	init_storage();
 	cproxy_submit_join(NodeType, LocalIpAddress, LocalPort);
 	event_base_dispatch(base);
 }
 
 
 void tapioca_start(int recovery) {
-	int rv;
-	rv = sm_init(lp_config, base);
-	assert(rv >= 0);
-	rv = cproxy_init(paxos_config, base);
-	assert(rv >= 0);
+	init_storage();
 	if (recovery)
 		sm_recovery();
 	event_base_dispatch(base);
@@ -154,3 +163,8 @@ void tapioca_dump_store_at_exit(char* path) {
 	dump_at_exit = 1;
 	dump_path = path;
 }
+
+
+void tapioca_restore_store(char* path) {
+	restore_path = path;
+}
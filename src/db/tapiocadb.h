@@ -32,6 +32,7 @@ void tapioca_add_node(int node_id, char* address, int port);
 void tapioca_start(int recovery);
 void tapioca_start_and_join(void);
 void tapioca_dump_store_at_exit(char* path);
+void tapioca_restore_store(char* path);
 struct event_base * tapioca_get_event_base();
 #ifdef __cplusplus
 }
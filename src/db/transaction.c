@@ -25,17 +25,54 @@
 #include "remote.h"
 #include "hash.h"
 #include "transaction.h"
-#include "hashtable_itr.h"
+#include "storage.h"
+#include "recent_writes.h"
 
 #include <paxos.h>
 
-static void add_to_set(struct hashtable* h, key* k, val* v);
+static void add_to_set(transaction* t, tr_set* s, key* k, val* v, int keep);
 static void remote_get_cb(key* k, val* v, void* arg);
-static int key_equal(void* k1, void* k2);
-static unsigned int hash_from_key(void* k);
-static void free_key(void* k);
+static void set_init(tr_set* s);
+static void set_free(tr_set* s);
+static void set_clear(tr_set* s);
+static unsigned int set_find(tr_set* s, key* k, unsigned int h);
+static flat_key_val* set_search(tr_set* s, key* k);
+static void set_grow(tr_set* s);
+static void set_st(transaction* t);
+static int range_cb(key* k, val* v, void* arg);
+static void reset_st(transaction* t);
+static int doomed(transaction* t);
+static void check_reread(transaction* t, flat_key_val* kv, int version);
+
+#define SET_INITIAL_SLOTS 64
+
+static long local_aborts = 0;
+static transaction_remote_get get_remote = remote_get;
+
+/*
+	Larger values read from the storage are not kept in the read set
+	(their vsize is set to VAL_NOT_KEPT), only their version, and are
+	read again from the storage at the snapshot of the transaction. The
+	storage may drop that version in the meantime (see
+	StorageMaxOldVersions), then the read cannot be repeated and the
+	transaction is aborted. Values fetched from remote nodes are always
+	kept: the storage may not have admitted them, and the read repeated
+	by the get callback would issue the same remote get forever.
+*/
+#define READ_VALUE_MAX 256
+#define KEEP(v) ((v)->size <= READ_VALUE_MAX)
+#define VAL_NOT_KEPT -1
+#define KV_ROOM(vsize) ((vsize) == VAL_NOT_KEPT ? (int)sizeof(int) : (vsize))
+
+#define ENTRY_BYTES(kv) \
+	(sizeof(flat_key_val) + (kv)->ksize + ((kv)->vsize > 0 ? (kv)->vsize : 0))
 
-#define hashtable_init 64, hash_from_key, key_equal, free_key
+
+typedef struct range_scan_t {
+	transaction* t;
+	transaction_range_cb cb;
+	void* arg;
+} range_scan;
 
 
 transaction* transaction_new() {
@@ -45,8 +82,11 @@ transaction* transaction_new() {
     t->st = -1;
 	t->seqn = 0;
 	t->remote_count = 0;
-    t->rs = create_hashtable(hashtable_init);
-    t->ws = create_hashtable(hashtable_init);
+	t->ranged = 0;
+	t->lost_read = 0;
+	set_init(&t->rs);
+	set_init(&t->ws);
+	t->mem = arena_new();
 	t->get_cb = NULL;
 	t->cb_arg = NULL;
 	t->cb_val = NULL;
@@ -57,38 +97,41 @@ transaction* transaction_new() {
 }
 
 
+/*
+	The sets are emptied in place, and the arena holding their keys and
+	values is reset, so that a client running transactions of similar
+	size no longer allocates.
+*/
 void transaction_clear(transaction* t) {
-    t->st = -1;
+    reset_st(t);
 	t->remote_count = 0;
-	if (hashtable_count(t->rs) > 0) {
-    	hashtable_destroy(t->rs, 1);
-		t->rs = create_hashtable(hashtable_init);
-	}
-	if (hashtable_count(t->ws) > 0) {
-    	hashtable_destroy(t->ws, 1);
-		t->ws = create_hashtable(hashtable_init);
-	}
+	t->ranged = 0;
+	t->lost_read = 0;
+	set_clear(&t->rs);
+	set_clear(&t->ws);
+	arena_reset(t->mem);
 }
 
 
+/*
+	The entries of a single set stay in the arena until the next
+	transaction_clear().
+*/
 void transaction_clear_writeset(transaction* t) {
-	if (hashtable_count(t->ws) > 0) {
-		hashtable_destroy(t->ws, 1);
-    	t->ws = create_hashtable(hashtable_init);
-	}
+	set_clear(&t->ws);
 }
 
 void transaction_clear_readset(transaction* t) {
-	if (hashtable_count(t->rs) > 0) {
-    	hashtable_destroy(t->rs, 1);
-		t->rs = create_hashtable(hashtable_init);
-	}
+	set_clear(&t->rs);
+	t->ranged = 0;
 }
 
 
 void transaction_destroy(transaction* t) {
-    hashtable_destroy(t->rs, 1);
-    hashtable_destroy(t->ws, 1);
+    reset_st(t);
+	set_free(&t->rs);
+	set_free(&t->ws);
+	arena_free(t->mem);
     DB_FREE(t);
 }
 
@@ -98,64 +141,161 @@ val* transaction_get(transaction* t, key* k) {
     flat_key_val* kv;
     
     // If read set is empty, mark current ST
-    if ((t->st == -1) && (hashtable_count(t->rs) == 0))
-		t->st = cproxy_current_st();
+    if ((t->st == -1) && (t->rs.count == 0))
+		set_st(t);
 	
 	// Lookup write set
-	kv = hashtable_search(t->ws, k);
+	kv = set_search(&t->ws, k);
 	if (kv != NULL) {
 		v = val_new(&kv->data[kv->ksize], kv->vsize);
 		// if (v->size > 0)
-			add_to_set(t->rs, k, v);
+			add_to_set(t, &t->rs, k, v, KEEP(v));
 		return v;
 	}
 
     // Lookup read set
-	kv = hashtable_search(t->rs, k);
-	if (kv != NULL) {
+	kv = set_search(&t->rs, k);
+	if (kv != NULL && kv->vsize != VAL_NOT_KEPT) {
 		v = val_new(&kv->data[kv->ksize], kv->vsize);
 		return v;
 	}
 	
     // Lookup storage
    	if ((v = sm_get(k, t->st)) != NULL) {
-       	add_to_set(t->rs, k, v);
+		if (kv == NULL)
+			add_to_set(t, &t->rs, k, v, KEEP(v));
+		else
+			check_reread(t, kv, v->version);
 		return v;
 	}
 	
 	// Issue a remote get and return NULL
-	remote_get(k, t->st, remote_get_cb, t);
+	get_remote(k, t->st, remote_get_cb, t);
 	return NULL;
 }
 
 
+/*
+	Values found in the write or read set are copied, since the sets may
+	be cleared before the view is released.
+*/
+int transaction_get_view(transaction* t, key* k, val_view* w) {
+	val v;
+	flat_key_val* kv;
+	
+	w->copy = NULL;
+	w->epoch = NULL;
+	w->hot = NULL;
+	if ((t->st == -1) && (t->rs.count == 0))
+		set_st(t);
+	
+	kv = set_search(&t->rs, k);
+	if (set_search(&t->ws, k) != NULL ||
+		(kv != NULL && kv->vsize != VAL_NOT_KEPT)) {
+		w->copy = transaction_get(t, k);
+		w->size = w->copy->size;
+		w->version = w->copy->version;
+		w->data = w->copy->data;
+		return 1;
+	}
+	
+	if (sm_get_view(k, t->st, w)) {
+		v.size = w->size;
+		v.version = w->version;
+		v.data = w->data;
+		if (kv == NULL)
+			add_to_set(t, &t->rs, k, &v, KEEP(&v));
+		else
+			check_reread(t, kv, v.version);
+		return 1;
+	}
+	
+	get_remote(k, t->st, remote_get_cb, t);
+	return 0;
+}
+
+
+void transaction_view_release(val_view* w) {
+	storage_view_release(w);
+}
+
+
 int transaction_put(transaction* t, key* k, val* v) {
     // If write set is empty, mark current ST
-    if ((t->st == -1) && (hashtable_count(t->ws) == 0))
-        t->st = cproxy_current_st();
+    if ((t->st == -1) && (t->ws.count == 0))
+        set_st(t);
     
-	add_to_set(t->ws, k, v);
+	add_to_set(t, &t->ws, k, v, 1);
 	return 0;
 }
 
 
+int transaction_delete(transaction* t, key* k) {
+	val tombstone;
+	tombstone.size = 0;
+	tombstone.version = 0;
+	tombstone.data = NULL;
+	return transaction_put(t, k, &tombstone);
+}
+
+
+int transaction_range(transaction* t, key* start, key* end, transaction_range_cb cb, void* arg) {
+	int rv;
+	range_scan scan;
+	
+	// The certifier only checks keys, not the ranges they were found in
+	if (t->ws.count > 0)
+		return -1;
+	
+	if ((t->st == -1) && (t->rs.count == 0))
+		set_st(t);
+	
+	scan.t = t;
+	scan.cb = cb;
+	scan.arg = arg;
+	rv = storage_range(start, end, t->st, range_cb, &scan);
+	if (rv >= 0)
+		t->ranged = 1;
+	return rv;
+}
+
+
+/*
+	The transaction is serialized straight into the batch of the
+	certifier proxy, unless it is already known to abort.
+*/
 int transaction_commit(transaction* t, int id, cproxy_commit_cb cb) {
 	int size;
-	static char buffer[MAX_TRANSACTION_SIZE];
+	tr_submit_msg* msg;
 	
     t->id.client_id = id;
 	t->id.seqnumber = t->seqn;
 	t->id.node_id = NodeID;
 	t->seqn++;
 	
-	size = transaction_serialize(t, (tr_submit_msg*)buffer, MAX_TRANSACTION_SIZE);
+	if (t->ranged) {
+		printf("transaction_commit: range scan in an update transaction\n");
+		return -1;
+	}
 	
-	if (size < 0) {
+	if (doomed(t)) {
+		local_aborts++;
+		return T_ABORTED;
+	}
+	
+	size = transaction_serialized_size(t);
+	if (size > MAX_TRANSACTION_SIZE) {
 		printf("transaction_serialize failed\n");
 		return -1;
 	}
 	
-    if (cproxy_submit(buffer, size, cb) < 0) {
+	if ((msg = (tr_submit_msg*)cproxy_reserve(size)) == NULL) {
+		printf("cproxy_reserve failed");
+		return -1;
+	}
+	transaction_serialize(t, msg, size);
+	
+    if (cproxy_submit_reserved(size, cb) < 0) {
 		printf("cproxy_submit failed");
         return -1;
 	}
@@ -165,84 +305,52 @@ int transaction_commit(transaction* t, int id, cproxy_commit_cb cb) {
 
 
 int transaction_read_only(transaction* t) {
-    return (hashtable_count(t->ws) == 0);
+    return (t->ws.count == 0) && !t->lost_read;
 }
 
 
 int transaction_serialize(transaction* t, tr_submit_msg* msg, int max_size) {
-    int size = 0;
-    int hsize = 0;
-	key* k;
-    flat_key_val* kv;
-    flat_key_hash* kh;
-	struct hashtable_itr* itr;
+	int i;
+	char* data;
+	flat_key_val* kv;
+	flat_key_hash* rs;
+	flat_key_hash* ws;
+	
+	if (transaction_serialized_size(t) > max_size)
+		return -1;
 	
 	msg->type = TRANSACTION_SUBMIT;
+	msg->hash_version = 0;
     msg->id.client_id = t->id.client_id;
     msg->id.seqnumber = t->id.seqnumber;
     msg->id.node_id = NodeID;
     msg->start = t->st;
-    msg->readset_count = 0;
-    msg->writeset_count = 0;
-    
-    // copy readset hashes
-	if (hashtable_count(t->rs) > 0) {
-		itr = hashtable_iterator(t->rs);
-		do {
-			if ((size + (int)sizeof(flat_key_hash)) > max_size) {
-				return -1;
-			}
-				
-			k = hashtable_iterator_key(itr);
-			kh = (flat_key_hash*)&msg->data[size];
-			
-			kh->hash[0] = hashtable_iterator_hash(itr);
-			kh->hash[1] = djb2_hash(k->data, k->size);
-			
-			size += sizeof(flat_key_hash);
-			msg->readset_count++;
-		} while (hashtable_iterator_advance(itr));
-		free(itr);
-	}
-
+    msg->readset_count = t->rs.count;
+    msg->writeset_count = t->ws.count;
+    msg->writeset_size = t->ws.bytes;
     
-    // copy writeset hashes
-	if (hashtable_count(t->ws) > 0) {
-		itr = hashtable_iterator(t->ws);
-		do {
-			if ((size + (int)sizeof(flat_key_hash)) > max_size) {
-				return -1;
-			}
-			
-			k = hashtable_iterator_key(itr);
-			kh = (flat_key_hash*)&msg->data[size];
-			
-			kh->hash[0] = hashtable_iterator_hash(itr);
-			kh->hash[1] = djb2_hash(k->data, k->size);
-			
-			size += sizeof(flat_key_hash);
-			msg->writeset_count++;
-		} while (hashtable_iterator_advance(itr));
-		free(itr);
-		hsize = size;
-		
-		itr = hashtable_iterator(t->ws);
-		do {
-			kv = hashtable_iterator_value(itr);
-			if ((size + (int)FLAT_KEY_VAL_SIZE(kv)) > max_size) {
-				return -1;
-			}
-			
-			memcpy(&msg->data[size], kv, FLAT_KEY_VAL_SIZE(kv));
-			size += (int)FLAT_KEY_VAL_SIZE(kv);
-		} while (hashtable_iterator_advance(itr));
-		free(itr);
+	// readset hashes, then writeset hashes along with the writeset data
+	rs = (flat_key_hash*)msg->data;
+	ws = rs + t->rs.count;
+	data = (char*)(ws + t->ws.count);
+	for (i = 0; i < t->rs.count; i++)
+		rs[i] = t->rs.entries[i].kh;
+	for (i = 0; i < t->ws.count; i++) {
+		kv = t->ws.entries[i].kv;
+		ws[i] = t->ws.entries[i].kh;
+		memcpy(data, kv, FLAT_KEY_VAL_SIZE(kv));
+		data += FLAT_KEY_VAL_SIZE(kv);
 	}
-    msg->writeset_size = (size - hsize);
     return TR_SUBMIT_MSG_SIZE(msg);
 }
 
 
+int transaction_serialized_size(transaction* t) {
+	return sizeof(tr_submit_msg) +
+		(t->rs.count + t->ws.count) * sizeof(flat_key_hash) + t->ws.bytes;
+}
+
+
 void transaction_set_get_cb(transaction* t, transaction_cb cb, void* arg) {
 	t->get_cb = cb;
 	t->cb_arg = arg;
@@ -254,71 +362,214 @@ int transaction_remote_count(transaction* t) {
 }
 
 
+long transaction_local_abort_count() {
+	return local_aborts;
+}
+
+
+void transaction_set_remote_get(transaction_remote_get f) {
+	get_remote = (f != NULL) ? f : remote_get;
+}
+
+
 static void remote_get_cb(key* k, val* v, void* arg) {
 	transaction* t;
+	flat_key_val* kv;
 	t = (transaction*)arg;
 	t->remote_count++;
-	add_to_set(t->rs, k, v);
+	kv = set_search(&t->rs, k);
+	if (kv != NULL && kv->vsize == VAL_NOT_KEPT)
+		check_reread(t, kv, v->version);
+	add_to_set(t, &t->rs, k, v, 1);
 	if (t->get_cb != NULL)
 		t->get_cb(k, v, t->cb_arg);
 }
 
 
-static void add_to_set(struct hashtable* h, key* k, val* v) {
-	int rv;
-	key* new_key;
-	flat_key_val* new_value;
+/*
+	Only the version of v is kept unless keep is set. A value larger than
+	the one already in the set gets new room in the arena.
+*/
+static void add_to_set(transaction* t, tr_set* s, key* k, val* v, int keep) {
+	unsigned int i;
+	int vsize, copied;
+	flat_key_hash kh;
+	tr_set_entry* e;
 	
-	new_value = hashtable_search(h, k);
-	if (new_value == NULL) {
-		new_key = key_new(k->data, k->size);
-		new_value = malloc(sizeof(flat_key_val) + k->size + v->size);
-		assert(new_value != NULL);
-		rv = hashtable_insert(h, new_key, new_value);
-		assert(rv != 0);
+	vsize = keep ? v->size : VAL_NOT_KEPT;
+	copied = (vsize == VAL_NOT_KEPT) ? 0 : vsize;
+	
+	key_hash_pair(k->data, k->size, kh.hash);
+	i = set_find(s, k, kh.hash[0]);
+	if (s->slots[i].gen == s->gen) {
+		e = &s->entries[s->slots[i].entry];
+		s->bytes -= ENTRY_BYTES(e->kv);
+		if (KV_ROOM(vsize) > KV_ROOM(e->kv->vsize))
+			e->kv = arena_alloc(t->mem, sizeof(flat_key_val) + k->size + KV_ROOM(vsize));
 	} else {
-		if ((k->size + v->size) != (new_value->ksize + new_value->vsize)) {
-			new_key = key_new(k->data, k->size);
-			new_value = hashtable_remove(h, k);
-			free(new_value);
-			new_value = malloc(sizeof(flat_key_val) + k->size + v->size);
-			assert(new_value != NULL);
-			rv = hashtable_insert(h, new_key, new_value);
-			assert(rv != 0);
+		if ((unsigned int)(s->count + 1) * 2 > s->mask + 1) {
+			set_grow(s);
+			i = set_find(s, k, kh.hash[0]);
 		}
+		s->slots[i].gen = s->gen;
+		s->slots[i].entry = s->count;
+		e = &s->entries[s->count++];
+		e->kh = kh;
+		e->kv = arena_alloc(t->mem, sizeof(flat_key_val) + k->size + KV_ROOM(vsize));
 	}
 	
-	new_value->ksize = k->size;
-	new_value->vsize = v->size;
-	memcpy(new_value->data, k->data, k->size);
-	memcpy(&new_value->data[k->size], v->data, v->size);
+	e->kv->ksize = k->size;
+	e->kv->vsize = vsize;
+	memcpy(e->kv->data, k->data, k->size);
+	if (vsize == VAL_NOT_KEPT)
+		memcpy(&e->kv->data[k->size], &v->version, sizeof(int));
+	else
+		memcpy(&e->kv->data[k->size], v->data, copied);
+	s->bytes += ENTRY_BYTES(e->kv);
+}
+
+
+static void set_init(tr_set* s) {
+	s->count = 0;
+	s->bytes = 0;
+	s->gen = 1;
+	s->mask = SET_INITIAL_SLOTS - 1;
+	s->slots = calloc(SET_INITIAL_SLOTS, sizeof(tr_set_slot));
+	s->entries = malloc((SET_INITIAL_SLOTS / 2) * sizeof(tr_set_entry));
+	assert(s->slots != NULL && s->entries != NULL);
+}
+
+
+static void set_free(tr_set* s) {
+	free(s->slots);
+	free(s->entries);
 }
 
 
-static int key_equal(void* k1, void* k2) {
-	key* a = (key*)k1;
-	key* b = (key*)k2;
+/*
+	Slots of older generations are empty. Once in four billion clears,
+	the generation wraps and the slots are actually zeroed.
+*/
+static void set_clear(tr_set* s) {
+	if (s->count == 0)
+		return;
+	s->count = 0;
+	s->bytes = 0;
+	if (++s->gen == 0) {
+		memset(s->slots, 0, (s->mask + 1) * sizeof(tr_set_slot));
+		s->gen = 1;
+	}
+}
+
+
+/*
+	Returns the slot of k, or the empty slot where it would go.
+*/
+static unsigned int set_find(tr_set* s, key* k, unsigned int h) {
+	unsigned int i;
+	tr_set_entry* e;
 	
-	if (a->size != b->size)
-		return 0;
+	i = h & s->mask;
+	while (s->slots[i].gen == s->gen) {
+		e = &s->entries[s->slots[i].entry];
+		if (e->kh.hash[0] == h && e->kv->ksize == k->size &&
+			memcmp(e->kv->data, k->data, k->size) == 0)
+			return i;
+		i = (i + 1) & s->mask;
+	}
+	return i;
+}
+
+
+static flat_key_val* set_search(tr_set* s, key* k) {
+	unsigned int i, h[2];
+	if (s->count == 0)
+		return NULL;
+	key_hash_pair(k->data, k->size, h);
+	i = set_find(s, k, h[0]);
+	if (s->slots[i].gen != s->gen)
+		return NULL;
+	return s->entries[s->slots[i].entry].kv;
+}
+
+
+/*
+	Doubles the slots, keeping at most one entry for two slots, and
+	indexes the entries again.
+*/
+static void set_grow(tr_set* s) {
+	int j;
+	unsigned int i, size;
 	
-	if (memcmp(a->data, b->data, a->size) == 0)
-		return 1;
+	size = (s->mask + 1) * 2;
+	free(s->slots);
+	s->slots = calloc(size, sizeof(tr_set_slot));
+	s->entries = realloc(s->entries, (size / 2) * sizeof(tr_set_entry));
+	assert(s->slots != NULL && s->entries != NULL);
+	s->mask = size - 1;
+	s->gen = 1;
 	
-	return 0;
+	for (j = 0; j < s->count; j++) {
+		i = s->entries[j].kh.hash[0] & s->mask;
+		while (s->slots[i].gen == s->gen)
+			i = (i + 1) & s->mask;
+		s->slots[i].gen = s->gen;
+		s->slots[i].entry = j;
+	}
 }
 
 
-static unsigned int hash_from_key(void* k) {
-	key* x = (key*)k;
-	if (x->size == sizeof(int))
-		return *((unsigned int*)x->data);
-	return joat_hash(x->data, x->size);
+static int range_cb(key* k, val* v, void* arg) {
+	range_scan* scan = (range_scan*)arg;
+	add_to_set(scan->t, &scan->t->rs, k, v, KEEP(v));
+	return scan->cb(k, v, scan->arg);
+}
+
+
+/*
+	The snapshot of a transaction is registered with the storage, so
+	that the versions it may read are not pruned.
+*/
+static void set_st(transaction* t) {
+	t->st = cproxy_current_st();
+	storage_snapshot_acquire(t->st);
 }
 
 
-static void free_key(void* k) {
-	key* x;
-	x = (key*)k;
-	key_free(x);
+static void reset_st(transaction* t) {
+	if (t->st != -1)
+		storage_snapshot_release(t->st);
+	t->st = -1;
+}
+
+
+/*
+	The certifier aborts a transaction that read a key written after its
+	snapshot, whatever its validation mode. Whether a snapshot is too old
+	depends on the certifier's mode and MaxPreviousST, not on ours, and is
+	left to the certifier.
+*/
+static int doomed(transaction* t) {
+	int i;
+	
+	if (t->lost_read)
+		return 1;
+	if (t->st == -1)
+		return 0;
+	for (i = 0; i < t->rs.count; i++)
+		if (recent_writes_after(t->rs.entries[i].kh.hash, t->st))
+			return 1;
+	return 0;
+}
+
+
+/*
+	A value not kept in the read set is read again at the snapshot of t,
+	which must return the version read the first time.
+*/
+static void check_reread(transaction* t, flat_key_val* kv, int version) {
+	int first;
+	memcpy(&first, &kv->data[kv->ksize], sizeof(int));
+	if (version != first)
+		t->lost_read = 1;
 }
@@ -25,23 +25,56 @@ extern "C" {
 #endif
 
 #include "dsmDB_priv.h"
-#include "hashtable.h"
+#include "arena.h"
 #include "cproxy.h"
 
 typedef void(*transaction_cb)(key*, val*, void*);
 
+typedef int(*transaction_range_cb)(key*, val*, void*);
+
+typedef void(*transaction_remote_get)(key*, int, transaction_cb, void*);
+
+/*
+	Read and write sets: open addressing tables over a dense array of
+	entries, whose keys and values are copied in the arena of their
+	transaction. A set is cleared in place by bumping its generation,
+	which empties all slots at once. Entries keep the hash pair sent to
+	the certifier; the read set keeps only the small values.
+*/
+typedef struct tr_set_slot_t {
+	unsigned int gen;
+	int entry;
+} tr_set_slot;
+
+typedef struct tr_set_entry_t {
+	flat_key_hash kh;
+	flat_key_val* kv;
+} tr_set_entry;
+
+typedef struct tr_set_t {
+	int count;
+	int bytes;
+	unsigned int mask;
+	unsigned int gen;
+	tr_set_slot* slots;
+	tr_set_entry* entries;
+} tr_set;
+
 typedef struct transaction_t {
     int   st;
     tr_id id;
 	short seqn;
 	int remote_count;
-    struct hashtable* rs;
-    struct hashtable* ws;
+    tr_set rs;
+    tr_set ws;
+    arena* mem;
 	transaction_cb get_cb;
 	transaction_cb put_cb;
 	void* cb_arg;
 	val* cb_val;
 	int never_set;
+	int ranged;		// a range scan was done, see transaction_range
+	int lost_read;	// a read could not be repeated, see transaction_get
 } transaction;
 
 
@@ -54,20 +87,80 @@ void transaction_clear_readset(transaction* t);
 
 void transaction_destroy(transaction* t);
 
+/*
+	Returns a copy of the value of k at the snapshot of t, adding k to
+	the read set. Reading k again returns the same value: the read set
+	keeps small values and those fetched remotely, larger ones found in
+	the storage are read again from it. If the storage no longer has the
+	version read the first time, t is no longer read-only and
+	transaction_commit aborts it.
+*/
 val* transaction_get(transaction* t, key* k);
 
+/*
+	Like transaction_get, but fills w with a view of the value, to be
+	released with transaction_view_release. Returns 0 if a remote get
+	was issued, as transaction_get returning NULL.
+*/
+int transaction_get_view(transaction* t, key* k, val_view* w);
+
+void transaction_view_release(val_view* w);
+
 int transaction_put(transaction* t, key* k, val* v);
 
+/*
+	Deletes k by putting a tombstone, an empty value, which is certified
+	as any other write and then read as a missing key.
+*/
+int transaction_delete(transaction* t, key* k);
+
+/*
+	Calls cb with the local keys in [start, end) and their values at the
+	snapshot of t (see storage_range), adding them to the read set.
+	Range scans are only serializable in read-only transactions, which
+	commit at their snapshot without certification: the certifier checks
+	the keys read, not the ranges, and would miss a key inserted in
+	[start, end) by a concurrent transaction. Returns the number of keys,
+	or -1 if the storage keeps no ordered index or t already wrote, and
+	transaction_commit refuses t if it writes after a range scan.
+*/
+int transaction_range(transaction* t, key* start, key* end, transaction_range_cb cb, void* arg);
+
+/*
+	Submits t to the certifier; cb is called with its outcome. Returns
+	T_ABORTED, without calling cb, if t is certain to be aborted by the
+	certifier (see recent_writes.h), and -1 on errors or if t did a range
+	scan.
+*/
 int transaction_commit(transaction* t, int id, cproxy_commit_cb cb);
 
 int transaction_read_only(transaction* t);
 
+/*
+	Writes the tr_submit_msg of t in msg, in a single pass over its sets.
+	Returns its size, transaction_serialized_size(t), or -1 if that is
+	larger than max_size.
+*/
 int transaction_serialize(transaction* t, tr_submit_msg* msg, int max_size);
 
+int transaction_serialized_size(transaction* t);
+
 void transaction_set_get_cb(transaction* t, transaction_cb cb, void* arg);
 
 int transaction_remote_count(transaction* t);
 
+/*
+	Returns the number of transactions aborted by transaction_commit
+	without reaching the certifier.
+*/
+long transaction_local_abort_count();
+
+/*
+	Issues the gets of keys missing in the storage through f instead of
+	remote_get, or again through remote_get if f is NULL. For tests.
+*/
+void transaction_set_remote_get(transaction_remote_get f);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,464 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "vset.h"
+#include "slab.h"
+#include "config.h"
+
+#include <zlib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+
+static vset_ops* impls[] = {
+	&vset_list_ops,
+	&vset_array_ops,
+	&vset_array_sorted_ops,
+	&vset_array_cache_ops,
+	&vset_compact_ops
+};
+
+
+#define OPS (impls[StorageVsetType])
+
+
+/*
+	While StorageCompressThreshold is set, values larger than
+	VAL_UNTAGGED_MAX are stored behind a one byte tag: VAL_RAW values
+	follow as they are, VAL_ZLIB values are their original size followed
+	by the deflated bytes. Smaller values are never compressed and are
+	stored as they are, so they still fit inline in the compact vset.
+	Recently decompressed values are kept in a few hot slots, shared by
+	the views pointing to them.
+*/
+#define VAL_RAW  0
+#define VAL_ZLIB 1
+#define VAL_UNTAGGED_MAX 16
+#define TAGGED(size) ((size) > VAL_UNTAGGED_MAX)
+#define ZLIB_HEADER (1 + (int)sizeof(int))
+#define COMPRESS_LEVEL Z_BEST_SPEED
+
+#define HOT_SLOTS 8
+#define HOT_MAX_SIZE (64*1024)
+
+typedef struct hot_slot_t {
+	vset s;
+	int version;
+	int size;
+	int refs;
+	long used;
+	int capacity;
+	char* data;
+} hot_slot;
+
+static hot_slot hot[HOT_SLOTS];
+static long hot_clock = 0;
+static char* scratch = NULL;
+static int scratch_size = 0;
+
+static long compressed_values = 0;
+static long compress_bytes_in = 0;
+static long compress_bytes_out = 0;
+static long compress_usecs = 0;
+static long decompress_usecs = 0;
+static long hot_hits = 0;
+
+static int compressing();
+static val* encode(val* v);
+static char* decode(vset s, int version, char* data, int size, int* dsize, hot_slot** slot);
+static val* get_decode(vset s, val* v);
+static void view_decode(vset s, val_view* w);
+static hot_slot* hot_find(vset s, int version);
+static hot_slot* hot_take(int size);
+static void hot_invalidate(vset s);
+static char* scratch_reserve(int size);
+static long usecs_since(struct timeval* start);
+
+
+const char* vset_name() {
+	return OPS->name;
+}
+
+
+int vset_sizeof() {
+	return OPS->size;
+}
+
+
+int vset_alignof() {
+	return OPS->align;
+}
+
+
+void vset_init(vset s) {
+	OPS->init(s);
+}
+
+
+void vset_destroy(vset s) {
+	if (compressing())
+		hot_invalidate(s);
+	OPS->destroy(s);
+}
+
+
+vset vset_new() {
+	vset s;
+	s = slab_alloc(OPS->size);
+	if (s == NULL) return NULL;
+	OPS->init(s);
+	return s;
+}
+
+
+void vset_free(vset s) {
+	if (compressing())
+		hot_invalidate(s);
+	OPS->destroy(s);
+	slab_free(s, OPS->size);
+}
+
+
+int vset_add(vset s, val* v) {
+	int rv;
+	val* e;
+	if (!compressing() || !TAGGED(v->size))
+		return OPS->add(s, v);
+	
+	hot_invalidate(s);
+	e = encode(v);
+	rv = OPS->add(s, e);
+	DB_FREE(e);
+	return rv;
+}
+
+
+val* vset_get(vset s, int v) {
+	val* x = OPS->get(s, v);
+	if (x == NULL || !compressing() || !TAGGED(x->size))
+		return x;
+	return get_decode(s, x);
+}
+
+
+/*
+	Implementations without a view operation hand out a copy.
+*/
+int vset_view(vset s, int v, val_view* w) {
+	w->copy = NULL;
+	w->epoch = NULL;
+	w->hot = NULL;
+	if (OPS->view != NULL) {
+		if (!OPS->view(s, v, w))
+			return 0;
+	} else {
+		if ((w->copy = OPS->get(s, v)) == NULL)
+			return 0;
+		w->size = w->copy->size;
+		w->version = w->copy->version;
+		w->data = w->copy->data;
+	}
+	if (compressing() && TAGGED(w->size))
+		view_decode(s, w);
+	return 1;
+}
+
+
+void vset_view_release(val_view* w) {
+	if (w->copy != NULL)
+		val_free(w->copy);
+	if (w->epoch != NULL)
+		slab_epoch_exit(w->epoch);
+	if (w->hot != NULL)
+		((hot_slot*)w->hot)->refs--;
+	w->copy = NULL;
+	w->epoch = NULL;
+	w->hot = NULL;
+}
+
+
+int vset_allocated_bytes(vset s) {
+	return OPS->allocated_bytes(s);
+}
+
+
+int vset_count(vset s) {
+	return OPS->count(s);
+}
+
+
+int vset_prune(vset s, int version) {
+	return OPS->prune(s, version);
+}
+
+
+long vset_compressed_count() {
+	return compressed_values;
+}
+
+
+long vset_compress_bytes_in() {
+	return compress_bytes_in;
+}
+
+
+long vset_compress_bytes_out() {
+	return compress_bytes_out;
+}
+
+
+long vset_compress_usecs() {
+	return compress_usecs;
+}
+
+
+long vset_decompress_usecs() {
+	return decompress_usecs;
+}
+
+
+long vset_hot_hit_count() {
+	return hot_hits;
+}
+
+
+static int compressing() {
+	return StorageCompressThreshold > 0;
+}
+
+
+/*
+	Returns the tagged copy of v to be stored, as a single allocation
+	freed with DB_FREE. v is compressed if it is large enough, and if
+	that saves at least the configured share of its size; a compressed
+	value must stay tagged, larger than VAL_UNTAGGED_MAX.
+*/
+static val* encode(val* v) {
+	int rv, max;
+	uLongf len;
+	val* e;
+	struct timeval start;
+	
+	e = DB_MALLOC(sizeof(val) + ZLIB_HEADER + compressBound(v->size));
+	e->data = (char*)e + sizeof(val);
+	e->version = v->version;
+	
+	if (v->size >= StorageCompressThreshold) {
+		gettimeofday(&start, NULL);
+		len = compressBound(v->size);
+		rv = compress2((Bytef*)e->data + ZLIB_HEADER, &len, v->data, v->size,
+			COMPRESS_LEVEL);
+		compress_usecs += usecs_since(&start);
+		max = (int)(((long)v->size * StorageCompressMaxPercent) / 100);
+		compress_bytes_in += v->size;
+		if (rv == Z_OK && ZLIB_HEADER + (int)len <= max &&
+			TAGGED(ZLIB_HEADER + (int)len)) {
+			((char*)e->data)[0] = VAL_ZLIB;
+			memcpy((char*)e->data + 1, &v->size, sizeof(int));
+			e->size = ZLIB_HEADER + len;
+			compress_bytes_out += e->size;
+			compressed_values++;
+			return e;
+		}
+		compress_bytes_out += v->size + 1;
+	}
+	
+	((char*)e->data)[0] = VAL_RAW;
+	memcpy((char*)e->data + 1, v->data, v->size);
+	e->size = v->size + 1;
+	return e;
+}
+
+
+/*
+	Returns the original bytes of a stored value, and their size in
+	dsize. Decompressed values are placed in a hot slot, returned in
+	slot, if one is free; otherwise they are only valid until the next
+	call. Returns NULL if the value cannot be decompressed.
+*/
+static char* decode(vset s, int version, char* data, int size, int* dsize, hot_slot** slot) {
+	int osize;
+	char* out;
+	uLongf len;
+	struct timeval start;
+	
+	*slot = NULL;
+	if (data[0] == VAL_RAW) {
+		*dsize = size - 1;
+		return data + 1;
+	}
+	
+	memcpy(&osize, data + 1, sizeof(int));
+	*dsize = osize;
+	if ((*slot = hot_find(s, version)) != NULL) {
+		hot_hits++;
+		return (*slot)->data;
+	}
+	
+	if ((*slot = hot_take(osize)) != NULL)
+		out = (*slot)->data;
+	else
+		out = scratch_reserve(osize);
+	
+	gettimeofday(&start, NULL);
+	len = osize;
+	if (uncompress((Bytef*)out, &len, (Bytef*)data + ZLIB_HEADER,
+			size - ZLIB_HEADER) != Z_OK || (int)len != osize) {
+		*slot = NULL;
+		return NULL;
+	}
+	decompress_usecs += usecs_since(&start);
+	
+	if (*slot != NULL) {
+		(*slot)->s = s;
+		(*slot)->version = version;
+		(*slot)->size = osize;
+	}
+	return out;
+}
+
+
+static val* get_decode(vset s, val* v) {
+	int size;
+	char* data;
+	val* d;
+	hot_slot* slot;
+	
+	if (((char*)v->data)[0] == VAL_RAW) {
+		memmove(v->data, (char*)v->data + 1, v->size - 1);
+		v->size--;
+		return v;
+	}
+	
+	data = decode(s, v->version, v->data, v->size, &size, &slot);
+	d = (data == NULL) ? NULL : versioned_val_new(data, size, v->version);
+	val_free(v);
+	return d;
+}
+
+
+/*
+	Points the view to the original bytes of the value. A decompressed
+	value is either held in a hot slot until the view is released, or
+	copied when no slot is free.
+*/
+static void view_decode(vset s, val_view* w) {
+	int size, version;
+	char* data;
+	val* copy = NULL;
+	hot_slot* slot;
+	
+	if (w->data[0] == VAL_RAW) {
+		w->data++;
+		w->size--;
+		return;
+	}
+	
+	version = w->version;
+	data = decode(s, version, w->data, w->size, &size, &slot);
+	if (data != NULL && slot == NULL)
+		copy = versioned_val_new(data, size, version);
+	vset_view_release(w);
+	w->version = version;
+	if (data == NULL) {
+		w->size = 0;
+		return;
+	}
+	
+	w->size = size;
+	if (slot != NULL) {
+		slot->refs++;
+		w->hot = slot;
+		w->data = slot->data;
+	} else {
+		w->copy = copy;
+		w->data = copy->data;
+	}
+}
+
+
+static hot_slot* hot_find(vset s, int version) {
+	int i;
+	for (i = 0; i < HOT_SLOTS; i++) {
+		if (hot[i].s == s && hot[i].version == version) {
+			hot[i].used = ++hot_clock;
+			return &hot[i];
+		}
+	}
+	return NULL;
+}
+
+
+/*
+	Returns the least recently used slot no view points to, with room
+	for size bytes, or NULL if there is none or the value is too large.
+*/
+static hot_slot* hot_take(int size) {
+	int i;
+	hot_slot* slot = NULL;
+	
+	if (size > HOT_MAX_SIZE)
+		return NULL;
+	for (i = 0; i < HOT_SLOTS; i++) {
+		if (hot[i].refs == 0 && (slot == NULL || hot[i].used < slot->used))
+			slot = &hot[i];
+	}
+	if (slot == NULL)
+		return NULL;
+	
+	slot->s = NULL;
+	slot->used = ++hot_clock;
+	if (slot->capacity < size) {
+		free(slot->data);
+		slot->data = malloc(size);
+		slot->capacity = size;
+	}
+	return slot;
+}
+
+
+/*
+	Slots of s are no longer found, but stay valid for the views still
+	pointing to them.
+*/
+static void hot_invalidate(vset s) {
+	int i;
+	for (i = 0; i < HOT_SLOTS; i++)
+		if (hot[i].s == s)
+			hot[i].s = NULL;
+}
+
+
+static char* scratch_reserve(int size) {
+	if (scratch_size < size) {
+		free(scratch);
+		scratch = malloc(size);
+		scratch_size = size;
+	}
+	return scratch;
+}
+
+
+static long usecs_since(struct timeval* start) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000000L +
+		(now.tv_usec - start->tv_usec);
+}
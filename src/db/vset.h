@@ -42,15 +42,18 @@ extern "C" {
 
 
 /**
-	Use the #define below to switch between different implementations
- 	of vset. Three implementations are currently supported:
+	The implementation is selected at startup with StorageVsetType:
 
-	USE_VSET_LIST
-	USE_VSET_ARRAY
-	USE_VSET_ARRAY_SORTED
-	USE_VSET_ARRAY_CACHE
+	VSET_LIST
+	VSET_ARRAY
+	VSET_ARRAY_SORTED
+	VSET_ARRAY_CACHE
+	VSET_COMPACT
+
+	A vset can be embedded in another structure (e.g. a key entry): it
+	then takes vset_sizeof() bytes, aligned to vset_alignof(), set up
+	with vset_init() and released with vset_destroy().
 */
-#define USE_VSET_ARRAY_CACHE
 
 
 /**
@@ -59,6 +62,62 @@ extern "C" {
 typedef struct vset_t* vset;
 
 
+/**
+	Operations of a vset implementation. size and align are those of the
+	part of the vset embedded in its owner.
+*/
+typedef struct vset_ops_t {
+	const char* name;
+	int size;
+	int align;
+	void (*init)(vset s);
+	void (*destroy)(vset s);
+	int (*add)(vset s, val* v);
+	val* (*get)(vset s, int v);
+	int (*allocated_bytes)(vset s);
+	int (*count)(vset s);
+	int (*prune)(vset s, int version);
+	int (*view)(vset s, int v, val_view* w);
+} vset_ops;
+
+extern vset_ops vset_list_ops;
+extern vset_ops vset_array_ops;
+extern vset_ops vset_array_sorted_ops;
+extern vset_ops vset_array_cache_ops;
+extern vset_ops vset_compact_ops;
+
+/* The compact vset counts versions in a byte */
+#define VSET_COMPACT_MAX_VERSIONS 255
+
+
+/**
+	Returns the name of the implementation in use.
+*/
+const char* vset_name();
+
+
+/**
+	Returns the number of bytes, and their alignment, taken by a vset
+	embedded in another structure.
+*/
+int vset_sizeof();
+
+int vset_alignof();
+
+
+/**
+	Initializes an empty vset in vset_sizeof() bytes of memory at s.
+*/
+void vset_init(vset s);
+
+
+/**
+	Releases the versions of a vset initialized with vset_init(), but
+	not the memory at s.
+*/
+void vset_destroy(vset s);
+
+
 /**
 	Creates a new vset. 
 */
@@ -85,6 +144,17 @@ int vset_add(vset s, val* v);
 val* vset_get(vset s, int v);
 
 
+/**
+	Like vset_get(), but fills w with a view of the value instead of
+	copying it, when the implementation supports it. Returns 1 if the
+	value exists, 0 otherwise. The view must be released with
+	vset_view_release().
+*/
+int vset_view(vset s, int v, val_view* w);
+
+void vset_view_release(val_view* w);
+
+
 /**
 	Returns the total amount of bytes allocated by this vset.
 */
@@ -97,6 +167,34 @@ int vset_allocated_bytes(vset s);
 int vset_count(vset s);
 
 
+/**
+	Drops the versions older than the newest version smaller or equal
+	to the given one, which no reader at that version or later can get.
+	Returns the number of versions dropped.
+*/
+int vset_prune(vset s, int version);
+
+
+/**
+	Compression counters, when StorageCompressThreshold is set: values
+	stored compressed, bytes of the values large enough to be compressed
+	and the bytes they take once stored, time spent compressing and
+	decompressing in microseconds, and decompressions avoided by hits in
+	the hot buffer.
+*/
+long vset_compressed_count();
+
+long vset_compress_bytes_in();
+
+long vset_compress_bytes_out();
+
+long vset_compress_usecs();
+
+long vset_decompress_usecs();
+
+long vset_hot_hit_count();
+
+
 #ifdef __cplusplus
 }
 #endif
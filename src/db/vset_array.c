@@ -18,8 +18,7 @@
 */
 
 #include "vset.h"
-
-#ifdef USE_VSET_ARRAY
+#include "slab.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -46,31 +45,26 @@ static void val_entry_free(vset s, val_entry* v);
 static int find_index(vset s, int version);
 
 
-vset vset_new() {
+static void array_init(vset s) {
 	int i;
-	vset s;
-	s = malloc(sizeof(struct vset_t));
-	if (s == NULL) return NULL;
-	s->versions = malloc(sizeof(val_entry*) * StorageMaxOldVersions);
-	if (s->versions == NULL) {free(s); return NULL;}
+	s->versions = slab_alloc(sizeof(val_entry*) * StorageMaxOldVersions);
 	for (i = 0; i < StorageMaxOldVersions; i++)
 		s->versions[i] = NULL;
 	s->size = sizeof(struct vset_t) + (sizeof(val_entry*) * StorageMaxOldVersions);
 	s->count = 0;
-	return s;
 }
 
 
-void vset_free(vset s) {
+static void array_destroy(vset s) {
 	int i;
 	for (i = 0; i < StorageMaxOldVersions; i++)
-		free(s->versions[i]);
-	free(s->versions);
-	free(s);
+		if (s->versions[i] != NULL)
+			slab_free(s->versions[i], sizeof(val_entry) + s->versions[i]->size);
+	slab_free(s->versions, sizeof(val_entry*) * StorageMaxOldVersions);
 }
 
 
-int vset_add(vset s, val* v) {
+static int array_add(vset s, val* v) {
 	int i;
 	i = find_index(s, v->version);
 	if (s->versions[i] == NULL) {
@@ -87,7 +81,7 @@ int vset_add(vset s, val* v) {
 }
 
 
-val* vset_get(vset s, int version) {
+static val* array_get(vset s, int version) {
 	val_entry* v = NULL;
 	int i, smallest = -1, smallest_index = -1;	
 	for (i = 0; i < StorageMaxOldVersions; i++) {
@@ -105,19 +99,58 @@ val* vset_get(vset s, int version) {
 }
 
 
-int vset_allocated_bytes(vset s) {
+static int array_allocated_bytes(vset s) {
 	return s->size;
 }
 
 
-int vset_count(vset s) {
+static int array_count(vset s) {
 	return s->count;
 }
 
 
+static int array_prune(vset s, int version) {
+	int i, n = 0, newest = INT_MIN;
+	val_entry* v;
+	
+	for (i = 0; i < StorageMaxOldVersions; i++) {
+		v = s->versions[i];
+		if (v != NULL && v->version <= version && v->version > newest)
+			newest = v->version;
+	}
+	if (newest == INT_MIN)
+		return 0;
+	
+	for (i = 0; i < StorageMaxOldVersions; i++) {
+		v = s->versions[i];
+		if (v != NULL && v->version < newest) {
+			val_entry_free(s, v);
+			s->versions[i] = NULL;
+			n++;
+		}
+	}
+	return n;
+}
+
+
+vset_ops vset_array_ops = {
+	"array",
+	sizeof(struct vset_t),
+	__alignof__(struct vset_t),
+	array_init,
+	array_destroy,
+	array_add,
+	array_get,
+	array_allocated_bytes,
+	array_count,
+	array_prune,
+	NULL
+};
+
+
 static val_entry* val_entry_new(vset s, int size) {
 	val_entry* v;
-	v = malloc(sizeof(val_entry) + size);
+	v = slab_alloc(sizeof(val_entry) + size);
 	if (v == NULL) return NULL;
 	v->size = size;
 	s->size += size;
@@ -129,7 +162,7 @@ static val_entry* val_entry_new(vset s, int size) {
 static void val_entry_free(vset s, val_entry* v) {
 	s->size -= (sizeof(val_entry) + v->size);
 	s->count--;
-	free(v);
+	slab_free(v, sizeof(val_entry) + v->size);
 }
 
 // returns either:
@@ -155,5 +188,3 @@ static int find_index(vset s, int version) {
 	}
 	return oldest_index;
 }
-
-#endif
@@ -18,8 +18,7 @@
 */
 
 #include "vset.h"
-
-#ifdef USE_VSET_ARRAY_CACHE
+#include "slab.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -36,29 +35,29 @@ typedef struct __attribute__ ((packed)) val_entry_t {
 
 struct __attribute__ ((packed)) vset_t  {
 	uint16_t count;
-	val_entry versions[0];
+	val_entry* versions;
 };
 
 
-vset vset_new() {
-	vset s;
-	int size;
-	size = (sizeof(struct vset_t) + (sizeof(val_entry) * StorageMaxOldVersions));
-	s = malloc(size);
+#define VERSIONS_SIZE (sizeof(val_entry) * StorageMaxOldVersions)
+#define VSET_SIZE (sizeof(struct vset_t) + VERSIONS_SIZE)
+
+
+static void cache_init(vset s) {
+	s->versions = slab_alloc(VERSIONS_SIZE);
 	s->count = 0;
-	return s;
 }
 
 
-void vset_free(vset s) {
+static void cache_destroy(vset s) {
 	int i;
 	for (i = 0; i < s->count; i++)
-		free(s->versions[i].data);
-	free(s);
+		slab_free(s->versions[i].data, s->versions[i].size);
+	slab_free(s->versions, VERSIONS_SIZE);
 }
 
 
-int vset_add(vset s, val* v) {
+static int cache_add(vset s, val* v) {
 	int i = 0;
 	val_entry ventry;
 	
@@ -70,7 +69,7 @@ int vset_add(vset s, val* v) {
 	if (s->count >= StorageMaxOldVersions) {
 		s->count--;
 		if (s->versions[s->count].size != v->size) {
-			free(s->versions[s->count].data);
+			slab_free(s->versions[s->count].data, s->versions[s->count].size);
 		} else {
 			ventry.data = s->versions[s->count].data;
 		}
@@ -78,7 +77,7 @@ int vset_add(vset s, val* v) {
 	}
 	
 	if (ventry.data == NULL) {
-		ventry.data = malloc(v->size);
+		ventry.data = slab_alloc(v->size);
 	}
 	memcpy(ventry.data, v->data, v->size);
 	
@@ -90,7 +89,7 @@ int vset_add(vset s, val* v) {
 			return 0;
 		}
 		if (ventry.version == s->versions[i].version) {
-			free(s->versions[i].data);
+			slab_free(s->versions[i].data, s->versions[i].size);
 			s->versions[i] = ventry;		
 			return 0;
 		}
@@ -103,7 +102,7 @@ int vset_add(vset s, val* v) {
 }
 
 
-val* vset_get(vset s, int v) {
+static val* cache_get(vset s, int v) {
 	int i;
 	for (i = 0; i < s->count; i++) {
 		if (s->versions[i].version <= v)
@@ -115,9 +114,9 @@ val* vset_get(vset s, int v) {
 }
 
 
-int vset_allocated_bytes(vset s) {
+static int cache_allocated_bytes(vset s) {
 	int i;
-	int bytes = (sizeof(struct vset_t) + (sizeof(val_entry) * StorageMaxOldVersions));
+	int bytes = VSET_SIZE;
 	for (i = 0; i < s->count; i++) {
 		bytes += s->versions[i].size;
 	}
@@ -125,8 +124,40 @@ int vset_allocated_bytes(vset s) {
 }
 
 
-int vset_count(vset s) {
+static int cache_count(vset s) {
 	return s->count;
 }
 
-#endif
+
+static int cache_prune(vset s, int version) {
+	int i, n;
+	
+	for (i = 0; i < s->count; i++)
+		if (s->versions[i].version <= version)
+			break;
+	if (i == s->count)
+		return 0;
+	
+	n = s->count - (i + 1);
+	while (s->count > i + 1) {
+		s->count--;
+		slab_free(s->versions[s->count].data, s->versions[s->count].size);
+		s->versions[s->count].data = NULL;
+	}
+	return n;
+}
+
+
+vset_ops vset_array_cache_ops = {
+	"array_cache",
+	sizeof(struct vset_t),
+	__alignof__(struct vset_t),
+	cache_init,
+	cache_destroy,
+	cache_add,
+	cache_get,
+	cache_allocated_bytes,
+	cache_count,
+	cache_prune,
+	NULL
+};
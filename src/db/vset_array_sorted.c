@@ -18,8 +18,7 @@
 */
 
 #include "vset.h"
-
-#ifdef USE_VSET_ARRAY_SORTED
+#include "slab.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -37,7 +36,7 @@ typedef struct val_entry_t {
 struct vset_t {
 	uint16_t size;
 	uint16_t count;
-	val_entry* versions[0];
+	val_entry** versions;
 };
 
 
@@ -45,26 +44,25 @@ static val_entry* val_entry_new(vset s, int size);
 static void val_entry_free(vset s, val_entry* v);
 
 
-vset vset_new() {
-	vset s;
-	int size;
-	size = (sizeof(struct vset_t) + (sizeof(val_entry*) * StorageMaxOldVersions));
-	s = malloc(size);
-	s->size = size;
+#define VERSIONS_SIZE (sizeof(val_entry*) * StorageMaxOldVersions)
+
+
+static void sorted_init(vset s) {
+	s->versions = slab_alloc(VERSIONS_SIZE);
+	s->size = sizeof(struct vset_t) + VERSIONS_SIZE;
 	s->count = 0;
-	return s;
 }
 
 
-void vset_free(vset s) {
+static void sorted_destroy(vset s) {
 	int i;
 	for (i = 0; i < s->count; i++)
-		free(s->versions[i]);
-	free(s);
+		slab_free(s->versions[i], sizeof(val_entry) + s->versions[i]->size);
+	slab_free(s->versions, VERSIONS_SIZE);
 }
 
 
-int vset_add(vset s, val* v) {
+static int sorted_add(vset s, val* v) {
 	int i = 0;
 	val_entry* ventry = NULL;
 	
@@ -106,7 +104,7 @@ int vset_add(vset s, val* v) {
 }
 
 
-val* vset_get(vset s, int v) {
+static val* sorted_get(vset s, int v) {
 	int i;
 	val_entry* ventry = NULL;
 	for (i = 0; i < s->count; i++) {
@@ -118,19 +116,53 @@ val* vset_get(vset s, int v) {
 }
 
 
-int vset_allocated_bytes(vset s) {
+static int sorted_allocated_bytes(vset s) {
 	return s->size;
 }
 
 
-int vset_count(vset s) {
+static int sorted_count(vset s) {
 	return s->count;
 }
 
 
+static int sorted_prune(vset s, int version) {
+	int i, n;
+	
+	for (i = 0; i < s->count; i++)
+		if (s->versions[i]->version <= version)
+			break;
+	if (i == s->count)
+		return 0;
+	
+	n = s->count - (i + 1);
+	while (s->count > i + 1) {
+		s->count--;
+		val_entry_free(s, s->versions[s->count]);
+		s->versions[s->count] = NULL;
+	}
+	return n;
+}
+
+
+vset_ops vset_array_sorted_ops = {
+	"array_sorted",
+	sizeof(struct vset_t),
+	__alignof__(struct vset_t),
+	sorted_init,
+	sorted_destroy,
+	sorted_add,
+	sorted_get,
+	sorted_allocated_bytes,
+	sorted_count,
+	sorted_prune,
+	NULL
+};
+
+
 static val_entry* val_entry_new(vset s, int size) {
 	val_entry* v;
-	v = malloc(sizeof(val_entry) + size);
+	v = slab_alloc(sizeof(val_entry) + size);
 	if (v == NULL) return NULL;
 	v->size = size;
 	s->size += size;
@@ -140,7 +172,5 @@ static val_entry* val_entry_new(vset s, int size) {
 
 static void val_entry_free(vset s, val_entry* v) {
 	s->size -= (sizeof(val_entry) + v->size);
-	free(v);
+	slab_free(v, sizeof(val_entry) + v->size);
 }
-
-#endif
@@ -0,0 +1,258 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "vset.h"
+#include "slab.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+
+/*
+	Compact vset. A key with a single version keeps it in the vset itself,
+	which is embedded in the key entry, and values up to VSET_INLINE bytes
+	are stored in place of the pointer to their data. A second version
+	moves the versions to an array sorted by decreasing version, grown
+	geometrically up to StorageMaxOldVersions entries.
+*/
+
+#define VSET_INLINE 8
+
+_Static_assert(VSET_COMPACT_MAX_VERSIONS <= UINT8_MAX,
+	"count and cap of the compact vset are bytes");
+
+
+typedef struct __attribute__ ((packed)) val_entry_t {
+	int version;
+	uint32_t size;
+	union {
+		char bytes[VSET_INLINE];
+		char* ptr;
+	} data;
+} val_entry;
+
+
+struct __attribute__ ((packed)) vset_t {
+	uint8_t count;
+	uint8_t cap;
+	union {
+		val_entry one;
+		val_entry* many;
+	} v;
+};
+
+
+#define ENTRY_DATA(e) ((e)->size <= VSET_INLINE ? (e)->data.bytes : (e)->data.ptr)
+#define VERSIONS(s) ((s)->cap == 0 ? &(s)->v.one : (s)->v.many)
+#define CAPACITY(s) ((s)->cap == 0 ? 1 : (s)->cap)
+
+
+static void entry_set(val_entry* e, val* v) {
+	e->version = v->version;
+	e->size = v->size;
+	if (v->size > VSET_INLINE)
+		e->data.ptr = slab_alloc(v->size);
+	memcpy(ENTRY_DATA(e), v->data, v->size);
+}
+
+
+/*
+	Out of line data may still be referenced by a view, see compact_view.
+*/
+static void entry_clear(val_entry* e) {
+	if (e->size > VSET_INLINE)
+		slab_free_deferred(e->data.ptr, e->size);
+}
+
+
+static void entry_replace(val_entry* e, val* v) {
+	if (e->size == v->size && v->size <= VSET_INLINE) {
+		e->version = v->version;
+		memcpy(ENTRY_DATA(e), v->data, v->size);
+		return;
+	}
+	entry_clear(e);
+	entry_set(e, v);
+}
+
+
+static void grow(vset s) {
+	int cap;
+	val_entry* many;
+	
+	cap = (s->cap == 0) ? 2 : 2 * s->cap;
+	if (cap > StorageMaxOldVersions)
+		cap = StorageMaxOldVersions;
+	assert(cap <= VSET_COMPACT_MAX_VERSIONS);
+	
+	many = slab_alloc(cap * sizeof(val_entry));
+	if (s->cap == 0) {
+		many[0] = s->v.one;
+	} else {
+		memcpy(many, s->v.many, s->count * sizeof(val_entry));
+		slab_free(s->v.many, s->cap * sizeof(val_entry));
+	}
+	s->v.many = many;
+	s->cap = cap;
+}
+
+
+static void compact_init(vset s) {
+	s->count = 0;
+	s->cap = 0;
+}
+
+
+static void compact_destroy(vset s) {
+	int i;
+	val_entry* e = VERSIONS(s);
+	for (i = 0; i < s->count; i++)
+		entry_clear(&e[i]);
+	if (s->cap > 0)
+		slab_free(s->v.many, s->cap * sizeof(val_entry));
+}
+
+
+static int compact_add(vset s, val* v) {
+	int i;
+	val_entry* e;
+	
+	e = VERSIONS(s);
+	for (i = 0; i < s->count; i++) {
+		if (e[i].version == v->version) {
+			entry_replace(&e[i], v);
+			return 0;
+		}
+	}
+	
+	// Delete the oldest value, or make room for a new one
+	if (s->count >= StorageMaxOldVersions) {
+		s->count--;
+		entry_clear(&e[s->count]);
+	} else if (s->count == CAPACITY(s)) {
+		grow(s);
+		e = VERSIONS(s);
+	}
+	
+	for (i = 0; i < s->count && e[i].version > v->version; i++);
+	memmove(&e[i+1], &e[i], (s->count - i) * sizeof(val_entry));
+	entry_set(&e[i], v);
+	s->count++;
+	return 0;
+}
+
+
+static val* compact_get(vset s, int v) {
+	int i;
+	val_entry* e = VERSIONS(s);
+	for (i = 0; i < s->count; i++) {
+		if (e[i].version <= v)
+			return versioned_val_new(ENTRY_DATA(&e[i]), e[i].size, e[i].version);
+	}
+	return NULL;
+}
+
+
+/*
+	Inline values are copied into the view, as they live in the key entry.
+	Out of line values are borrowed: the view enters a slab epoch, which
+	keeps their data around until the view is released.
+*/
+static int compact_view(vset s, int v, val_view* w) {
+	int i;
+	val_entry* e = VERSIONS(s);
+	for (i = 0; i < s->count; i++) {
+		if (e[i].version <= v) {
+			w->size = e[i].size;
+			w->version = e[i].version;
+			if (e[i].size <= VSET_INLINE) {
+				memcpy(w->bytes, e[i].data.bytes, e[i].size);
+				w->data = w->bytes;
+			} else {
+				w->data = e[i].data.ptr;
+				w->epoch = slab_epoch_enter();
+			}
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+static int compact_allocated_bytes(vset s) {
+	int i, bytes;
+	val_entry* e = VERSIONS(s);
+	
+	bytes = sizeof(struct vset_t) + s->cap * sizeof(val_entry);
+	for (i = 0; i < s->count; i++)
+		if (e[i].size > VSET_INLINE)
+			bytes += e[i].size;
+	return bytes;
+}
+
+
+static int compact_count(vset s) {
+	return s->count;
+}
+
+
+/*
+	Shrinks back to an inline version when a single one is left.
+*/
+static int compact_prune(vset s, int version) {
+	int i, n;
+	val_entry one;
+	val_entry* e = VERSIONS(s);
+	
+	for (i = 0; i < s->count; i++)
+		if (e[i].version <= version)
+			break;
+	if (i == s->count)
+		return 0;
+	
+	n = s->count - (i + 1);
+	while (s->count > i + 1) {
+		s->count--;
+		entry_clear(&e[s->count]);
+	}
+	
+	if (s->count == 1 && s->cap > 0) {
+		one = e[0];
+		slab_free(s->v.many, s->cap * sizeof(val_entry));
+		s->v.one = one;
+		s->cap = 0;
+	}
+	return n;
+}
+
+
+vset_ops vset_compact_ops = {
+	"compact",
+	sizeof(struct vset_t),
+	__alignof__(struct vset_t),
+	compact_init,
+	compact_destroy,
+	compact_add,
+	compact_get,
+	compact_allocated_bytes,
+	compact_count,
+	compact_prune,
+	compact_view
+};
@@ -18,8 +18,7 @@
 */
 
 #include "vset.h"
-
-#ifdef USE_VSET_LIST
+#include "slab.h"
 
 #include <stdlib.h>
 #include <sys/queue.h>
@@ -49,28 +48,23 @@ static val_entry* val_entry_new(vset s, val* v);
 static int val_entry_free(vset s, val_entry* ventry);
 
 
-vset vset_new() {
-	vset v;
-	v = malloc(sizeof(struct vset_t));
-	if (v == NULL) return NULL;
+static void list_init(vset v) {
 	v->count = 0;
 	v->alloc_bytes = sizeof(struct vset_t);
 	TAILQ_INIT(&v->values_list);
-	return v;
 }
 
 
-void vset_free(vset s) {
+static void list_destroy(vset s) {
 	val_entry* v;
 	while ((v = TAILQ_FIRST(&s->values_list)) != NULL) {
         TAILQ_REMOVE(&s->values_list, v, values);
         val_entry_free(s, v);
     }
-	free(s);
 }
 
 
-int vset_add(vset s, val* v) {
+static int list_add(vset s, val* v) {
 	val_entry* itr;
 	val_entry* ventry = NULL;
 	
@@ -80,11 +74,11 @@ int vset_add(vset s, val* v) {
 			ventry = itr;
 			ventry->version = v->version;
 		    memcpy(ventry->val, v->data, v->size);
-		} else {
-	    	val_entry_free(s, itr);
 		}
         s->count--;
         TAILQ_REMOVE(&s->values_list, itr, values);
+		if (ventry == NULL)
+	    	val_entry_free(s, itr);
 	}
 
 	if (ventry == NULL)
@@ -124,7 +118,7 @@ int vset_add(vset s, val* v) {
 }
 
 
-val* vset_get(vset s, int v) {
+static val* list_get(vset s, int v) {
     val_entry* ventry;
 
     TAILQ_FOREACH(ventry, &s->values_list, values) {
@@ -137,19 +131,59 @@ val* vset_get(vset s, int v) {
 }
 
 
-int vset_allocated_bytes(vset s) {
+static int list_allocated_bytes(vset s) {
 	return s->alloc_bytes;
 }
 
 
-int vset_count(vset s) {
+static int list_count(vset s) {
 	return s->count;
 }
 
 
+static int list_prune(vset s, int version) {
+	int n = 0;
+	val_entry* itr;
+	val_entry* next;
+	
+	TAILQ_FOREACH(itr, &s->values_list, values) {
+		if (itr->version <= version)
+			break;
+	}
+	if (itr == NULL)
+		return 0;
+	
+	itr = TAILQ_NEXT(itr, values);
+	while (itr != NULL) {
+		next = TAILQ_NEXT(itr, values);
+		TAILQ_REMOVE(&s->values_list, itr, values);
+		val_entry_free(s, itr);
+		s->count--;
+		n++;
+		itr = next;
+	}
+	return n;
+}
+
+
+vset_ops vset_list_ops = {
+	"list",
+	sizeof(struct vset_t),
+	__alignof__(struct vset_t),
+	list_init,
+	list_destroy,
+	list_add,
+	list_get,
+	list_allocated_bytes,
+	list_count,
+	list_prune,
+	NULL
+};
+
+
 static val_entry* val_entry_new(vset s, val* v) {
     val_entry* ventry;
-    ventry = malloc(sizeof(val_entry) + v->size);
+    ventry = slab_alloc(sizeof(val_entry) + v->size);
 	if (ventry == NULL) return NULL;
     ventry->size = v->size;
     ventry->version = v->version;
@@ -162,9 +196,7 @@ static val_entry* val_entry_new(vset s, val* v) {
 static int val_entry_free(vset s, val_entry* ventry) {
     int bytes;
     bytes = sizeof(val_entry) + ventry->size;
-    free(ventry);
+    slab_free(ventry, bytes);
 	s->alloc_bytes -= bytes;
     return bytes;
 }
-
-#endif
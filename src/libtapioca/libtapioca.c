@@ -57,6 +57,12 @@ tapioca_put(tapioca_handle* th, void* k, int ksize, void* v, int vsize) {
 }
 
 
+int
+tapioca_delete(tapioca_handle* th, void* k, int ksize) {
+	return protocol_delete(th, k, ksize);
+}
+
+
 int
 tapioca_commit(tapioca_handle* th) {
 	return protocol_commit(th);
@@ -99,6 +105,19 @@ tapioca_mput(tapioca_handle* th, void* k, int ksize, void* v, int vsize) {
 }
 
 
+int
+tapioca_mdelete(tapioca_handle* th, void* k, int ksize) {
+	return protocol_mdelete(th, k, ksize);
+}
+
+
+mget_result*
+tapioca_range(tapioca_handle* th, void* start, int ssize,
+	void* end, int esize, int max) {
+	return protocol_range(th, start, ssize, end, esize, max);
+}
+
+
 int
 tapioca_mput_commit(tapioca_handle* th) {
 	return protocol_mput_commit(th);
@@ -28,6 +28,7 @@ int protocol_node_id(void* ph);
 int protocol_client_id(void* p);
 int protocol_get(void* ph, void* k, int ksize, void* v, int vsize);
 int protocol_put(void* ph, void* k, int ksize, void* v, int vsize);
+int protocol_delete(void* ph, void* k, int ksize);
 int protocol_commit(void* ph);
 int protocol_rollback(void* ph);
 
@@ -37,8 +38,10 @@ int protocol_mput_int(void* ph, int n, int* keys, int* values);
 
 int protocol_mget(void* ph, void* k, int ksize);
 mget_result* protocol_mget_commit(void* ph);
+mget_result* protocol_range(void* ph, void* start, int ssize, void* end, int esize, int max);
 
 int protocol_mput(void* ph, void* k, int ksize, void* v, int vsize);
+int protocol_mdelete(void* ph, void* k, int ksize);
 int protocol_mput_commit(void* ph);
 
 int protocol_mget_put(void* ph, void* k, int ksize, void* v, int vsize);
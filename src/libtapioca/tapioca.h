@@ -91,6 +91,18 @@ int tapioca_get(tapioca_handle* th, void* k, int ksize, void* v, int vsize);
 int tapioca_put(tapioca_handle* th, void* k, int ksize, void* v, int vsize);
 
 
+/**
+	Performs a delete operation on the current transaction. A deleted key
+	is read as a missing key once the transaction commits.
+
+	@param th a opened tapioca_handle
+	@param k a pointer to the key to delete
+	@param ksize the size of the memory area pointed by k
+	@return 1 if the operations succeeds, -1 otherwise
+*/
+int tapioca_delete(tapioca_handle* th, void* k, int ksize);
+
+
 /**
 	Commits the current transaction.
 	
@@ -135,6 +147,26 @@ int tapioca_mput(tapioca_handle* th, void* k, int ksize, void* v, int vsize);
 int tapioca_mput_commit(tapioca_handle* th);
 int tapioca_mput_commit_retry(tapioca_handle* th, int times);
 
+// Groups a delete with the mput operations, submitted by tapioca_mput_commit()
+int tapioca_mdelete(tapioca_handle* th, void* k, int ksize);
+
+/**
+  Scans, in key order, the keys in [start, end) stored by the tapioca node
+  to which th is connected, among those it keeps ordered. The scan reads
+  the snapshot of the current transaction.
+
+  @param th a opened tapioca_handle
+  @param start the first key of the range, NULL to start from the first key
+  @param ssize the size of start
+  @param end the key ending the range, NULL for no limit
+  @param esize the size of end
+  @param max the maximum number of keys returned, 0 for no limit
+  @return an mget_result holding, for each key found, the key followed by
+  its value, or NULL if the operation failed.
+*/
+mget_result* tapioca_range(tapioca_handle* th, void* start, int ssize,
+	void* end, int esize, int max);
+
 int tapioca_mget_put(tapioca_handle* th, void* k, int ksize, void* v, int vsize);
 int tapioca_mget_put_commit(tapioca_handle* th);
 
@@ -159,6 +159,23 @@ protocol_put(void* p, void* k, int ksize, void* v, int vsize) {
 }
 
 
+int
+protocol_delete(void* p, void* k, int ksize) {
+	int rv;
+    int size = sizeof(int) + ksize;
+    int rtype = 27;
+	tcp_handle* h = (tcp_handle*)p;
+	struct evbuffer* msg = buffer_with_header(size, rtype);
+    buffer_add_data_with_size(msg, k, ksize);
+	CHECK_BUFFER_SIZE(msg, size);
+	rv = tcp_write_buffer(h->c, msg, h->b);
+	evbuffer_free(msg);
+	if (rv != 0) { return -1; }
+	evbuffer_remove(h->b, &rv, sizeof(int));
+	return rv;
+}
+
+
 int
 protocol_commit(void* p) {
 	int rv, commit;
@@ -227,6 +244,34 @@ protocol_mget_commit(void* p) {
 }
 
 
+// The result holds a key and a value per key found
+mget_result*
+protocol_range(void* p, void* start, int ssize, void* end, int esize, int max) {
+	int rv;
+	tcp_handle* h = (tcp_handle*)p;
+    int size = 3*sizeof(int) + ssize + esize;
+    int rtype = 28;
+    mget_result* result;
+	struct evbuffer* msg = buffer_with_header(size, rtype);
+	buffer_add_data_with_size(msg, start, ssize);
+	buffer_add_data_with_size(msg, end, esize);
+	evbuffer_add(msg, &max, sizeof(int));
+	CHECK_BUFFER_SIZE(msg, size);
+	rv = tcp_write_buffer(h->c, msg, h->b);
+	evbuffer_free(msg);
+	if (rv != 0) { return NULL; }
+	
+	evbuffer_remove(h->b, &rv, sizeof(int));
+	if (rv < 0) { return NULL; }
+	
+	result = malloc(sizeof(mget_result));
+	result->buffer = evbuffer_new();
+	result->count = 2 * rv;
+	evbuffer_add_buffer(result->buffer, h->b);
+	return result;
+}
+
+
 int
 protocol_mget_int(void* p, int n, int* keys, int* values) {
 	int i, size;
@@ -268,6 +313,13 @@ protocol_mput(void* p, void* k, int ksize, void* v, int vsize) {
 }
 
 
+// A delete is put as an empty value, the tombstone
+int
+protocol_mdelete(void* p, void* k, int ksize) {
+	return protocol_mput(p, k, ksize, NULL, 0);
+}
+
+
 // int
 // protocol_mput_commit(void* p) {
 // 	int rv;
@@ -0,0 +1,139 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	Compares the certifier's bloom filters with the blocked ones, in the
+	shape of validate_snapshots(): the readset of a transaction tested
+	against the writesets of MaxPreviousST snapshots. Reports the cost of
+	a readset test and the false positive rate of each filter.
+*/
+
+#include "bloom.h"
+#include "blocked_bloom.h"
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#define FILTERS 128
+#define READSET 16
+#define TESTS 4096
+
+static volatile int sink;
+
+static long now_usecs() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+static void random_hashes(flat_key_hash* h, int n) {
+	int i;
+	for (i = 0; i < n; i++) {
+		h[i].hash[0] = ((unsigned int)rand() << 16) ^ rand();
+		h[i].hash[1] = ((unsigned int)rand() << 16) ^ rand();
+	}
+}
+
+static double bench_bloom(bloom** f, flat_key_hash* rs, int iterations,
+	double* fp) {
+	int i, j, k, t, hits;
+	long start;
+	
+	hits = 0;
+	start = now_usecs();
+	for (i = 0; i < iterations; i++) {
+		for (t = 0; t < TESTS; t++) {
+			for (j = 0; j < FILTERS; j++)
+				for (k = 0; k < READSET; k++)
+					if (bloom_contains_hashes(f[j], rs[t * READSET + k].hash)) {
+						hits++;
+						goto next;
+					}
+		next:;
+		}
+	}
+	*fp = (double)hits / ((double)iterations * TESTS);
+	sink += hits;
+	return ((double)(now_usecs() - start) * 1000) / ((double)iterations * TESTS);
+}
+
+static double bench_blocked(blocked_bloom** f, flat_key_hash* rs,
+	int iterations, double* fp) {
+	int i, t, hits;
+	long start;
+	
+	hits = 0;
+	start = now_usecs();
+	for (i = 0; i < iterations; i++)
+		for (t = 0; t < TESTS; t++)
+			hits += blocked_bloom_contains_any(f, FILTERS,
+				&rs[t * READSET], READSET);
+	*fp = (double)hits / ((double)iterations * TESTS);
+	sink += hits;
+	return ((double)(now_usecs() - start) * 1000) / ((double)iterations * TESTS);
+}
+
+int main(int argc, char **argv) {
+	int i, j, w;
+	int writesets[] = {8, 32, 128, 512};
+	int iterations = 10;
+	double ns[2], fp[2];
+	bloom* f[FILTERS];
+	blocked_bloom* g[FILTERS];
+	flat_key_hash *ws, *rs;
+	
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+	
+	for (i = 0; i < FILTERS; i++) {
+		f[i] = bloom_new(BIG_BLOOM);
+		g[i] = blocked_bloom_new(BLOCKED_BLOOM);
+	}
+	ws = malloc(sizeof(flat_key_hash) * 512);
+	rs = malloc(sizeof(flat_key_hash) * READSET * TESTS);
+	random_hashes(rs, READSET * TESTS);
+	
+	printf("%d filters, %d reads per test\n",
+		FILTERS, READSET);
+	printf("writes\tbloom ns\tfp\tblocked ns\tfp\tspeedup\n");
+	for (w = 0; w < (int)(sizeof(writesets) / sizeof(int)); w++) {
+		for (i = 0; i < FILTERS; i++) {
+			bloom_clear(f[i]);
+			blocked_bloom_clear(g[i]);
+			random_hashes(ws, writesets[w]);
+			for (j = 0; j < writesets[w]; j++) {
+				bloom_add_hashes(f[i], ws[j].hash);
+				blocked_bloom_add_hashes(g[i], ws[j].hash);
+			}
+		}
+		ns[0] = bench_bloom(f, rs, iterations, &fp[0]);
+		ns[1] = bench_blocked(g, rs, iterations, &fp[1]);
+		printf("%d\t%.1f\t\t%.4f\t%.1f\t\t%.4f\t%.2fx\n", writesets[w],
+			ns[0], fp[0], ns[1], fp[1], ns[0] / ns[1]);
+	}
+	
+	for (i = 0; i < FILTERS; i++) {
+		bloom_destroy(f[i]);
+		blocked_bloom_destroy(g[i]);
+	}
+	free(ws);
+	free(rs);
+	return 0;
+}
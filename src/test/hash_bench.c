@@ -0,0 +1,90 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	Compares the per-key cost of the legacy joat/djb2 hashes with xxh64,
+	as computed on the hot path: key_hash() for each storage access and
+	key_hash_pair() for each key of a serialized transaction.
+*/
+
+#include "hash.h"
+#include "config.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#define KEY_COUNT 1024
+
+static volatile unsigned int sink;
+
+static long now_usecs() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+static double bench(char* keys, int ksize, int iterations, int pair) {
+	int i, j;
+	long start;
+	unsigned int h[2];
+	
+	start = now_usecs();
+	for (i = 0; i < iterations; i++) {
+		for (j = 0; j < KEY_COUNT; j++) {
+			if (pair) {
+				key_hash_pair(&keys[j * ksize], ksize, h);
+				sink += h[0] ^ h[1];
+			} else {
+				sink += key_hash(&keys[j * ksize], ksize);
+			}
+		}
+	}
+	return ((double)(now_usecs() - start) * 1000) / ((double)iterations * KEY_COUNT);
+}
+
+int main(int argc, char **argv) {
+	int i, ksize, pair;
+	int sizes[] = {16, 24, 32, 48, 64};
+	int iterations = 10000;
+	double ns[2];
+	char* keys;
+	
+	if (argc > 1)
+		iterations = atoi(argv[1]);
+	
+	keys = malloc(KEY_COUNT * 64);
+	for (i = 0; i < KEY_COUNT * 64; i++)
+		keys[i] = rand();
+	
+	printf("ksize\tfunction\tjoat/djb2 ns\txxh64 ns\tspeedup\n");
+	for (i = 0; i < (int)(sizeof(sizes) / sizeof(int)); i++) {
+		ksize = sizes[i];
+		for (pair = 0; pair < 2; pair++) {
+			HashVersion = HASH_JOAT_DJB2;
+			ns[0] = bench(keys, ksize, iterations, pair);
+			HashVersion = HASH_XXH64;
+			ns[1] = bench(keys, ksize, iterations, pair);
+			printf("%d\t%s\t%.2f\t\t%.2f\t\t%.2fx\n", ksize,
+				pair ? "key_hash_pair" : "key_hash", ns[0], ns[1], ns[0] / ns[1]);
+		}
+	}
+	
+	free(keys);
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	Measures the transactions per second a single core runs through the
+	server side of a TPC-style transaction: reads and writes of a few
+	keys of the local storage, serialization of the transaction for the
+	certifier, and clearing it for the next one.
+*/
+
+#include "tapiocadb.h"
+#include "transaction.h"
+#include "storage.h"
+#include <paxos.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define KEY_COUNT (64*1024)
+#define KEY_SIZE 16
+#define VAL_SIZE 64
+
+static char buffer[MAX_TRANSACTION_SIZE];
+
+static long now_usecs() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+static void make_key(key* k, char* data, int i) {
+	memset(data, 0, KEY_SIZE);
+	snprintf(data, KEY_SIZE, "k%d", i);
+	k->data = data;
+	k->size = KEY_SIZE;
+}
+
+static void load(int n) {
+	int i;
+	key k;
+	val v;
+	char kdata[KEY_SIZE], vdata[VAL_SIZE];
+	
+	memset(vdata, 'v', VAL_SIZE);
+	v.data = vdata;
+	v.size = VAL_SIZE;
+	v.version = 0;
+	for (i = 0; i < n; i++) {
+		make_key(&k, kdata, i);
+		storage_put(&k, &v, 1, 0);
+	}
+}
+
+static double bench(transaction* t, int transactions, int keys) {
+	int i, j;
+	long start;
+	key k;
+	val v, *r;
+	char kdata[KEY_SIZE], vdata[VAL_SIZE];
+	
+	memset(vdata, 'w', VAL_SIZE);
+	v.data = vdata;
+	v.size = VAL_SIZE;
+	v.version = 0;
+	
+	start = now_usecs();
+	for (i = 0; i < transactions; i++) {
+		for (j = 0; j < keys; j++) {
+			make_key(&k, kdata, rand() % KEY_COUNT);
+			if (j % 2 == 0) {
+				if ((r = transaction_get(t, &k)) != NULL)
+					val_free(r);
+			} else {
+				transaction_put(t, &k, &v);
+			}
+		}
+		if (transaction_serialize(t, (tr_submit_msg*)buffer, MAX_TRANSACTION_SIZE) < 0) {
+			printf("transaction_serialize failed\n");
+			exit(1);
+		}
+		transaction_clear(t);
+	}
+	return (double)transactions * 1000000 / (double)(now_usecs() - start);
+}
+
+int main(int argc, char **argv) {
+	int i;
+	int keys[] = {4, 20, 100};
+	int transactions = 200000;
+	transaction* t;
+	
+	if (argc > 1)
+		transactions = atoi(argv[1]);
+	
+	tapioca_init_defaults();
+	storage_init();
+	load(KEY_COUNT);
+	t = transaction_new();
+	
+	printf("keys\ttransactions/s\n");
+	for (i = 0; i < (int)(sizeof(keys) / sizeof(int)); i++)
+		printf("%d\t%.0f\n", keys[i], bench(t, transactions, keys[i]));
+	
+	transaction_destroy(t);
+	storage_free();
+	return 0;
+}
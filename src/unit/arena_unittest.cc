@@ -0,0 +1,58 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include "arena.h"
+#include <string.h>
+
+
+TEST(ArenaTest, Aligned) {
+	int i;
+	char* p;
+	arena* a = arena_new();
+	
+	for (i = 1; i < 100; i++) {
+		p = (char*)arena_alloc(a, i);
+		EXPECT_EQ(0, (long)p % 8);
+		memset(p, i, i);
+	}
+	EXPECT_GE(arena_used(a), 99 * 100 / 2);
+	arena_free(a);
+}
+
+
+TEST(ArenaTest, ResetReuses) {
+	int i;
+	void* first;
+	arena* a = arena_new();
+	
+	// A load over several chunks is then served by a single one
+	for (i = 0; i < 100; i++)
+		memset(arena_alloc(a, 1000), 0, 1000);
+	memset(arena_alloc(a, 3 * ARENA_CHUNK_SIZE), 0, 3 * ARENA_CHUNK_SIZE);
+	arena_reset(a);
+	EXPECT_EQ(0, arena_used(a));
+	
+	first = arena_alloc(a, 1000);
+	for (i = 1; i < 100; i++)
+		arena_alloc(a, 1000);
+	arena_reset(a);
+	EXPECT_EQ(first, arena_alloc(a, 1000));
+	arena_free(a);
+}
@@ -0,0 +1,135 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include "blocked_bloom.h"
+
+
+class BlockedBloomTest : public testing::Test {
+protected:
+
+	static const int filters = 4;
+	blocked_bloom* f[filters];
+	
+	virtual void SetUp() {
+		srand(7);
+		for (int i = 0; i < filters; i++)
+			f[i] = blocked_bloom_new(4096);
+	}
+	
+	virtual void TearDown() {
+		for (int i = 0; i < filters; i++)
+			blocked_bloom_destroy(f[i]);
+		blocked_bloom_use_avx2(1);
+	}
+	
+	void randomHash(flat_key_hash* h) {
+		h->hash[0] = rand();
+		h->hash[1] = rand();
+	}
+	
+	// Adds count random hashes to filter i, and records them in h
+	void fill(int i, flat_key_hash* h, int count) {
+		for (int j = 0; j < count; j++) {
+			randomHash(&h[j]);
+			blocked_bloom_add_hashes(f[i], h[j].hash);
+		}
+	}
+};
+
+
+TEST_F(BlockedBloomTest, NoFalseNegatives) {
+	flat_key_hash h[filters][200];
+	
+	for (int i = 0; i < filters; i++)
+		fill(i, h[i], 200);
+	
+	for (int avx2 = 0; avx2 < 2; avx2++) {
+		blocked_bloom_use_avx2(avx2);
+		for (int i = 0; i < filters; i++) {
+			for (int j = 0; j < 200; j++) {
+				ASSERT_TRUE(blocked_bloom_contains_hashes(f[i], h[i][j].hash));
+				ASSERT_TRUE(blocked_bloom_contains_any(f, filters, &h[i][j], 1));
+			}
+			// An added hash at the end of a longer probe is still found
+			flat_key_hash probe[9];
+			for (int j = 0; j < 8; j++)
+				randomHash(&probe[j]);
+			probe[8] = h[i][rand() % 200];
+			ASSERT_TRUE(blocked_bloom_contains_any(f, filters, probe, 9));
+		}
+	}
+}
+
+
+TEST_F(BlockedBloomTest, EmptyContainsNothing) {
+	flat_key_hash h[16];
+	
+	for (int i = 0; i < 16; i++)
+		randomHash(&h[i]);
+	for (int avx2 = 0; avx2 < 2; avx2++) {
+		blocked_bloom_use_avx2(avx2);
+		ASSERT_FALSE(blocked_bloom_contains_any(f, filters, h, 16));
+		ASSERT_FALSE(blocked_bloom_contains_any(f, 0, h, 16));
+		ASSERT_FALSE(blocked_bloom_contains_any(f, filters, h, 0));
+	}
+}
+
+
+TEST_F(BlockedBloomTest, Avx2AgreesWithScalar) {
+	flat_key_hash added[filters][300];
+	flat_key_hash probe[32];
+	int positives = 0;
+	
+	if (!blocked_bloom_use_avx2(1))
+		return;
+	
+	// Crowded enough for false positives, to compare both answers
+	for (int i = 0; i < filters; i++)
+		fill(i, added[i], 300);
+	
+	for (int round = 0; round < 5000; round++) {
+		int m = 1 + rand() % filters;
+		int n = 1 + rand() % 32;
+		for (int j = 0; j < n; j++) {
+			if (rand() % 8 == 0)
+				probe[j] = added[rand() % filters][rand() % 300];
+			else
+				randomHash(&probe[j]);
+		}
+		
+		blocked_bloom_use_avx2(0);
+		int scalar = blocked_bloom_contains_any(f, m, probe, n);
+		blocked_bloom_use_avx2(1);
+		int avx2 = blocked_bloom_contains_any(f, m, probe, n);
+		ASSERT_EQ(scalar != 0, avx2 != 0) << "round " << round;
+		
+		// Each single probe too, so that negatives get compared
+		for (int j = 0; j < n; j++) {
+			blocked_bloom_use_avx2(0);
+			scalar = blocked_bloom_contains_any(f, m, &probe[j], 1);
+			blocked_bloom_use_avx2(1);
+			avx2 = blocked_bloom_contains_any(f, m, &probe[j], 1);
+			ASSERT_EQ(scalar != 0, avx2 != 0) << "round " << round;
+			positives += (scalar != 0);
+		}
+	}
+	ASSERT_GT(positives, 0);
+}
@@ -20,8 +20,15 @@
 #include <gtest/gtest.h>
 #include "tapiocadb.h"
 #include "storage.h"
+#include "snapshot.h"
+#include "crc32c.h"
+#include "config.h"
 #include "test_helpers.h"
 
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
 
 // A mock consistent hash function such that
 // it always returns node id 1 for whatever hash
@@ -35,6 +42,7 @@ protected:
 
 	virtual void SetUp() {
 		tapioca_init_defaults();
+		NodeID = 0;
 		storage_init2(mock_id_for_hash);
 	}
 	
@@ -84,3 +92,102 @@ TEST_F(DumpTest, IterateSkipVersions) {
 	
 	EXPECT_EQ(1, storage_iterate(11, iter, NULL));
 }
+
+
+#define SNAPSHOT_PATH "/tmp/dump_unittest.bin"
+
+
+static void putKeys(int n) {
+	for (int i = 0; i < n; i++) {
+		key* k = createKey(i);
+		val* v = createVal(2*i, 1);
+		storage_put(k, v, 1, 0);
+		key_free(k);
+		val_free(v);
+		v = createVal(2*i, 5);
+		storage_put(k = createKey(i), v, 1, 0);
+		key_free(k);
+		val_free(v);
+	}
+}
+
+
+TEST_F(DumpTest, Crc32c) {
+	EXPECT_EQ(0xe3069283, crc32c(0, "123456789", 9));
+	EXPECT_EQ(crc32c(0, "123456789", 9),
+		crc32c(crc32c(0, "1234", 4), "56789", 5));
+}
+
+
+TEST_F(DumpTest, SnapshotRestore) {
+	int i, n = 100000;
+	key* k;
+	val* v;
+	
+	putKeys(n);
+	EXPECT_EQ(n, snapshot_write(SNAPSHOT_PATH, 3));
+	storage_free();
+	storage_init2(mock_id_for_hash);
+	EXPECT_EQ(0, storage_key_count());
+	
+	EXPECT_EQ(3, snapshot_load(SNAPSHOT_PATH, 4));
+	EXPECT_EQ(n, storage_key_count());
+	EXPECT_EQ(n, storage_iterate(3, iter, NULL));
+	for (i = 0; i < n; i += 100) {
+		k = createKey(i);
+		v = storage_get(k, 3);
+		ASSERT_TRUE(v != NULL);
+		EXPECT_EQ(1, v->version);
+		val_free(v);
+		key_free(k);
+	}
+	unlink(SNAPSHOT_PATH);
+}
+
+
+TEST_F(DumpTest, SnapshotCorrupted) {
+	FILE* fp;
+	
+	putKeys(100000);
+	EXPECT_EQ(100000, snapshot_write(SNAPSHOT_PATH, 3));
+	storage_free();
+	storage_init2(mock_id_for_hash);
+	
+	fp = fopen(SNAPSHOT_PATH, "r+");
+	fseek(fp, 100000, SEEK_SET);
+	fputc(0xff ^ fgetc(fp), fp);
+	fclose(fp);
+	
+	EXPECT_EQ(-1, snapshot_load(SNAPSHOT_PATH, 4));
+	EXPECT_EQ(0, storage_key_count());
+	unlink(SNAPSHOT_PATH);
+}
+
+
+// The record count of the first block, right after the file header
+TEST_F(DumpTest, SnapshotCorruptedBlockHeader) {
+	FILE* fp;
+	
+	putKeys(1000);
+	EXPECT_EQ(1000, snapshot_write(SNAPSHOT_PATH, 3));
+	storage_free();
+	storage_init2(mock_id_for_hash);
+	
+	fp = fopen(SNAPSHOT_PATH, "r+");
+	fseek(fp, 16, SEEK_SET);
+	fputc(0x80 ^ fgetc(fp), fp);
+	fclose(fp);
+	
+	EXPECT_EQ(-1, snapshot_load(SNAPSHOT_PATH, 1));
+	EXPECT_EQ(0, storage_key_count());
+	unlink(SNAPSHOT_PATH);
+}
+
+
+TEST_F(DumpTest, SnapshotTruncated) {
+	putKeys(1000);
+	EXPECT_EQ(1000, snapshot_write(SNAPSHOT_PATH, 3));
+	EXPECT_EQ(0, truncate(SNAPSHOT_PATH, 1000));
+	EXPECT_EQ(-1, snapshot_load(SNAPSHOT_PATH, 1));
+	unlink(SNAPSHOT_PATH);
+}
@@ -0,0 +1,90 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include "freq_sketch.h"
+
+
+class FreqSketchTest : public testing::Test {
+protected:
+
+	freq_sketch* s;
+	
+	virtual void SetUp() {
+		s = freq_sketch_new(1024);
+	}
+	
+	virtual void TearDown() {
+		freq_sketch_free(s);
+	}
+};
+
+
+TEST_F(FreqSketchTest, Empty) {
+	EXPECT_EQ(0, freq_sketch_estimate(s, 1));
+	EXPECT_EQ(0, freq_sketch_estimate(s, 12345));
+}
+
+
+TEST_F(FreqSketchTest, NeverUnderestimates) {
+	unsigned int h;
+	
+	for (h = 1; h <= 100; h++)
+		for (unsigned int i = 0; i < h; i++)
+			freq_sketch_add(s, h);
+	
+	for (h = 1; h <= 100; h++)
+		EXPECT_GE(freq_sketch_estimate(s, h), (int)h);
+	EXPECT_EQ(0, freq_sketch_resets(s));
+}
+
+
+TEST_F(FreqSketchTest, HotAboveCold) {
+	unsigned int h;
+	
+	for (h = 1000; h < 1500; h++)
+		freq_sketch_add(s, h);
+	for (int i = 0; i < 50; i++)
+		freq_sketch_add(s, 7);
+	
+	EXPECT_GT(freq_sketch_estimate(s, 7), freq_sketch_estimate(s, 1200));
+}
+
+
+TEST_F(FreqSketchTest, Saturates) {
+	for (int i = 0; i < 1000; i++)
+		freq_sketch_add(s, 42);
+	EXPECT_EQ(255, freq_sketch_estimate(s, 42));
+}
+
+
+TEST_F(FreqSketchTest, Aging) {
+	int i, n = FREQ_SKETCH_SAMPLE * 1024;
+	
+	for (i = 0; i < 100; i++)
+		freq_sketch_add(s, 42);
+	
+	// Fill up the sample with other keys, counters get halved
+	for (i = 100; i < n; i++)
+		freq_sketch_add(s, 100000 + i);
+	
+	EXPECT_EQ(1, freq_sketch_resets(s));
+	EXPECT_GE(freq_sketch_estimate(s, 42), 50);
+	EXPECT_LT(freq_sketch_estimate(s, 42), 100);
+}
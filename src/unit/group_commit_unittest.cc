@@ -0,0 +1,155 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <string.h>
+#include "tapiocadb.h"
+#include "group_commit.h"
+#include "validation.h"
+#include <paxos.h>
+
+
+static std::vector<int> counts;
+static std::vector<int> fulls;
+
+static void onSubmit(struct evbuffer* b, int count, int full) {
+	tr_deliver_msg m;
+	evbuffer_copyout(b, &m, sizeof(tr_deliver_msg));
+	EXPECT_EQ(count, m.aborted_count + m.committed_count);
+	EXPECT_EQ(m.ST, validation_ST());
+	counts.push_back(count);
+	fulls.push_back(full);
+}
+
+
+class GroupCommitTest : public testing::Test {
+protected:
+
+	struct event_base* base;
+	std::vector<char> buffer;
+	
+	virtual void SetUp() {
+		tapioca_init_defaults();
+		ValidationBufferSize = 4;
+		ValidationDeliverInterval = 10000;
+		init_validation();
+		base = event_base_new();
+		group_commit_init(base, onSubmit);
+		buffer.resize(MAX_TRANSACTION_SIZE);
+		counts.clear();
+		fulls.clear();
+	}
+	
+	virtual void TearDown() {
+		group_commit_free();
+		event_base_free(base);
+		validation_cleanup();
+	}
+	
+	// A blind write of key i, with wsize bytes of writeset
+	tr_submit_msg* createTransaction(int i, int wsize) {
+		tr_submit_msg* t = (tr_submit_msg*)&buffer[0];
+		flat_key_hash* h = (flat_key_hash*)t->data;
+		
+		memset(t, 0, sizeof(tr_submit_msg) + sizeof(flat_key_hash) + wsize);
+		t->hash_version = HashVersion;
+		t->id.seqnumber = i;
+		t->start = validation_ST();
+		t->writeset_count = 1;
+		t->writeset_size = wsize;
+		h->hash[0] = i;
+		h->hash[1] = i * 7 + 1;
+		return t;
+	}
+};
+
+
+TEST_F(GroupCommitTest, FlushWhenFull) {
+	int i;
+	
+	for (i = 0; i < ValidationBufferSize - 1; i++)
+		EXPECT_EQ(1, group_commit_validate(createTransaction(i, 0)));
+	EXPECT_EQ(0, counts.size());
+	
+	EXPECT_EQ(1, group_commit_validate(createTransaction(i, 0)));
+	ASSERT_EQ(1, counts.size());
+	EXPECT_EQ(ValidationBufferSize, counts[0]);
+	EXPECT_EQ(1, fulls[0]);
+	EXPECT_EQ(1, validation_ST());
+	EXPECT_EQ(0, validated_count());
+}
+
+
+TEST_F(GroupCommitTest, FlushBeforeValueOverflows) {
+	int wsize = MAX_TRANSACTION_SIZE / 2;
+	
+	group_commit_validate(createTransaction(1, wsize));
+	EXPECT_EQ(0, counts.size());
+	
+	// Both writesets would not fit in a paxos value
+	group_commit_validate(createTransaction(2, wsize));
+	ASSERT_EQ(1, counts.size());
+	EXPECT_EQ(1, counts[0]);
+	EXPECT_EQ(1, fulls[0]);
+	EXPECT_EQ(1, validated_count());
+}
+
+
+TEST_F(GroupCommitTest, FlushOnTimeout) {
+	group_commit_validate(createTransaction(1, 0));
+	group_commit_validate(createTransaction(2, 0));
+	EXPECT_EQ(0, counts.size());
+	
+	event_base_loop(base, EVLOOP_ONCE);
+	ASSERT_EQ(1, counts.size());
+	EXPECT_EQ(2, counts[0]);
+	EXPECT_EQ(0, fulls[0]);
+	
+	// The timer is armed again by the next transaction only
+	EXPECT_EQ(1, event_base_loop(base, EVLOOP_NONBLOCK));
+	group_commit_validate(createTransaction(3, 0));
+	event_base_loop(base, EVLOOP_ONCE);
+	EXPECT_EQ(2, counts.size());
+}
+
+
+TEST_F(GroupCommitTest, ConflictsWithinBuffer) {
+	tr_submit_msg* t;
+	
+	group_commit_validate(createTransaction(1, 0));
+	
+	// Reads key 1 from the snapshot before the buffer
+	t = createTransaction(2, 0);
+	t->readset_count = 1;
+	t->writeset_count = 0;
+	((flat_key_hash*)t->data)->hash[0] = 1;
+	((flat_key_hash*)t->data)->hash[1] = 8;
+	EXPECT_EQ(0, group_commit_validate(t));
+}
+
+
+TEST_F(GroupCommitTest, NoInterval) {
+	ValidationDeliverInterval = 0;
+	group_commit_validate(createTransaction(1, 0));
+	group_commit_validate(createTransaction(2, 0));
+	ASSERT_EQ(2, counts.size());
+	EXPECT_EQ(1, counts[1]);
+	EXPECT_EQ(2, validation_ST());
+}
@@ -0,0 +1,81 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include "hash.h"
+#include "config.h"
+
+
+class HashTest : public testing::Test {
+protected:
+
+	int version;
+	
+	virtual void SetUp() {
+		version = HashVersion;
+	}
+	
+	virtual void TearDown() {
+		HashVersion = version;
+	}
+};
+
+
+TEST_F(HashTest, Xxh64Vectors) {
+	const char* s = "Nobody inspects the spammish repetition";
+	EXPECT_EQ(0xEF46DB3751D8E999ULL, xxh64("", 0, 0));
+	EXPECT_EQ(0x44BC2CF5AD770999ULL, xxh64("abc", 3, 0));
+	EXPECT_EQ(0xFBCEA83C8A378BF1ULL, xxh64(s, strlen(s), 0));
+}
+
+
+TEST_F(HashTest, PairMatchesKeyHash) {
+	char k[64];
+	unsigned int h[2];
+	
+	for (int i = 0; i < 64; i++)
+		k[i] = i * 7;
+	
+	HashVersion = HASH_XXH64;
+	for (int size = 1; size <= 64; size++) {
+		key_hash_pair(k, size, h);
+		EXPECT_EQ(key_hash(k, size), h[0]);
+		EXPECT_NE(h[0], h[1]);
+	}
+	
+	HashVersion = HASH_JOAT_DJB2;
+	key_hash_pair(k, 16, h);
+	EXPECT_EQ(joat_hash(k, 16), h[0]);
+	EXPECT_EQ(djb2_hash(k, 16), h[1]);
+	EXPECT_EQ(joat_hash(k, 16), key_hash(k, 16));
+}
+
+
+TEST_F(HashTest, LegacyPairOfIntKeys) {
+	unsigned int h[2];
+	int k = 123456;
+	
+	// as the baseline transaction_serialize sent them
+	HashVersion = HASH_JOAT_DJB2;
+	key_hash_pair((char*)&k, sizeof(int), h);
+	EXPECT_EQ((unsigned int)k, h[0]);
+	EXPECT_EQ(djb2_hash((char*)&k, sizeof(int)), h[1]);
+	EXPECT_EQ(joat_hash((char*)&k, sizeof(int)), key_hash((char*)&k, sizeof(int)));
+}
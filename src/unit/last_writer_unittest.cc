@@ -0,0 +1,111 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include "last_writer.h"
+
+
+class LastWriterTest : public testing::Test {
+protected:
+
+	last_writer* lw;
+	
+	virtual void SetUp() {
+		lw = last_writer_new(16);
+	}
+	
+	virtual void TearDown() {
+		last_writer_free(lw);
+	}
+	
+	// Hashes of key i, all in the same slot
+	void keyHash(unsigned int i, unsigned int h[2]) {
+		h[0] = i;
+		h[1] = 3;
+	}
+};
+
+
+TEST_F(LastWriterTest, SizeRoundedUp) {
+	last_writer* l = last_writer_new(100);
+	EXPECT_EQ(128, l->size);
+	last_writer_free(l);
+	l = last_writer_new(1);
+	EXPECT_EQ(16, l->size);
+	last_writer_free(l);
+}
+
+
+TEST_F(LastWriterTest, SetAndGet) {
+	unsigned int h[2], h2[2], other[2];
+	
+	keyHash(1, h);
+	keyHash(2, h2);
+	keyHash(3, other);
+	last_writer_set(lw, h, 5);
+	last_writer_set(lw, h2, 7);
+	EXPECT_EQ(5, last_writer_get(lw, h));
+	EXPECT_EQ(7, last_writer_get(lw, h2));
+	EXPECT_EQ(0, last_writer_get(lw, other));
+	
+	// Writing a key again only moves its ST
+	last_writer_set(lw, h, 9);
+	EXPECT_EQ(9, last_writer_get(lw, h));
+	EXPECT_EQ(2, lw->count);
+	EXPECT_EQ(0, last_writer_horizon(lw));
+}
+
+
+TEST_F(LastWriterTest, EvictsOlderHalf) {
+	unsigned int i, h[2];
+	
+	// 12 of the 16 slots fill the map
+	for (i = 1; i <= 12; i++) {
+		keyHash(i, h);
+		last_writer_set(lw, h, i);
+	}
+	EXPECT_EQ(0, last_writer_horizon(lw));
+	
+	// The writes up to the middle ST between 1 and 13 go
+	keyHash(13, h);
+	last_writer_set(lw, h, 13);
+	EXPECT_EQ(7, last_writer_horizon(lw));
+	for (i = 1; i <= 13; i++) {
+		keyHash(i, h);
+		EXPECT_EQ(i > 7 ? i : 0, last_writer_get(lw, h));
+	}
+	EXPECT_EQ(6, lw->count);
+}
+
+
+TEST_F(LastWriterTest, EvictsAllAtSameSt) {
+	unsigned int i, h[2];
+	
+	for (i = 1; i <= 12; i++) {
+		keyHash(i, h);
+		last_writer_set(lw, h, 5);
+	}
+	keyHash(13, h);
+	last_writer_set(lw, h, 5);
+	EXPECT_EQ(5, last_writer_horizon(lw));
+	EXPECT_EQ(5, last_writer_get(lw, h));
+	keyHash(1, h);
+	EXPECT_EQ(0, last_writer_get(lw, h));
+	EXPECT_EQ(1, lw->count);
+}
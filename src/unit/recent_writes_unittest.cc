@@ -0,0 +1,71 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include "recent_writes.h"
+
+
+class RecentWritesTest : public testing::Test {
+protected:
+
+	virtual void TearDown() {
+		recent_writes_free();
+	}
+};
+
+
+TEST_F(RecentWritesTest, Disabled) {
+	unsigned int h[2] = {1, 2};
+	recent_writes_init(0);
+	recent_writes_add(h, 10);
+	EXPECT_EQ(0, recent_writes_after(h, 1));
+}
+
+
+TEST_F(RecentWritesTest, LastWrite) {
+	unsigned int h[2] = {1, 2};
+	unsigned int other[2] = {1, 3};
+	
+	recent_writes_init(64);
+	recent_writes_add(h, 10);
+	recent_writes_add(h, 5);
+	EXPECT_EQ(1, recent_writes_after(h, 9));
+	EXPECT_EQ(0, recent_writes_after(h, 10));
+	EXPECT_EQ(0, recent_writes_after(other, 1));
+}
+
+
+TEST_F(RecentWritesTest, FullBucketForgetsOldest) {
+	unsigned int i;
+	unsigned int h[2];
+	
+	// With a single bucket every key competes for the same entries
+	recent_writes_init(RECENT_WRITES_WAYS);
+	for (i = 0; i <= RECENT_WRITES_WAYS; i++) {
+		h[0] = i;
+		h[1] = 0;
+		recent_writes_add(h, i + 1);
+	}
+	h[0] = 0;
+	EXPECT_EQ(0, recent_writes_after(h, 0));
+	for (i = 1; i <= RECENT_WRITES_WAYS; i++) {
+		h[0] = i;
+		EXPECT_EQ(1, recent_writes_after(h, i));
+	}
+}
@@ -47,7 +47,8 @@ static void mock_join(struct remote_mock* rm) {
 	int fd;
 	char buffer[1024];
 	join_msg* msg = (join_msg*)buffer;
-	msg->type = NODE_JOIN;
+	msg->type = (HashVersion == HASH_JOAT_DJB2) ? NODE_JOIN : NODE_JOIN_HASHED;
+	msg->hash_version = HashVersion;
 	//msg->node_id = my_id;
 	msg->node_type = REGULAR_NODE;
 	msg->port = my_port;
@@ -95,7 +96,7 @@ static void handle_rec_key(int fd, short ev, void* arg) {
 
 val* mock_recover_key(struct remote_mock* rm, key* k) {
 	int port = 12345;
-	unsigned int h = joat_hash(k->data, k->size);
+	unsigned int h = key_hash(k->data, k->size);
 		
 	rec_key_msg_for_key(k, rm->buffer, &rm->buffer_size);
 	rm->recv_sock = udp_bind_fd(my_port);
@@ -0,0 +1,118 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "skiplist.h"
+
+
+static int string_cmp(void* item, const char* k, int size) {
+	std::string* s = (std::string*)item;
+	int rv = memcmp(s->data(), k, std::min((int)s->size(), size));
+	if (rv != 0)
+		return rv;
+	return (int)s->size() - size;
+}
+
+
+class SkiplistTest : public testing::Test {
+protected:
+
+	skiplist* s;
+	std::vector<std::string*> items;
+	
+	virtual void SetUp() {
+		s = skiplist_new(string_cmp);
+	}
+	
+	virtual void TearDown() {
+		skiplist_free(s);
+		for (size_t i = 0; i < items.size(); i++)
+			delete items[i];
+	}
+	
+	int insert(const std::string& k) {
+		std::string* item = new std::string(k);
+		items.push_back(item);
+		return skiplist_insert(s, item, item->data(), item->size());
+	}
+	
+	std::string at(skiplist_node* n) {
+		return *(std::string*)skiplist_item(n);
+	}
+};
+
+
+TEST_F(SkiplistTest, Empty) {
+	EXPECT_EQ(0, skiplist_count(s));
+	EXPECT_TRUE(skiplist_seek(s, NULL, 0) == NULL);
+	EXPECT_TRUE(skiplist_seek(s, "a", 1) == NULL);
+	EXPECT_EQ(-1, skiplist_remove(s, "a", 1));
+}
+
+
+TEST_F(SkiplistTest, Ordered) {
+	int i, n = 10000;
+	char buf[16];
+	skiplist_node* node;
+	std::vector<std::string> keys;
+	
+	for (i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "%d", (i * 7919) % n);
+		keys.push_back(buf);
+		EXPECT_EQ(0, insert(buf));
+	}
+	EXPECT_EQ(-1, insert("42"));
+	EXPECT_EQ(n, skiplist_count(s));
+	
+	std::sort(keys.begin(), keys.end());
+	node = skiplist_seek(s, NULL, 0);
+	for (i = 0; i < n; i++) {
+		ASSERT_TRUE(node != NULL);
+		EXPECT_EQ(keys[i], at(node));
+		node = skiplist_next(node);
+	}
+	EXPECT_TRUE(node == NULL);
+}
+
+
+TEST_F(SkiplistTest, SeekAndRemove) {
+	skiplist_node* n;
+	
+	insert("b");
+	insert("ba");
+	insert("bb");
+	insert("d");
+	
+	// A key sorts right after its prefixes
+	EXPECT_EQ("b", at(skiplist_seek(s, "b", 1)));
+	EXPECT_EQ("ba", at(skiplist_next(skiplist_seek(s, "b", 1))));
+	EXPECT_EQ("bb", at(skiplist_seek(s, "bab", 3)));
+	EXPECT_EQ("d", at(skiplist_seek(s, "c", 1)));
+	EXPECT_TRUE(skiplist_seek(s, "e", 1) == NULL);
+	
+	EXPECT_EQ(0, skiplist_remove(s, "ba", 2));
+	EXPECT_EQ(-1, skiplist_remove(s, "ba", 2));
+	n = skiplist_seek(s, "b", 1);
+	EXPECT_EQ("bb", at(skiplist_next(n)));
+	EXPECT_EQ(3, skiplist_count(s));
+}
@@ -0,0 +1,117 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include "slab.h"
+#include <string.h>
+
+
+class SlabTest : public testing::Test {
+protected:
+
+	long used;
+	
+	virtual void SetUp() {
+		used = slab_used_bytes();
+	}
+	
+	virtual void TearDown() {
+		slab_reclaim(0);
+	}
+};
+
+
+TEST_F(SlabTest, ZeroSize) {
+	EXPECT_TRUE(slab_alloc(0) == NULL);
+	slab_free(NULL, 0);
+	EXPECT_EQ(used, slab_used_bytes());
+}
+
+
+TEST_F(SlabTest, AllocFree) {
+	int i, n = 10000;
+	char* p[10000];
+	
+	for (i = 0; i < n; i++) {
+		p[i] = (char*)slab_alloc(1 + (i % 300));
+		memset(p[i], i, 1 + (i % 300));
+	}
+	
+	for (i = 0; i < n; i++) {
+		EXPECT_EQ((char)i, p[i][0]);
+		EXPECT_EQ((char)i, p[i][i % 300]);
+	}
+	EXPECT_GT(slab_used_bytes(), used);
+	
+	for (i = 0; i < n; i++)
+		slab_free(p[i], 1 + (i % 300));
+	EXPECT_EQ(used, slab_used_bytes());
+}
+
+
+TEST_F(SlabTest, LargeObjects) {
+	int size = SLAB_MAX_OBJECT + 1;
+	char* p = (char*)slab_alloc(size);
+	memset(p, 1, size);
+	EXPECT_EQ(used + size, slab_used_bytes());
+	slab_free(p, size);
+	EXPECT_EQ(used, slab_used_bytes());
+}
+
+
+TEST_F(SlabTest, ReclaimEmptySlabs) {
+	int i, n = 100000;
+	void** p = (void**)malloc(n * sizeof(void*));
+	
+	slab_reclaim(0);
+	int slabs = slab_count();
+	
+	for (i = 0; i < n; i++)
+		p[i] = slab_alloc(64);
+	EXPECT_GT(slab_count(), slabs);
+	
+	for (i = 0; i < n; i++)
+		slab_free(p[i], 64);
+	EXPECT_GT(slab_reclaim(0), 0);
+	EXPECT_EQ(slabs, slab_count());
+	free(p);
+}
+
+
+TEST_F(SlabTest, DeferredFree) {
+	void* e1;
+	void* e2;
+	void* q;
+	void* p = slab_alloc(100);
+	
+	slab_free_deferred(p, 100);
+	EXPECT_EQ(0, slab_deferred_bytes());
+	
+	e1 = slab_epoch_enter();
+	q = slab_alloc(100);
+	slab_free_deferred(q, 100);
+	EXPECT_EQ(100, slab_deferred_bytes());
+	
+	// Entered after the free, does not hold it back
+	e2 = slab_epoch_enter();
+	slab_epoch_exit(e1);
+	EXPECT_EQ(0, slab_deferred_bytes());
+	slab_epoch_exit(e2);
+	EXPECT_EQ(used, slab_used_bytes());
+}
@@ -0,0 +1,131 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include "spill.h"
+
+#include <string.h>
+
+
+#define SPILL_TEST_SIZE (SPILL_SEGMENTS * 64 * 1024)
+#define RECORDS 200
+#define RECORD_DATA 1000
+
+
+static void moved(void* owner, long offset) {
+	*(long*)owner = offset;
+}
+
+
+class SpillTest : public testing::Test {
+protected:
+
+	spill* s;
+	long offsets[RECORDS];
+	char data[RECORD_DATA];
+	
+	virtual void SetUp() {
+		s = spill_new("/tmp/spill_unittest.spill", SPILL_TEST_SIZE);
+		ASSERT_TRUE(s != NULL);
+	}
+	
+	virtual void TearDown() {
+		spill_free(s);
+	}
+	
+	void appendRecords() {
+		for (int i = 0; i < RECORDS; i++) {
+			memset(data, i, RECORD_DATA);
+			offsets[i] = spill_append(s, &offsets[i], data, RECORD_DATA);
+			ASSERT_GE(offsets[i], 0);
+		}
+	}
+	
+	void checkRecord(int i) {
+		int size;
+		char* p = (char*)spill_data(s, offsets[i], &size);
+		memset(data, i, RECORD_DATA);
+		EXPECT_EQ(RECORD_DATA, size);
+		EXPECT_EQ(0, memcmp(p, data, RECORD_DATA));
+	}
+};
+
+
+TEST_F(SpillTest, AppendAndRead) {
+	appendRecords();
+	for (int i = 0; i < RECORDS; i++)
+		checkRecord(i);
+	EXPECT_GE(spill_live_bytes(s), RECORDS * RECORD_DATA);
+	EXPECT_EQ(0, spill_dead_bytes(s));
+}
+
+
+TEST_F(SpillTest, Full) {
+	long offset;
+	int n = 0;
+	
+	while ((offset = spill_append(s, NULL, data, RECORD_DATA)) >= 0)
+		n++;
+	EXPECT_GT(n, 0);
+	EXPECT_LE(n, SPILL_TEST_SIZE / RECORD_DATA);
+	EXPECT_EQ(-1, spill_append(s, NULL, data, SPILL_TEST_SIZE));
+}
+
+
+TEST_F(SpillTest, ReleaseAll) {
+	appendRecords();
+	for (int i = 0; i < RECORDS; i++)
+		spill_release(s, offsets[i]);
+	EXPECT_EQ(0, spill_live_bytes(s));
+	EXPECT_EQ(0, spill_dead_bytes(s));
+}
+
+
+TEST_F(SpillTest, Compact) {
+	long live;
+	
+	appendRecords();
+	for (int i = 0; i < RECORDS; i += 2)
+		spill_release(s, offsets[i]);
+	live = spill_live_bytes(s);
+	EXPECT_GT(spill_dead_bytes(s), 0);
+	
+	while (spill_compact(s, 4096, moved) > 0);
+	
+	EXPECT_EQ(live, spill_live_bytes(s));
+	EXPECT_LT(spill_dead_bytes(s), live);
+	for (int i = 1; i < RECORDS; i += 2)
+		checkRecord(i);
+}
+
+
+TEST_F(SpillTest, FrozenNotReused) {
+	appendRecords();
+	spill_freeze(s, 1);
+	for (int i = 0; i < RECORDS; i += 2)
+		spill_release(s, offsets[i]);
+	EXPECT_EQ(0, spill_compact(s, SPILL_TEST_SIZE, moved));
+	for (int i = 0; i < RECORDS; i++)
+		spill_release(s, offsets[i]);
+	EXPECT_EQ(0, spill_live_bytes(s));
+	EXPECT_GT(spill_dead_bytes(s), 0);
+	
+	spill_freeze(s, 0);
+	EXPECT_EQ(0, spill_dead_bytes(s));
+}
@@ -18,8 +18,11 @@
 */
 
 #include <gtest/gtest.h>
+#include <vector>
+#include <arpa/inet.h>
 #include "tapiocadb.h"
 #include "storage.h"
+#include "vset.h"
 #include "test_helpers.h"
 
 
@@ -308,3 +311,961 @@ TEST_F(StorageTest, GCPreserveNullVal) {
 	v = storage_get(k, 3445);
 	EXPECT_EQ(v->version, 3391);
 }
+
+
+TEST_F(StorageTest, GCKeepsIndexConsistent) {
+	key* k;
+	val* v;
+	val* rv;
+	int i, found = 0, n = 100000;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, 1);
+		EXPECT_EQ(1, storage_put(k, v, 0, 1));
+		key_free(k);
+		val_free(v);
+	}
+	
+	// evict roughly half of the entries
+	storage_gc_at_least(storage_get_current_size() / 2);
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, 1);
+		rv = storage_get(k, 1);
+		if (rv != NULL) {
+			EXPECT_PRED2(valVersionEqual, rv, v);
+			val_free(rv);
+			found++;
+		}
+		key_free(k);
+		val_free(v);
+	}
+	
+	EXPECT_GT(found, 0);
+	EXPECT_LT(found, n);
+	EXPECT_EQ(found, storage_key_count());
+}
+
+
+TEST_F(StorageTest, AdmitOnlyFrequentKeys) {
+	key* k;
+	val* v;
+	val* rv;
+	int i, n = 0;
+	
+	// Below the limit everything is admitted
+	k = createKey(-1);
+	EXPECT_EQ(1, storage_admit(k));
+	key_free(k);
+	
+	StorageMaxSize = 4*1024*1024;
+	StorageMinFreeSize = 1024*1024;
+	while (storage_get_current_size() + StorageMinFreeSize < StorageMaxSize) {
+		k = createKey(n);
+		v = createVal(n, 1);
+		EXPECT_EQ(1, storage_put(k, v, 0, 1));
+		key_free(k);
+		val_free(v);
+		n++;
+	}
+	
+	// Every cached key is read twice
+	for (int j = 0; j < 2; j++) {
+		for (i = 0; i < n; i++) {
+			k = createKey(i);
+			rv = storage_get(k, 1);
+			val_free(rv);
+			key_free(k);
+		}
+	}
+	
+	// A key read once is not worth evicting any of them
+	k = createKey(n);
+	EXPECT_TRUE(storage_get(k, 1) == NULL);
+	EXPECT_EQ(0, storage_admit(k));
+	EXPECT_EQ(1, storage_admission_reject_count());
+	key_free(k);
+	
+	// A key read more often is admitted
+	k = createKey(n + 1);
+	for (i = 0; i < 5; i++)
+		EXPECT_TRUE(storage_get(k, 1) == NULL);
+	EXPECT_EQ(1, storage_admit(k));
+	key_free(k);
+	
+	// Keys already in storage are always admitted
+	k = createKey(0);
+	EXPECT_EQ(1, storage_admit(k));
+	key_free(k);
+}
+
+
+// Peeking the victim for admission leaves the LRU order as it was
+TEST_F(StorageTest, AdmitKeepsLruOrder) {
+	key* k;
+	val* v;
+	val* rv;
+	int i, n = 1000;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, 1);
+		EXPECT_EQ(1, storage_put(k, v, 0, 1));
+		if (i < 2)
+			EXPECT_EQ(1, storage_pin(k, i));
+		key_free(k);
+		val_free(v);
+	}
+	
+	// Over the limit, admission compares with the victim, past the
+	// pinned tail entries
+	StorageMaxSize = storage_get_current_size();
+	StorageMinFreeSize = 1;
+	k = createKey(n);
+	for (i = 0; i < 10; i++)
+		storage_admit(k);
+	key_free(k);
+	
+	for (i = 0; i < 2; i++) {
+		k = createKey(i);
+		storage_unpin(k, i);
+		key_free(k);
+	}
+	storage_gc_at_least(1);
+	
+	k = createKey(0);
+	EXPECT_TRUE(storage_get(k, 1) == NULL);
+	key_free(k);
+	k = createKey(2);
+	rv = storage_get(k, 1);
+	EXPECT_TRUE(rv != NULL);
+	val_free(rv);
+	key_free(k);
+}
+
+
+TEST_F(StorageTest, GetView) {
+	val_view w;
+	key* k = createKey(1);
+	val* v = createVal(std::string(100, 'a'), 1);
+	val* v2 = createVal(std::string(100, 'b'), 2);
+	
+	EXPECT_EQ(0, storage_get_view(k, 1, &w));
+	storage_put(k, v, 0, 1);
+	EXPECT_EQ(1, storage_get_view(k, 1, &w));
+	EXPECT_EQ(100, w.size);
+	EXPECT_EQ(1, w.version);
+	
+	// The view survives overwrites and eviction of its key
+	storage_put(k, v2, 0, 1);
+	storage_gc_at_least(1024*1024*1024);
+	EXPECT_EQ(0, storage_key_count());
+	EXPECT_EQ(0, memcmp(w.data, v->data, 100));
+	storage_view_release(&w);
+	
+	key_free(k);
+	val_free(v);
+	val_free(v2);
+}
+
+
+TEST_F(StorageTest, PinnedNotEvicted) {
+	key* k;
+	val* v;
+	int i, n = 1000;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, 1);
+		EXPECT_EQ(1, storage_put(k, v, 0, 1));
+		if (i % 10 == 0)
+			EXPECT_EQ(1, storage_pin(k, i));
+		key_free(k);
+		val_free(v);
+	}
+	
+	k = createKey(n);
+	EXPECT_EQ(0, storage_pin(k, n));
+	key_free(k);
+	
+	storage_gc_at_least(1024*1024*1024);
+	EXPECT_EQ(n / 10, storage_key_count());
+	
+	for (i = 0; i < n; i += 10) {
+		k = createKey(i);
+		storage_unpin(k, i);
+		key_free(k);
+	}
+	storage_gc_at_least(1024*1024*1024);
+	EXPECT_EQ(0, storage_key_count());
+}
+
+
+TEST_F(StorageTest, UnpinOnlyOwnPin) {
+	key* k = createKey(1);
+	val* v = createVal(1, 1);
+	
+	EXPECT_EQ(1, storage_put(k, v, 0, 1));
+	EXPECT_EQ(1, storage_pin(k, 1));
+	EXPECT_EQ(1, storage_pin(k, 2));
+	
+	// Releases by other owners, or twice by the same, are ignored
+	storage_unpin(k, 3);
+	storage_unpin(k, 1);
+	storage_unpin(k, 1);
+	storage_gc_at_least(1024*1024*1024);
+	EXPECT_EQ(1, storage_key_count());
+	
+	storage_unpin(k, 2);
+	storage_gc_at_least(1024*1024*1024);
+	EXPECT_EQ(0, storage_key_count());
+	key_free(k);
+	val_free(v);
+}
+
+
+TEST_F(StorageTest, GCBudget) {
+	key* k;
+	val* v;
+	int i, n = 10000;
+	long freed;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, 1);
+		EXPECT_EQ(1, storage_put(k, v, 0, 1));
+		key_free(k);
+		val_free(v);
+	}
+	
+	freed = storage_gc_budget(4096, 1000000);
+	EXPECT_GE(freed, 4096);
+	EXPECT_LT(freed, 4096 + 1024);
+	EXPECT_GT(storage_key_count(), 0);
+	
+	// Stops after 1 us, at the first clock check
+	freed = storage_gc_budget(1024*1024*1024, 1);
+	EXPECT_GT(storage_key_count(), 0);
+	EXPECT_EQ(freed > 0, true);
+}
+
+
+TEST_F(StorageTest, SnapshotWatermark) {
+	EXPECT_EQ(-1, storage_oldest_snapshot());
+	
+	storage_snapshot_acquire(10);
+	storage_snapshot_acquire(12);
+	storage_snapshot_acquire(10);
+	storage_snapshot_acquire(5);
+	EXPECT_EQ(5, storage_oldest_snapshot());
+	
+	storage_snapshot_release(5);
+	EXPECT_EQ(10, storage_oldest_snapshot());
+	storage_snapshot_release(10);
+	EXPECT_EQ(10, storage_oldest_snapshot());
+	storage_snapshot_release(10);
+	EXPECT_EQ(12, storage_oldest_snapshot());
+	
+	// Unknown snapshots are ignored
+	storage_snapshot_release(7);
+	storage_snapshot_release(12);
+	EXPECT_EQ(-1, storage_oldest_snapshot());
+}
+
+
+TEST_F(StorageTest, PruneOldVersions) {
+	key* k;
+	val* v;
+	int i, j, n = 1000;
+	long size;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		for (j = 1; j <= StorageMaxOldVersions; j++) {
+			v = createVal(i, j);
+			storage_put(k, v, 1, 1);
+			val_free(v);
+		}
+		key_free(k);
+	}
+	EXPECT_EQ(n * StorageMaxOldVersions, storage_val_count());
+	size = storage_get_current_size();
+	
+	// Readers at version 2 or later need versions 2 and newer,
+	// pruned 100 entries at a time
+	for (i = 0; i < 1000; i++)
+		storage_prune(2, 100);
+	EXPECT_EQ(n * (StorageMaxOldVersions - 1), storage_val_count());
+	
+	storage_prune(StorageMaxOldVersions, 1 << 30);
+	EXPECT_EQ(n, storage_val_count());
+	EXPECT_EQ(n * (StorageMaxOldVersions - 1), storage_pruned_count());
+	EXPECT_LT(storage_get_current_size(), size);
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, StorageMaxOldVersions);
+		EXPECT_PRED3(matchStorageVersion, k, v, StorageMaxOldVersions);
+		EXPECT_PRED3(matchStorageVersion, k, (val*)NULL, 1);
+		key_free(k);
+		val_free(v);
+	}
+}
+
+
+TEST_F(StorageTest, DeletedKeysReclaimed) {
+	key* k;
+	val* v;
+	val* tombstone = val_new(NULL, 0);
+	int i, n = 1000;
+	long size;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, 1);
+		storage_put(k, v, 1, 1);
+		val_free(v);
+		key_free(k);
+	}
+	size = storage_get_current_size();
+	
+	// Delete the even keys at version 2
+	tombstone->version = 2;
+	for (i = 0; i < n; i += 2) {
+		k = createKey(i);
+		storage_put(k, tombstone, 1, 1);
+		key_free(k);
+	}
+	
+	// A pinned entry is kept until unpinned
+	k = createKey(0);
+	storage_pin(k, 0);
+	
+	// Readers at version 1 still see the deleted keys
+	storage_prune(1, 1 << 30);
+	EXPECT_EQ(n, storage_key_count());
+	EXPECT_EQ(0, storage_reclaimed_count());
+	
+	storage_prune(2, 1 << 30);
+	EXPECT_EQ(n / 2 + 1, storage_key_count());
+	EXPECT_EQ(n / 2 + 1, storage_val_count());
+	EXPECT_EQ(n / 2 - 1, storage_reclaimed_count());
+	EXPECT_LT(storage_get_current_size(), size);
+	
+	storage_unpin(k, 0);
+	storage_prune(2, 1 << 30);
+	EXPECT_EQ(n / 2, storage_key_count());
+	key_free(k);
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, 1);
+		if (i % 2 == 0)
+			EXPECT_PRED3(matchStorageVersion, k, (val*)NULL, 2);
+		else
+			EXPECT_PRED3(matchStorageVersion, k, v, 2);
+		key_free(k);
+		val_free(v);
+	}
+	val_free(tombstone);
+}
+
+
+static key* createClassKey(char prefix, int i) {
+	std::string s(1, prefix);
+	s.append((char*)&i, sizeof(int));
+	return createKey(s);
+}
+
+
+static void addKeyClass(unsigned char prefix, int cache, int prio, long max) {
+	storage_key_class* c = &StorageKeyClasses[StorageKeyClassCount++];
+	c->prefix[0] = prefix;
+	c->prefix_len = 1;
+	c->cache = cache;
+	c->priority = prio;
+	c->max_bytes = max;
+}
+
+
+class KeyClassStorageTest : public StorageTest {
+protected:
+
+	virtual void SetUp() {
+		tapioca_init_defaults();
+		addKeyClass(0x4, 1, 2, 0);      // meta nodes, evicted last
+		addKeyClass(0x5, 1, 1, 0);      // nodes
+		addKeyClass(0x6, 0, 0, 0);      // never cached
+		addKeyClass(0x7, 1, 0, 4096);   // at most 4KB
+		storage_init2(mock_id_for_hash);
+	}
+	
+	void putKeys(char prefix, int n, int local) {
+		for (int i = 0; i < n; i++) {
+			key* k = createClassKey(prefix, i);
+			val* v = createVal(i, 1);
+			EXPECT_EQ(1, storage_put(k, v, local, 1));
+			key_free(k);
+			val_free(v);
+		}
+	}
+	
+	int countKeys(char prefix, int n) {
+		int found = 0;
+		for (int i = 0; i < n; i++) {
+			key* k = createClassKey(prefix, i);
+			val* v = storage_get(k, 1);
+			if (v != NULL) {
+				found++;
+				val_free(v);
+			}
+			key_free(k);
+		}
+		return found;
+	}
+};
+
+
+TEST_F(KeyClassStorageTest, NotCached) {
+	key* k = createClassKey(0x6, 1);
+	
+	putKeys(0x6, 100, 0);
+	EXPECT_EQ(0, storage_key_count());
+	EXPECT_EQ(0, storage_admit(k));
+	
+	// local keys are always stored
+	putKeys(0x6, 100, 1);
+	EXPECT_EQ(100, storage_key_count());
+	key_free(k);
+}
+
+
+TEST_F(KeyClassStorageTest, MaxBytes) {
+	putKeys(0x7, 1000, 0);
+	EXPECT_GT(storage_key_count(), 0);
+	EXPECT_LT(storage_key_count(), 1000);
+	EXPECT_LE(storage_key_class_cached_bytes(4), 4096);
+	EXPECT_GT(storage_key_class_cached_bytes(4), 4096 - 128);
+}
+
+
+TEST_F(KeyClassStorageTest, MaxBytesOnNewVersions) {
+	int n = 16;
+	
+	putKeys(0x7, n, 0);
+	EXPECT_EQ(n, storage_key_count());
+	
+	// Versions added to cached keys evict from the class
+	for (int version = 2; version < 10; version++) {
+		for (int i = 0; i < n; i++) {
+			key* k = createClassKey(0x7, i);
+			val* v = createVal(std::string(100, 'a' + i), version);
+			EXPECT_EQ(1, storage_put(k, v, 0, 1));
+			key_free(k);
+			val_free(v);
+			EXPECT_LE(storage_key_class_cached_bytes(4), 4096);
+		}
+	}
+	EXPECT_LT(storage_key_count(), n);
+}
+
+
+TEST_F(KeyClassStorageTest, OverBudgetClassEvictedFirst) {
+	int n = 10;
+	
+	putKeys(0x3, 100, 0);
+	putKeys(0x7, n, 0);
+	
+	// Pinned entries can't be trimmed: their new versions take the
+	// class over budget
+	for (int i = 0; i < n; i++) {
+		key* k = createClassKey(0x7, i);
+		EXPECT_EQ(1, storage_pin(k, i));
+		key_free(k);
+	}
+	for (int i = 0; i < n; i++) {
+		key* k = createClassKey(0x7, i);
+		val* v = createVal(std::string(1000, 'a'), 2);
+		EXPECT_EQ(1, storage_put(k, v, 0, 1));
+		key_free(k);
+		val_free(v);
+	}
+	EXPECT_GT(storage_key_class_cached_bytes(4), 4096);
+	for (int i = 0; i < n; i++) {
+		key* k = createClassKey(0x7, i);
+		storage_unpin(k, i);
+		key_free(k);
+	}
+	
+	// The default class has the same priority, but GC trims 0x7 first
+	storage_gc_at_least(1);
+	EXPECT_EQ(100, countKeys(0x3, 100));
+	EXPECT_EQ(n - 1, countKeys(0x7, n));
+}
+
+
+TEST_F(KeyClassStorageTest, EvictByPriority) {
+	int n = 1000;
+	
+	putKeys(0x4, n, 0);
+	putKeys(0x5, n, 0);
+	putKeys(0x3, n, 0);
+	EXPECT_EQ(3*n, storage_key_count());
+	
+	// Default class first, then nodes
+	storage_gc_at_least(storage_key_class_cached_bytes(0) +
+		storage_key_class_cached_bytes(2) / 2);
+	EXPECT_EQ(0, countKeys(0x3, n));
+	EXPECT_GT(countKeys(0x5, n), 0);
+	EXPECT_LT(countKeys(0x5, n), n);
+	EXPECT_EQ(n, countKeys(0x4, n));
+	EXPECT_EQ(0, storage_key_class_cached_bytes(0));
+}
+
+
+class ClockStorageTest : public StorageTest {
+protected:
+
+	virtual void SetUp() {
+		tapioca_init_defaults();
+		StorageEvictionPolicy = EVICTION_CLOCK;
+		storage_init2(mock_id_for_hash);
+	}
+};
+
+
+TEST_F(ClockStorageTest, GCSimple) {
+	key* k;
+	val* v;
+	int i, n = 100000;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, 1);
+		EXPECT_EQ(1, storage_put(k, v, 0, 1));
+		key_free(k);
+		val_free(v);
+	}
+	
+	storage_gc_at_least(1024*1024*1024);
+	
+	EXPECT_EQ(0, storage_key_count());
+	EXPECT_EQ(0, storage_val_count());
+	EXPECT_EQ(n, storage_eviction_count());
+}
+
+
+TEST_F(ClockStorageTest, ReferencedSurvive) {
+	key* k;
+	val* v;
+	val* rv;
+	int i, n = 100000;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, 1);
+		EXPECT_EQ(1, storage_put(k, v, 0, 1));
+		key_free(k);
+		val_free(v);
+	}
+	
+	// reference even keys only
+	for (i = 0; i < n; i += 2) {
+		k = createKey(i);
+		rv = storage_get(k, 1);
+		EXPECT_TRUE(rv != NULL);
+		val_free(rv);
+		key_free(k);
+	}
+	EXPECT_EQ(n / 2, storage_cache_hit_count());
+	
+	storage_gc_at_least(storage_get_current_size() / 4);
+	EXPECT_GT(storage_eviction_count(), 0);
+	
+	for (i = 0; i < n; i += 2) {
+		k = createKey(i);
+		rv = storage_get(k, 1);
+		EXPECT_TRUE(rv != NULL);
+		val_free(rv);
+		key_free(k);
+	}
+	EXPECT_EQ(n, storage_cache_hit_count());
+}
+
+
+TEST_F(ClockStorageTest, PinnedNotEvicted) {
+	key* k;
+	val* v;
+	int i, n = 1000;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, 1);
+		EXPECT_EQ(1, storage_put(k, v, 0, 1));
+		if (i % 10 == 0)
+			EXPECT_EQ(1, storage_pin(k, i));
+		key_free(k);
+		val_free(v);
+	}
+	
+	storage_gc_at_least(1024*1024*1024);
+	EXPECT_EQ(n / 10, storage_key_count());
+}
+
+
+TEST_F(ClockStorageTest, LocalNotEvicted) {
+	key* k;
+	val* v;
+	int i, n = 1000;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, 1);
+		EXPECT_EQ(1, storage_put(k, v, i % 2, 1));
+		key_free(k);
+		val_free(v);
+	}
+	
+	storage_gc_at_least(1024*1024*1024);
+	
+	EXPECT_EQ(n / 2, storage_key_count());
+	EXPECT_EQ(n / 2, storage_eviction_count());
+}
+
+
+class SpillStorageTest : public StorageTest {
+protected:
+
+	virtual void SetUp() {
+		tapioca_init_defaults();
+		StorageSpillPath = (char*)"/tmp/storage_unittest.spill";
+		StorageSpillSize = 64*1024*1024;
+		storage_init2(mock_id_for_hash);
+	}
+	
+	virtual void TearDown() {
+		storage_free();
+		StorageSpillPath = NULL;
+	}
+};
+
+
+TEST_F(SpillStorageTest, SpillLocalKeys) {
+	key* k;
+	val* v;
+	val* rv;
+	int i, n = 10000;
+	long size;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(std::string(100, 'a' + (i % 26)), 1);
+		EXPECT_EQ(1, storage_put(k, v, 1, 0));
+		val_free(v);
+		v = createVal(std::string(100, 'A' + (i % 26)), 2);
+		EXPECT_EQ(1, storage_put(k, v, 1, 0));
+		key_free(k);
+		val_free(v);
+	}
+	
+	size = storage_get_current_size();
+	storage_gc_at_least(1024*1024*1024);
+	EXPECT_EQ(n, storage_spilled_count());
+	EXPECT_EQ(n, storage_key_count());
+	EXPECT_EQ(2 * n, storage_val_count());
+	EXPECT_LT(storage_get_current_size(), size / 2);
+	
+	// Old and new versions are brought back
+	for (i = 0; i < n; i += 10) {
+		k = createKey(i);
+		v = createVal(std::string(100, 'a' + (i % 26)), 1);
+		rv = storage_get(k, 1);
+		ASSERT_TRUE(rv != NULL);
+		EXPECT_PRED2(valEqual, rv, v);
+		val_free(rv);
+		val_free(v);
+		v = createVal(std::string(100, 'A' + (i % 26)), 2);
+		rv = storage_get(k, 2);
+		ASSERT_TRUE(rv != NULL);
+		EXPECT_PRED2(valEqual, rv, v);
+		val_free(rv);
+		val_free(v);
+		key_free(k);
+	}
+	EXPECT_EQ(n / 10, storage_spill_fault_count());
+	EXPECT_EQ(n - n / 10, storage_spilled_count());
+}
+
+
+TEST_F(SpillStorageTest, HotKeysStay) {
+	key* k;
+	val* v;
+	int i, n = 1000;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(std::string(100, 'a'), 1);
+		EXPECT_EQ(1, storage_put(k, v, 1, 0));
+		key_free(k);
+		val_free(v);
+	}
+	
+	for (i = 0; i < n; i += 2) {
+		k = createKey(i);
+		val_free(storage_get(k, 1));
+		key_free(k);
+	}
+	storage_gc_budget(100 * 100, 0);
+	EXPECT_GT(storage_spilled_count(), 0);
+	EXPECT_LT(storage_spilled_count(), n / 2);
+	
+	for (i = 0; i < n; i += 2) {
+		k = createKey(i);
+		val_free(storage_get(k, 1));
+		key_free(k);
+	}
+	EXPECT_EQ(0, storage_spill_fault_count());
+}
+
+
+TEST_F(SpillStorageTest, PutOnSpilledKey) {
+	key* k = createKey(1);
+	val* v1 = createVal(std::string(100, 'a'), 1);
+	val* v2 = createVal(std::string(100, 'b'), 2);
+	val* rv;
+	
+	storage_put(k, v1, 1, 0);
+	storage_gc_at_least(1024*1024*1024);
+	EXPECT_EQ(1, storage_spilled_count());
+	storage_put(k, v2, 1, 0);
+	EXPECT_EQ(0, storage_spilled_count());
+	EXPECT_EQ(2, storage_val_count());
+	
+	rv = storage_get(k, 1);
+	EXPECT_PRED2(valEqual, rv, v1);
+	val_free(rv);
+	
+	key_free(k);
+	val_free(v1);
+	val_free(v2);
+}
+
+
+static key* createOrderedKey(char prefix, int i) {
+	std::string s(1, prefix);
+	i = htonl(i);
+	s.append((char*)&i, sizeof(int));
+	return createKey(s);
+}
+
+
+static int collectRange(key* k, val* v, void* arg) {
+	std::vector<int>* found = (std::vector<int>*)arg;
+	found->push_back(ntohl(*(int*)((char*)k->data + 1)));
+	return found->size() >= 1000;
+}
+
+
+class OrderedStorageTest : public StorageTest {
+protected:
+
+	virtual void SetUp() {
+		tapioca_init_defaults();
+		StorageOrderedPrefix[0] = 'r';
+		StorageOrderedPrefixLen = 1;
+		storage_init2(mock_id_for_hash);
+	}
+	
+	void putKey(char prefix, int i, int version, int local) {
+		key* k = createOrderedKey(prefix, i);
+		val* v = createVal(i, version);
+		storage_put(k, v, local, 1);
+		key_free(k);
+		val_free(v);
+	}
+};
+
+
+TEST_F(StorageTest, RangeWithoutOrderedIndex) {
+	EXPECT_EQ(-1, storage_range(NULL, NULL, 1, collectRange, NULL));
+	EXPECT_EQ(0, storage_ordered_count());
+}
+
+
+TEST_F(OrderedStorageTest, Range) {
+	int i, n = 100;
+	key *start, *end;
+	std::vector<int> found;
+	
+	for (i = n - 1; i >= 0; i--) {
+		putKey('r', i, 1, 1);
+		putKey('x', i, 1, 1);
+	}
+	putKey('r', n, 1, 0);	// cached, not local
+	EXPECT_EQ(n + 1, storage_ordered_count());
+	
+	EXPECT_EQ(n, storage_range(NULL, NULL, 1, collectRange, &found));
+	for (i = 0; i < n; i++)
+		EXPECT_EQ(i, found[i]);
+	
+	found.clear();
+	start = createOrderedKey('r', 10);
+	end = createOrderedKey('r', 20);
+	EXPECT_EQ(10, storage_range(start, end, 1, collectRange, &found));
+	EXPECT_EQ(10, found[0]);
+	EXPECT_EQ(19, found[9]);
+	
+	// Keys with no version old enough, or deleted, are skipped
+	putKey('r', 1000, 3, 1);
+	found.clear();
+	EXPECT_EQ(n, storage_range(NULL, NULL, 2, collectRange, &found));
+	found.clear();
+	EXPECT_EQ(n + 1, storage_range(NULL, NULL, 3, collectRange, &found));
+	EXPECT_EQ(1000, found.back());
+	
+	key* k = createOrderedKey('r', 12);
+	val* tombstone = val_new(NULL, 0);
+	tombstone->version = 4;
+	storage_put(k, tombstone, 1, 1);
+	found.clear();
+	EXPECT_EQ(9, storage_range(start, end, 4, collectRange, &found));
+	EXPECT_EQ(13, found[2]);
+	
+	// Reclaimed keys leave the ordered index
+	storage_prune(4, 1 << 30);
+	EXPECT_EQ(n + 1, storage_ordered_count());
+	
+	key_free(k);
+	val_free(tombstone);
+	key_free(start);
+	key_free(end);
+}
+
+
+TEST_F(OrderedStorageTest, RangeStops) {
+	int i, n = 2000;
+	std::vector<int> found;
+	
+	for (i = 0; i < n; i++)
+		putKey('r', i, 1, 1);
+	EXPECT_EQ(1000, storage_range(NULL, NULL, 1, collectRange, &found));
+	EXPECT_EQ(999, found.back());
+}
+
+
+class CompressedStorageTest : public StorageTest {
+protected:
+
+	virtual void SetUp() {
+		tapioca_init_defaults();
+		StorageCompressThreshold = 64;
+		storage_init2(mock_id_for_hash);
+	}
+};
+
+
+TEST_F(CompressedStorageTest, CompressibleValue) {
+	long compressed = vset_compressed_count();
+	key* k = createKey(1);
+	val* v = createVal(std::string(4096, 'a'), 1);
+	val* rv;
+	
+	storage_put(k, v, 1, 1);
+	EXPECT_EQ(compressed + 1, vset_compressed_count());
+	EXPECT_LT(storage_get_current_size(), 1024);
+	
+	rv = storage_get(k, 1);
+	EXPECT_PRED2(valEqual, rv, v);
+	
+	key_free(k);
+	val_free(v);
+	val_free(rv);
+}
+
+
+TEST_F(CompressedStorageTest, IncompressibleAndSmallValues) {
+	int i;
+	long compressed = vset_compressed_count();
+	std::string s(4096, 0);
+	key* k = createKey(1);
+	key* k2 = createKey(2);
+	val *v, *v2, *rv;
+	
+	srand(1);
+	for (i = 0; i < 4096; i++)
+		s[i] = rand();
+	v = createVal(s, 1);
+	v2 = createVal(2, 1);
+	storage_put(k, v, 1, 1);
+	storage_put(k2, v2, 1, 1);
+	EXPECT_EQ(compressed, vset_compressed_count());
+	
+	rv = storage_get(k, 1);
+	EXPECT_PRED2(valEqual, rv, v);
+	val_free(rv);
+	rv = storage_get(k2, 1);
+	EXPECT_PRED2(valEqual, rv, v2);
+	val_free(rv);
+	
+	key_free(k);
+	key_free(k2);
+	val_free(v);
+	val_free(v2);
+}
+
+
+TEST_F(CompressedStorageTest, SmallValuesUntagged) {
+	int bytes;
+	vset s;
+	val* v = createVal(std::string(8, 'a'), 1);
+	val* rv;
+	
+	// Small values take the same room as without compression
+	s = vset_new();
+	vset_add(s, v);
+	bytes = vset_allocated_bytes(s);
+	rv = vset_get(s, 1);
+	EXPECT_PRED2(valEqual, rv, v);
+	val_free(rv);
+	vset_free(s);
+	
+	StorageCompressThreshold = 0;
+	s = vset_new();
+	vset_add(s, v);
+	EXPECT_EQ(vset_allocated_bytes(s), bytes);
+	vset_free(s);
+	
+	val_free(v);
+}
+
+
+TEST_F(CompressedStorageTest, ViewsShareHotCopy) {
+	long hits = vset_hot_hit_count();
+	val_view w, w2;
+	key* k = createKey(1);
+	val* v = createVal(std::string(1000, 'a'), 1);
+	val* v2 = createVal(std::string(1000, 'b'), 2);
+	
+	storage_put(k, v, 1, 1);
+	EXPECT_EQ(1, storage_get_view(k, 1, &w));
+	EXPECT_EQ(1, storage_get_view(k, 1, &w2));
+	EXPECT_EQ(hits + 1, vset_hot_hit_count());
+	EXPECT_EQ(1000, w2.size);
+	EXPECT_EQ(w.data, w2.data);
+	
+	storage_view_release(&w2);
+	
+	// A new version does not change the value already viewed
+	storage_put(k, v2, 1, 1);
+	EXPECT_EQ(1, storage_get_view(k, 2, &w2));
+	EXPECT_EQ(0, memcmp(w.data, v->data, 1000));
+	EXPECT_EQ(0, memcmp(w2.data, v2->data, 1000));
+	storage_view_release(&w);
+	storage_view_release(&w2);
+	
+	key_free(k);
+	val_free(v);
+	val_free(v2);
+}
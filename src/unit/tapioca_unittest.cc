@@ -256,6 +256,47 @@ TEST_F(TapiocaTest, Rollback) {
 	}
 }
 
+TEST_F(TapiocaTest, DeleteCommitted) {
+	int v = 0;
+	int k = 1234;
+
+	EXPECT_EQ(1, tapioca_put_int(th, k, 4321));
+	EXPECT_GE(tapioca_commit(th), 0);
+	
+	EXPECT_EQ(1, tapioca_delete(th, &k, sizeof(int)));
+	EXPECT_EQ(0, tapioca_get_int(th, k, &v));
+	EXPECT_GE(tapioca_commit(th), 0);
+	
+	EXPECT_EQ(0, tapioca_get_int(th, k, &v));
+	EXPECT_EQ(v, 0);
+	EXPECT_GE(tapioca_commit(th), 0);
+}
+
+
+TEST_F(TapiocaTest, MDelete) {
+	int v = 0;
+	int count = 10;
+	
+	for (int i = 0; i < count; i++)
+		EXPECT_EQ(1, tapioca_put_int(th, i, i));
+	EXPECT_GE(tapioca_commit(th), 0);
+	
+	for (int i = 0; i < count; i += 2)
+		tapioca_mdelete(th, &i, sizeof(int));
+	EXPECT_GE(tapioca_mput_commit(th), 0);
+	
+	for (int i = 0; i < count; i++) {
+		v = 0;
+		if (i % 2 == 0) {
+			EXPECT_EQ(0, tapioca_get_int(th, i, &v));
+		} else {
+			EXPECT_EQ((int)sizeof(int), tapioca_get_int(th, i, &v));
+			EXPECT_EQ(i, v);
+		}
+	}
+	EXPECT_GE(tapioca_commit(th), 0);
+}
+
 /* TODO Re-enable this test
 TEST_F(TapiocaTest, RecoverySimple) {
 	key* k;
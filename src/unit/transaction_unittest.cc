@@ -18,9 +18,12 @@
 */
 
 #include <gtest/gtest.h>
+#include <vector>
 #include "tapiocadb.h"
 #include "transaction.h"
 #include "storage.h"
+#include "hash.h"
+#include "recent_writes.h"
 #include "test_helpers.h"
 
 class TransactionTest : public testing::Test {
@@ -72,3 +75,280 @@ TEST_F(TransactionTest, ReadOnly) {
 	
 	EXPECT_EQ(1, transaction_read_only(t));
 }
+
+
+TEST_F(TransactionTest, PutOverwrites) {
+	key* k = createKey(1);
+	val* v = createVal(std::string(10, 'a'), 0);
+	val* v2 = createVal(std::string(100, 'b'), 0);
+	val* rv;
+	
+	transaction_put(t, k, v);
+	transaction_put(t, k, v2);
+	rv = transaction_get(t, k);
+	EXPECT_EQ(100, rv->size);
+	EXPECT_EQ(0, memcmp(rv->data, v2->data, 100));
+	EXPECT_EQ(0, transaction_read_only(t));
+	
+	key_free(k);
+	val_free(v);
+	val_free(v2);
+	val_free(rv);
+}
+
+
+TEST_F(TransactionTest, ClearReusesSets) {
+	key* k;
+	val* v;
+	int i, round, n;
+	int size = 64*1024;
+	std::vector<char> buffer(size);
+	tr_submit_msg* msg = (tr_submit_msg*)&buffer[0];
+	
+	for (round = 0; round < 3; round++) {
+		n = (round == 1) ? 500 : 20;
+		for (i = 0; i < n; i++) {
+			k = createKey(i);
+			v = createVal(i + round, 0);
+			val_free(transaction_get(t, k));
+			transaction_put(t, k, v);
+			key_free(k);
+			val_free(v);
+		}
+		ASSERT_GT(transaction_serialize(t, msg, size), 0);
+		EXPECT_EQ(n, msg->readset_count);
+		EXPECT_EQ(n, msg->writeset_count);
+		
+		k = createKey(n - 1);
+		v = transaction_get(t, k);
+		EXPECT_EQ(n - 1 + round, *(int*)v->data);
+		key_free(k);
+		val_free(v);
+		
+		transaction_clear(t);
+		EXPECT_EQ(1, transaction_read_only(t));
+	}
+}
+
+
+TEST_F(TransactionTest, LargeReadsNotKept) {
+	int i, n = 10;
+	key* k;
+	val* v = createVal(std::string(32*1024, 'a'), 0);
+	val* rv;
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(storage_items + i);
+		storage_put(k, v, 1, 1);
+		key_free(k);
+	}
+	
+	for (i = 0; i < 2 * n; i++) {
+		k = createKey(storage_items + (i % n));
+		rv = transaction_get(t, k);
+		EXPECT_PRED2(valEqual, rv, v);
+		key_free(k);
+		val_free(rv);
+	}
+	EXPECT_LT(arena_used(t->mem), v->size);
+	
+	val_free(v);
+}
+
+
+TEST_F(TransactionTest, LargeReadNotRepeatedAborts) {
+	key* k = createKey(storage_items);
+	val* v = createVal(std::string(1024, 'a'), 1);
+	val* v2 = createVal(std::string(1024, 'b'), 2);
+	val* rv;
+	long aborts = transaction_local_abort_count();
+	
+	cproxy_set_st(5);
+	storage_put(k, v, 1, 1);
+	rv = transaction_get(t, k);
+	EXPECT_PRED2(valEqual, rv, v);
+	val_free(rv);
+	
+	// The read now returns version 2, as if version 1 had been dropped
+	storage_put(k, v2, 1, 1);
+	val_free(transaction_get(t, k));
+	EXPECT_FALSE(transaction_read_only(t));
+	EXPECT_EQ(T_ABORTED, transaction_commit(t, 1, NULL));
+	EXPECT_EQ(aborts + 1, transaction_local_abort_count());
+	
+	transaction_clear(t);
+	EXPECT_TRUE(transaction_read_only(t));
+	cproxy_set_st(0);
+	key_free(k);
+	val_free(v);
+	val_free(v2);
+}
+
+
+// Remote gets are answered by the test, and their values not stored
+static int remote_gets;
+static transaction_cb remote_cb;
+static void* remote_arg;
+
+static void mockRemoteGet(key* k, int version, transaction_cb cb, void* arg) {
+	remote_gets++;
+	remote_cb = cb;
+	remote_arg = arg;
+}
+
+// Reads the keys again, as tcp.c does when the reply of an mget arrives
+static int rereads;
+static key* reread_keys[2];
+
+static void onRemoteGet(key* k, val* v, void* arg) {
+	transaction* t = (transaction*)arg;
+	val* rv;
+	for (int i = 0; i < 2; i++) {
+		if ((rv = transaction_get(t, reread_keys[i])) == NULL)
+			return;
+		val_free(rv);
+	}
+	rereads++;
+}
+
+
+TEST_F(TransactionTest, LargeRemoteReadsKept) {
+	key* k1 = createKey(storage_items);
+	key* k2 = createKey(storage_items + 1);
+	val* v = createVal(std::string(1024, 'a'), 0);
+	
+	remote_gets = 0;
+	rereads = 0;
+	reread_keys[0] = k1;
+	reread_keys[1] = k2;
+	transaction_set_remote_get(mockRemoteGet);
+	transaction_set_get_cb(t, onRemoteGet, t);
+	
+	EXPECT_TRUE(transaction_get(t, k1) == NULL);
+	EXPECT_EQ(1, remote_gets);
+	remote_cb(k1, v, remote_arg);
+	EXPECT_EQ(2, remote_gets);
+	remote_cb(k2, v, remote_arg);
+	EXPECT_EQ(2, remote_gets);
+	EXPECT_EQ(1, rereads);
+	EXPECT_TRUE(storage_get(k1, 0) == NULL);
+	EXPECT_TRUE(transaction_read_only(t));
+	
+	transaction_set_remote_get(NULL);
+	key_free(k1);
+	key_free(k2);
+	val_free(v);
+}
+
+
+TEST_F(TransactionTest, SerializeLayout) {
+	int i, n = 10;
+	key* k;
+	val* v;
+	flat_key_hash h;
+	flat_key_hash* hashes;
+	flat_key_val* kv;
+	std::vector<char> buffer(64*1024);
+	tr_submit_msg* msg = (tr_submit_msg*)&buffer[0];
+	
+	for (i = 0; i < n; i++) {
+		k = createKey(i);
+		v = createVal(i, 0);
+		if (i % 2 == 0)
+			val_free(transaction_get(t, k));
+		else
+			transaction_put(t, k, v);
+		key_free(k);
+		val_free(v);
+	}
+	
+	EXPECT_EQ(transaction_serialized_size(t),
+		transaction_serialize(t, msg, buffer.size()));
+	EXPECT_EQ(-1, transaction_serialize(t, msg, sizeof(tr_submit_msg)));
+	EXPECT_EQ(n / 2, msg->readset_count);
+	EXPECT_EQ(n / 2, msg->writeset_count);
+	
+	hashes = (flat_key_hash*)msg->data;
+	kv = (flat_key_val*)&hashes[n];
+	for (i = 0; i < n / 2; i++) {
+		k = createKey(2 * i + 1);
+		key_hash_pair((char*)k->data, k->size, h.hash);
+		EXPECT_EQ(0, memcmp(&h, &hashes[n / 2 + i], sizeof(h)));
+		EXPECT_EQ(k->size, kv->ksize);
+		EXPECT_EQ(0, memcmp(k->data, kv->data, k->size));
+		EXPECT_EQ(2 * i + 1, *(int*)&kv->data[kv->ksize]);
+		kv = (flat_key_val*)((char*)kv + FLAT_KEY_VAL_SIZE(kv));
+		key_free(k);
+	}
+	EXPECT_EQ((char*)kv - (char*)&hashes[n], msg->writeset_size);
+}
+
+
+TEST_F(TransactionTest, AbortedLocally) {
+	key* k = createKey(1);
+	key* k2 = createKey(2);
+	val* v = createVal(1, 0);
+	unsigned int h[2];
+	long aborts = transaction_local_abort_count();
+	
+	recent_writes_init(1024);
+	cproxy_set_st(5);
+	val_free(transaction_get(t, k));
+	transaction_put(t, k2, v);
+	
+	// k was written after the snapshot of t
+	key_hash_pair((char*)k->data, k->size, h);
+	recent_writes_add(h, 6);
+	EXPECT_EQ(T_ABORTED, transaction_commit(t, 1, NULL));
+	EXPECT_EQ(aborts + 1, transaction_local_abort_count());
+	transaction_clear(t);
+	
+	// An old snapshot is left to the certifier, which may accept it
+	val_free(transaction_get(t, k2));
+	transaction_put(t, k2, v);
+	cproxy_set_st(6 + MaxPreviousST);
+	EXPECT_EQ(0, transaction_commit(t, 1, NULL));
+	EXPECT_EQ(aborts + 1, transaction_local_abort_count());
+	
+	cproxy_set_st(0);
+	recent_writes_free();
+	key_free(k);
+	key_free(k2);
+	val_free(v);
+}
+
+
+static int countRange(key* k, val* v, void* arg) {
+	(*(int*)arg)++;
+	return 0;
+}
+
+
+TEST_F(TransactionTest, RangeOnlyInReadOnly) {
+	int n = 0;
+	key* k = createKey(1);
+	val* v = createVal(1, 0);
+	
+	StorageOrderedPrefix[0] = 'r';
+	StorageOrderedPrefixLen = 1;
+	storage_init();
+	
+	// A scan after a write could miss a concurrent insert in the range
+	transaction_put(t, k, v);
+	EXPECT_EQ(-1, transaction_range(t, NULL, NULL, countRange, &n));
+	transaction_clear(t);
+	
+	EXPECT_EQ(0, transaction_range(t, NULL, NULL, countRange, &n));
+	EXPECT_EQ(0, n);
+	EXPECT_TRUE(transaction_read_only(t));
+	transaction_put(t, k, v);
+	EXPECT_EQ(-1, transaction_commit(t, 1, NULL));
+	transaction_clear(t);
+	
+	// Cleared, t can write again
+	transaction_put(t, k, v);
+	EXPECT_EQ(0, transaction_commit(t, 1, NULL));
+	
+	key_free(k);
+	val_free(v);
+}
@@ -0,0 +1,173 @@
+/*
+    Copyright (C) 2013 University of Lugano
+
+	This file is part of the MoSQL storage system. 
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <gtest/gtest.h>
+#include <vector>
+#include <algorithm>
+#include <string.h>
+#include "tapiocadb.h"
+#include "validation.h"
+
+
+class ValidationTest : public testing::Test {
+protected:
+
+	char buffer[64*1024];
+	
+	virtual void SetUp() {
+		tapioca_init_defaults();
+	}
+	
+	virtual void TearDown() {
+		validation_cleanup();
+	}
+	
+	void initValidation(int mode, int previous) {
+		ValidationMode = mode;
+		MaxPreviousST = previous;
+		init_validation();
+	}
+	
+	static void keyHash(int k, unsigned int* h) {
+		h[0] = k * 2654435761u;
+		h[1] = k * 40503u + k * k;
+	}
+	
+	tr_submit_msg* createTransaction(int start, const std::vector<int>& reads,
+		const std::vector<int>& writes) {
+		int i;
+		tr_submit_msg* t = (tr_submit_msg*)buffer;
+		flat_key_hash* h = (flat_key_hash*)t->data;
+		
+		memset(t, 0, sizeof(tr_submit_msg));
+		t->hash_version = HashVersion;
+		t->start = start;
+		t->readset_count = reads.size();
+		t->writeset_count = writes.size();
+		for (i = 0; i < reads.size(); i++)
+			keyHash(reads[i], h[i].hash);
+		for (i = 0; i < writes.size(); i++)
+			keyHash(writes[i], h[reads.size() + i].hash);
+		return t;
+	}
+	
+	int validate(int start, const std::vector<int>& reads,
+		const std::vector<int>& writes) {
+		return validate_transaction(createTransaction(start, reads, writes));
+	}
+	
+	// Ends the buffer, as the certifier does when submitting it
+	void deliver() {
+		struct evbuffer* b = evbuffer_new();
+		add_validation_state(b);
+		evbuffer_free(b);
+		reset_validation_buffer();
+	}
+};
+
+
+TEST_F(ValidationTest, ExactConflicts) {
+	initValidation(VALIDATION_EXACT, 8);
+	
+	EXPECT_EQ(1, validate(0, {}, {1}));
+	EXPECT_EQ(0, validate(0, {1}, {2}));
+	deliver();
+	EXPECT_EQ(0, validate(0, {1}, {}));
+	EXPECT_EQ(1, validate(1, {1}, {}));
+	EXPECT_EQ(1, validate(0, {2, 3}, {}));
+}
+
+
+TEST_F(ValidationTest, ExactHasNoAgeLimit) {
+	int i;
+	
+	initValidation(VALIDATION_EXACT, 4);
+	validate(0, {}, {1});
+	for (i = 0; i < 10; i++)
+		deliver();
+	EXPECT_EQ(1, validate(1, {1}, {}));
+	EXPECT_EQ(0, validate(0, {1}, {}));
+}
+
+
+TEST_F(ValidationTest, ExactEvictedKeysConflict) {
+	int i;
+	
+	ValidationExactSize = 16;
+	initValidation(VALIDATION_EXACT, 8);
+	for (i = 1; i <= 13; i++) {
+		validate(i - 1, {}, {100 + i});
+		deliver();
+	}
+	
+	// 101 was evicted with the writes up to the horizon, ST 7
+	EXPECT_EQ(0, validate(6, {101}, {}));
+	EXPECT_EQ(1, validate(7, {101}, {}));
+	EXPECT_EQ(0, validate(7, {110}, {}));
+	EXPECT_EQ(1, validate(10, {110}, {}));
+}
+
+
+
+// Checks the summaries against the last ST each key was written at
+class SummariesTest : public ValidationTest,
+	public testing::WithParamInterface<int> { };
+
+INSTANTIATE_TEST_CASE_P(MaxPreviousST, SummariesTest,
+	testing::Values(1, 3, 16, 64));
+
+
+TEST_P(SummariesTest, MatchBruteForce) {
+	std::vector<int> last_write(20000, -1);
+	int real = 0, false_aborts = 0, commits = 0;
+	
+	initValidation(VALIDATION_BLOOM, GetParam());
+	srand(GetParam());
+	for (int st = 0; st < 400; st++) {
+		for (int k = 0; k < 20; k++) {
+			std::vector<int> reads(8), writes(4);
+			int age = rand() % (GetParam() + 3);
+			int start = std::max(validation_ST() - age, 0);
+			int old = start < validation_ST() - GetParam();
+			int conflict = 0;
+			for (int i = 0; i < 8; i++) {
+				reads[i] = rand() % last_write.size();
+				if (last_write[reads[i]] > start)
+					conflict = 1;
+			}
+			for (int i = 0; i < 4; i++)
+				writes[i] = rand() % last_write.size();
+			
+			int committed = validate(start, reads, writes);
+			ASSERT_FALSE(committed && (conflict || old)) << "ST " << st;
+			if (committed) {
+				commits++;
+				for (int i = 0; i < 4; i++)
+					last_write[writes[i]] = validation_ST() + 1;
+			} else if (conflict) {
+				real++;
+			} else if (!old) {
+				false_aborts++;
+			}
+		}
+		deliver();
+	}
+	EXPECT_GT(real, 0);
+	EXPECT_LT(false_aborts, commits / 20);
+}
@@ -23,13 +23,14 @@
 #include "test_helpers.h"
 
 
-class VsetTest : public testing::Test {
+class VsetTest : public testing::TestWithParam<int> {
 protected:
 	
 	vset vs;
 	
 	virtual void SetUp() {
 		tapioca_init_defaults();
+		StorageVsetType = GetParam();
 		vs = vset_new();
 	}
 	
@@ -39,13 +40,17 @@ protected:
 };
 
 
-TEST_F(VsetTest, GetEmpty) {
+INSTANTIATE_TEST_CASE_P(AllVsets, VsetTest, testing::Values(VSET_LIST,
+	VSET_ARRAY, VSET_ARRAY_SORTED, VSET_ARRAY_CACHE, VSET_COMPACT));
+
+
+TEST_P(VsetTest, GetEmpty) {
 	EXPECT_TRUE(vset_get(vs, 1) == NULL);
 	EXPECT_EQ(0, vset_count(vs));
 }
 
 
-TEST_F(VsetTest, GetExisting) {
+TEST_P(VsetTest, GetExisting) {
 	int i;
 	val* v;
 	val* check;
@@ -68,7 +73,7 @@ TEST_F(VsetTest, GetExisting) {
 }
 
 
-TEST_F(VsetTest, GetTooOld) {
+TEST_P(VsetTest, GetTooOld) {
 	val* v;
 	int count = 2*StorageMaxOldVersions;
 	
@@ -87,7 +92,104 @@ TEST_F(VsetTest, GetTooOld) {
 }
 
 
-TEST_F(VsetTest, AllocatedBytes) {
+TEST_P(VsetTest, AddOutOfOrder) {
+	val* v;
+	val* check;
+	int versions[] = {3, 1, 4, 2};
+	
+	for (int i = 0; i < 4; i++) {
+		v = createVal(versions[i], versions[i]);
+		EXPECT_EQ(0, vset_add(vs, v));
+		val_free(v);
+	}
+	
+	for (int i = 1; i <= 4; i++) {
+		v = vset_get(vs, i);
+		check = createVal(i, i);
+		EXPECT_PRED2(valVersionEqual, v, check);
+		val_free(v);
+		val_free(check);
+	}
+}
+
+
+TEST_P(VsetTest, OverwriteVersion) {
+	val* v;
+	val* check;
+	std::string big;
+	
+	big.assign(100, 'b');
+	v = createVal(1, 1);
+	vset_add(vs, v);
+	val_free(v);
+	v = createVal(big, 1);
+	vset_add(vs, v);
+	
+	EXPECT_EQ(1, vset_count(vs));
+	check = vset_get(vs, 1);
+	EXPECT_PRED2(valVersionEqual, check, v);
+	val_free(check);
+	val_free(v);
+}
+
+
+TEST_P(VsetTest, Prune) {
+	val* v;
+	val* check;
+	
+	for (int i = 1; i <= StorageMaxOldVersions; i++) {
+		v = createVal(i, 10*i);
+		vset_add(vs, v);
+		val_free(v);
+	}
+	
+	// Nothing at or below version 5
+	EXPECT_EQ(0, vset_prune(vs, 5));
+	EXPECT_EQ(StorageMaxOldVersions, vset_count(vs));
+	
+	// Keep version 20 and newer ones
+	EXPECT_EQ(1, vset_prune(vs, 25));
+	EXPECT_EQ(StorageMaxOldVersions - 1, vset_count(vs));
+	EXPECT_TRUE(vset_get(vs, 15) == NULL);
+	check = createVal(2, 20);
+	v = vset_get(vs, 25);
+	EXPECT_PRED2(valVersionEqual, v, check);
+	val_free(v);
+	val_free(check);
+	
+	// Keep the newest only
+	EXPECT_EQ(StorageMaxOldVersions - 2, vset_prune(vs, 1000));
+	EXPECT_EQ(1, vset_count(vs));
+	check = createVal(StorageMaxOldVersions, 10*StorageMaxOldVersions);
+	v = vset_get(vs, 1000);
+	EXPECT_PRED2(valVersionEqual, v, check);
+	val_free(v);
+	val_free(check);
+}
+
+
+/*
+	The fixed size of array_cache vsets lets allocated bytes grow by
+	exactly the size of the values.
+*/
+class ArrayCacheVsetTest : public testing::Test {
+protected:
+	
+	vset vs;
+	
+	virtual void SetUp() {
+		tapioca_init_defaults();
+		StorageVsetType = VSET_ARRAY_CACHE;
+		vs = vset_new();
+	}
+	
+	virtual void TearDown() {
+		vset_free(vs);
+	}
+};
+
+
+TEST_F(ArrayCacheVsetTest, AllocatedBytes) {
 	val* v;
 	std::string s;
 	int bytes = vset_allocated_bytes(vs);
@@ -101,3 +203,101 @@ TEST_F(VsetTest, AllocatedBytes) {
 			bytes = vset_allocated_bytes(vs);
 	}
 }
+
+
+class CompactVsetTest : public ArrayCacheVsetTest {
+protected:
+	
+	virtual void SetUp() {
+		tapioca_init_defaults();
+		StorageVsetType = VSET_COMPACT;
+		vs = vset_new();
+	}
+};
+
+
+// Values of 64 KiB or more, whose size does not fit 16 bits
+TEST_F(CompactVsetTest, LargeValues) {
+	val* v;
+	val* check;
+	val* large = createVal(std::string(70000, 'a'), 1);
+	val* larger = createVal(std::string(140000, 'b'), 2);
+	
+	vset_add(vs, large);
+	v = vset_get(vs, 1);
+	EXPECT_PRED2(valEqual, v, large);
+	val_free(v);
+	
+	vset_add(vs, larger);
+	v = vset_get(vs, 2);
+	EXPECT_PRED2(valEqual, v, larger);
+	val_free(v);
+	check = vset_get(vs, 1);
+	EXPECT_PRED2(valEqual, check, large);
+	val_free(check);
+	
+	val_free(large);
+	val_free(larger);
+}
+
+
+TEST_F(CompactVsetTest, SmallValuesInline) {
+	val* v;
+	val* check;
+	int bytes = vset_allocated_bytes(vs);
+	
+	v = createVal(42, 1);
+	vset_add(vs, v);
+	EXPECT_EQ(bytes, vset_allocated_bytes(vs));
+	check = vset_get(vs, 1);
+	EXPECT_PRED2(valVersionEqual, check, v);
+	val_free(check);
+	val_free(v);
+}
+
+
+TEST_F(CompactVsetTest, GrowsOnSecondVersion) {
+	val* v;
+	val* check;
+	std::string s;
+	int bytes = vset_allocated_bytes(vs);
+	
+	s.assign(1000, 'a');
+	v = createVal(s, 1);
+	vset_add(vs, v);
+	val_free(v);
+	EXPECT_EQ(bytes + 1000, vset_allocated_bytes(vs));
+	
+	v = createVal(s, 2);
+	vset_add(vs, v);
+	val_free(v);
+	EXPECT_GT(vset_allocated_bytes(vs), bytes + 2000);
+	EXPECT_LT(vset_allocated_bytes(vs), bytes + 2000 + 64);
+	
+	for (int i = 1; i <= 2; i++) {
+		v = createVal(s, i);
+		check = vset_get(vs, i);
+		EXPECT_PRED2(valVersionEqual, check, v);
+		val_free(check);
+		val_free(v);
+	}
+}
+
+
+TEST_F(CompactVsetTest, MaxVersions) {
+	val* v;
+	int n = VSET_COMPACT_MAX_VERSIONS + 10;
+	
+	StorageMaxOldVersions = VSET_COMPACT_MAX_VERSIONS;
+	for (int i = 1; i <= n; i++) {
+		v = createVal(i, i);
+		EXPECT_EQ(0, vset_add(vs, v));
+		val_free(v);
+	}
+	EXPECT_EQ(VSET_COMPACT_MAX_VERSIONS, vset_count(vs));
+	
+	v = vset_get(vs, n);
+	ASSERT_TRUE(v != NULL);
+	EXPECT_EQ(n, v->version);
+	val_free(v);
+}